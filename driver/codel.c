@@ -0,0 +1,114 @@
+#include "c_types.h"
+#include "osapi.h"
+
+#include "driver/codel.h"
+
+/*
+ * CoDel (RFC 8289) for the queues of the SLIP TX path, run when the head
+ * packet of a queue is about to go to the UART.
+ *
+ * A queue is too long, if the sojourn time of its packets stayed above
+ * the target for a whole interval with more than one frame waiting. Then
+ * the head packet is dropped and further drops follow in intervals that
+ * shrink with 1/sqrt(count), until the sojourn time is below target
+ * again. TCP sees the loss early and backs off, instead of filling all
+ * buffers up to the tail drop.
+ *
+ * All times are system_get_time() in us, compared with wrap-around.
+ */
+
+#define TIME_AFTER_EQ(a, b) ((int32_t)((a) - (b)) >= 0)
+
+static uint32_t codel_target_us = CODEL_TARGET_US;
+static uint32_t codel_interval_us = CODEL_INTERVAL_US;
+static uint32_t codel_rate;
+
+void ICACHE_FLASH_ATTR
+codel_set_rate(uint32_t bit_rate)
+{
+uint32_t mtu_us;
+
+    if (bit_rate == codel_rate || bit_rate == 0)
+	return;
+    codel_rate = bit_rate;
+
+    // 10 bits per byte on the line
+    mtu_us = (uint32_t)((uint64_t)CODEL_MTU * 10 * 1000000 / bit_rate);
+    codel_target_us = mtu_us > CODEL_TARGET_US ? mtu_us : CODEL_TARGET_US;
+    codel_interval_us = 2 * codel_target_us > CODEL_INTERVAL_US ? 2 * codel_target_us : CODEL_INTERVAL_US;
+}
+
+uint32_t ICACHE_FLASH_ATTR
+codel_target(void)
+{
+    return codel_target_us;
+}
+
+static uint16_t ICACHE_FLASH_ATTR
+codel_isqrt(uint16_t n)
+{
+uint16_t r = 1;
+
+    while ((uint32_t)(r + 1) * (r + 1) <= n)
+	r++;
+    return r;
+}
+
+static uint32_t ICACHE_FLASH_ATTR
+codel_control_law(uint32_t t, uint16_t count)
+{
+    return t + codel_interval_us / codel_isqrt(count);
+}
+
+static bool ICACHE_FLASH_ATTR
+codel_ok_to_drop(struct codel *c, uint32_t now, uint32_t sojourn, uint16_t backlog)
+{
+    if (sojourn < codel_target_us || backlog <= CODEL_MTU) {
+	c->first_above = 0;
+	return false;
+    }
+    if (c->first_above == 0) {
+	// 0 means below target, skip it on wrap-around
+	c->first_above = (now + codel_interval_us) | 1;
+	return false;
+    }
+    return TIME_AFTER_EQ(now, c->first_above);
+}
+
+bool ICACHE_FLASH_ATTR
+codel_drop(struct codel *c, uint32_t now, uint32_t sojourn, uint16_t backlog)
+{
+uint16_t delta;
+
+    if (!codel_ok_to_drop(c, now, sojourn, backlog)) {
+	c->dropping = false;
+	return false;
+    }
+
+    if (c->dropping) {
+	if (!TIME_AFTER_EQ(now, c->drop_next))
+	    return false;
+	c->count++;
+	c->drop_next = codel_control_law(c->drop_next, c->count);
+	return true;
+    }
+
+    // Start dropping. If it ended only recently, continue with about the
+    // rate that was reached then
+    c->dropping = true;
+    delta = c->count - c->lastcount;
+    if (delta > 1 && !TIME_AFTER_EQ(now, c->drop_next + 16 * codel_interval_us))
+	c->count = delta;
+    else
+	c->count = 1;
+    c->lastcount = c->count;
+    c->drop_next = codel_control_law(now, c->count);
+    return true;
+}
+
+void ICACHE_FLASH_ATTR
+codel_empty(struct codel *c)
+{
+    c->first_above = 0;
+    c->dropping = false;
+}
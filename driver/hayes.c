@@ -1,4 +1,5 @@
 #include "driver/hayes.h"
+#include "user_interface.h"
 
 /*
  * This aims to be as standard as possible a wrapper for the Hayes AT command
@@ -46,13 +47,14 @@ LOCAL void ICACHE_FLASH_ATTR h_init_pnp() {
     .prod_id = "ESRH", // ESP SLIP Router - Hayes
     .serial_no = "00000000", // WiFi MAC address?
     .class_id = "MODEM",
-    .device_id = "ESPESRH,ATM1152",
+    .driver_id = "ESPESRH,ATM1152",
     .user_name = "esp-slip-router Hayes-compatible modem",
     // Mod-8 of characters, as hex, MSD first
     .checksum = "00",
     .end = ')' // Static
   };
 }
+LOCAL void h_guard_start();
 void ICACHE_FLASH_ATTR h_init(sysconfig_p cfg) {
   // Hayes Initialise - set everything to a known state
   config = cfg;
@@ -77,7 +79,7 @@ void ICACHE_FLASH_ATTR h_init(sysconfig_p cfg) {
   REG_S(9) = 6;   // S9:  Carrier detect time, 1/10th second.
   REG_S(10) = 7;  // S10: Carrier loss wait time, 1/10th second
   REG_S(11) = 70; // S11: Tone duration and interval, milliseconds.
-  REG_S(12) = 50; // S12: Escape code guard time, half-seconds.
+  REG_S(12) = 50; // S12: Escape code guard time, 1/50th second.
   // S19: Inactivity/hang-up timer
   REG_S(21) = 10; // S21: Break time, 1/100th second.
   // S24: Pulsed DSR duration, 1/50th second.
@@ -96,6 +98,7 @@ void ICACHE_FLASH_ATTR h_init(sysconfig_p cfg) {
     modem.state.in_call = true;
     modem.state.online = true;
   }
+  h_guard_start();
 }
 LOCAL bool ICACHE_FLASH_ATTR h_is_num(char c) {
   // Basic ASCII is-numeric test
@@ -153,7 +156,7 @@ LOCAL void ICACHE_FLASH_ATTR h_print_h(char suffix[]) {
   os_sprintf(str, "%s %s", S_ID, suffix);
   h_print(str);
 }
-LOCAL void ICACHE_FLASH_ATTR h_serialise_pnp(char *buffer[]) {
+LOCAL void ICACHE_FLASH_ATTR h_serialise_pnp(char *buffer) {
   char pnpstr[256]; // PNP spec says this may be up to 256 chars
   // (1.0ESPESRH\01234567\MODEM\PNPC10E,PNPC103,PNPC107,PNPC10F\esp-slip-router Hayes-compatible modem\XX)
   /*
@@ -164,7 +167,7 @@ LOCAL void ICACHE_FLASH_ATTR h_serialise_pnp(char *buffer[]) {
   modem.id.eisa_id, modem.id.prod_id,
   modem.id.serial_no,
   modem.id.class_id,
-  modem.id.device_id,
+  modem.id.driver_id,
   modem.id.user_name,
   modem.id.end);
   uint8_t rem = uint8_t len = os_strlen(pnpstr);
@@ -175,7 +178,7 @@ LOCAL void ICACHE_FLASH_ATTR h_serialise_pnp(char *buffer[]) {
   os_sprintf(buffer, "%c%u%u%s%s%c%c%s%c%s%c",
   PNP_BEGIN, modem.id.upper_rev, modem.id.lower_rev,
   modem.id.eisa_id, modem.id.prod_id, PNP_EXTRA, PNP_EXTRA,
-  modem.id.class_id, PNP_EXTRA, modem.id.device_id, PNP_END);
+  modem.id.class_id, PNP_EXTRA, modem.id.driver_id, PNP_END);
 }
 LOCAL void ICACHE_FLASH_ATTR h_result_connbaud() {
   // Method to output the correct result upon connecting
@@ -465,16 +468,14 @@ LOCAL void ICACHE_FLASH_ATTR ht_ATI(uint8_t i) {
       config->bit_rate, REG_CR,
       modem.state.on_hook? "N " : "FF", REG_CR);
       h_print(outstr);
-      // Registers
-      os_sprintf(outstr,
-        "S00=%03u  S01=%03u  S02=%03u  S03=%03u  S04=%03u  S05=%03u  S06=%03u  S07=%03u",
-        REG_E(0), REG_E(1), REG_E(2), REG_E(3), REG_E(4), REG_E(5), REG_E(6), REG_E(7));
-      os_sprintf(outstr,
-        "S00=%03u  S01=%03u  S02=%03u  S03=%03u  S04=%03u  S05=%03u  S06=%03u  S07=%03u",
-        REG_E(0), REG_E(1), REG_E(2), REG_E(3), REG_E(4), REG_E(5), REG_E(6), REG_E(7));
-      os_sprintf(outstr,
-        "S00=%03u  S01=%03u  S02=%03u  S03=%03u  S04=%03u  S05=%03u  S06=%03u  S07=%03u",
-        REG_E(0), REG_E(1), REG_E(2), REG_E(3), REG_E(4), REG_E(5), REG_E(6), REG_E(7));
+      // Registers, eight per line
+      while(iter<sizeof(modem.prefs.regs)) {
+        os_sprintf(outstr, "S%02u=%03u  ", iter, REG_S(iter));
+        h_print_nocr(outstr);
+        if(++iter%8==0)
+          CHAR_OUT(REG_CR);
+      }
+      CHAR_OUT(REG_CR);
       break;
     case 5:
       // ATI5 - NVRAM Settings
@@ -506,7 +507,7 @@ LOCAL void ICACHE_FLASH_ATTR ht_ATI(uint8_t i) {
        * PnP can be implemented as a state machine I think, but may not be
        *  worthwhile to really do properly.
        */
-       h_serialise_pnp(&outstr);
+       h_serialise_pnp(outstr);
        h_print(outstr);
       break;
     case 10:
@@ -687,18 +688,18 @@ LOCAL void ht_AMP_F(char c) {
 // AT+...
 // V.250-compliant commands
 
-LOCAL void ICACHE_FLASH_ATTR h_cmdparse_amp(uint8_t i) {
+LOCAL uint8_t ICACHE_FLASH_ATTR h_cmdparse_amp(uint8_t i) {
   uint8_t taken=0;
   switch(modem.state.cmdbuf[i]) {
     case 'F':
       if(i+1 == modem.state.cmd_i) h_result(ERROR);
       else ht_AMP_F(modem.state.cmdbuf[++taken+i]);
-      return;
+      return ++taken;
     default:
       return ++taken;
   }
 }
-LOCAL void ICACHE_FLASH_ATTR h_cmdparse_plus(uint8_t i) {
+LOCAL uint8_t ICACHE_FLASH_ATTR h_cmdparse_plus(uint8_t i) {
   uint8_t taken=0;
   switch(modem.state.cmdbuf[i]) {
     default:
@@ -720,7 +721,7 @@ LOCAL void ICACHE_FLASH_ATTR h_cmdparse() {
       case 'D':
         // ATD[LPRS$][n...] - Dial number
         if(i+1 == modem.state.cmd_i) hz_ATD();
-        else i+=ht_ATD(++i);
+        else { i++; i+=ht_ATD(i); }
         return;
       case 'E':
         if(i+1 == modem.state.cmd_i) hz_ATE();
@@ -752,7 +753,7 @@ LOCAL void ICACHE_FLASH_ATTR h_cmdparse() {
       case 'S':
         // ATS$, ATSn?, ATSn=v
         if(i+1 == modem.state.cmd_i) h_result(ERROR);
-        else i+=h_ATS(++i);
+        else { i++; i+=h_ATS(i); }
         break;
       case 'V':
         if(i+1 == modem.state.cmd_i) hz_ATV();
@@ -767,7 +768,7 @@ LOCAL void ICACHE_FLASH_ATTR h_cmdparse() {
         return;
       case '&':
         if(i+1 == modem.state.cmd_i) h_result(ERROR);
-        else i+=h_cmdparse_amp(++i);
+        else { i++; i+=h_cmdparse_amp(i); }
         break;
       case '$':
         if(i>0 && modem.state.cmdbuf[i-1] == '&') ht_ATAMPDOLLAR();
@@ -815,31 +816,98 @@ LOCAL void ICACHE_FLASH_ATTR h_recv(char c) {
   // The docs mention 125ms as a default, but don't indicate if it can change
   modem.state.l_chr = c;
 }
-// Returns true if input was handled
-bool ICACHE_FLASH_ATTR h_handler(char c, void (*slip_rx)(struct netif*, u8_t), struct netif *slip_if, uint64_t *bytes_out) {
-  if(!modem.state.online) {
-    h_recv(c);
-    return true;
+/*
+ * Online data mode: the escape sequence is a run of exactly three REG_ESC
+ * with at least the guard time (S12) of silence before and after it. All
+ * chars of a FIFO block arrive back to back, so only the first char of a
+ * block can start a run, and a block that holds anything besides the run
+ * is plain data. h_rx_block() thus passes a block straight to the data
+ * receiver after one compare in the common case, and only holds back
+ * blocks that may be part of a run. h_guard_check() confirms the run, or
+ * releases the held chars as data, once the guard time is over.
+ */
+static uart_unload_block_fn h_data_rx;
+static uint32_t h_last_rx; // system_get_time() of the last received block
+static os_timer_t h_guard_timer;
+
+LOCAL uint32_t h_guard_us() {
+  // S12 is in 1/50th second, 0 disables the guard time
+  return REG_S(12) * 20000;
+}
+LOCAL void h_esc_release() {
+  // The held chars were not an escape sequence
+  uint8_t buf[3] = {REG_ESC, REG_ESC, REG_ESC};
+  uint8_t n = modem.state.n_escs;
+  modem.state.n_escs = 0;
+  modem.state.in_esc = false;
+  if(n > 0 && h_data_rx != NULL)
+    h_data_rx(buf, n);
+}
+// Called from the UART ISR with each block read from the RX FIFO
+void h_rx_block(uint8_t *data, uint16_t len, uart_unload_block_fn data_rx) {
+  uint32_t now = system_get_time();
+  uint32_t idle = now - h_last_rx;
+  uint32_t guard = h_guard_us();
+  uint16_t i;
+
+  h_data_rx = data_rx;
+  h_last_rx = now;
+  // Command mode: per char, off the hot path. Bytes after a command that
+  // went online (ATO, ATD) are data with no silence before them
+  while(len > 0 && !modem.state.online) {
+    h_recv(*data++);
+    len--;
+    idle = 0;
   }
-  if(c == REG_ESC) {
-    if(modem.state.in_esc && modem.state.n_escs == 2) {
-      modem.state.in_esc = false;
-      modem.state.n_escs = 0;
-      modem.state.online = false;
-      h_result(OKAY);
-      return true;
+  if(len == 0) return;
+
+  // Is the whole block a run of escape chars that fits the sequence?
+  for(i = 0; i < len && data[i] == REG_ESC; i++);
+  if(i == len && modem.state.n_escs + len <= 3) {
+    if(modem.state.n_escs > 0 && (idle < guard || guard == 0)) {
+      // continues the run held so far
+      modem.state.n_escs += len;
+      return;
     }
-    if(!modem.state.in_esc)
+    if(modem.state.n_escs == 0 && idle >= guard) {
+      modem.state.n_escs = len;
       modem.state.in_esc = true;
-    modem.state.n_escs++;
-    return true;
+      return;
+    }
   }
-  if(modem.state.in_esc) {
-    modem.state.in_esc = false;
-    while(modem.state.n_escs-->0) {
-      slip_rx(slip_if, REG_ESC);
-      (*bytes_out)++;
+  // A pause in the run that is longer than the guard time ends it just as
+  // data does, h_guard_check() may not have run yet
+  if(modem.state.n_escs > 0) {
+    h_esc_release();
+    if(i == len && len <= 3 && idle >= guard) {
+      modem.state.n_escs = len;
+      modem.state.in_esc = true;
+      return;
     }
   }
-  return false;
+  data_rx(data, len);
+}
+LOCAL void ICACHE_FLASH_ATTR h_guard_check(void *arg) {
+  bool escape = false;
+
+  // Shares the state with the UART ISR
+  ETS_UART_INTR_DISABLE();
+  if(modem.state.n_escs > 0 && system_get_time() - h_last_rx >= h_guard_us()) {
+    if(modem.state.n_escs == 3 && modem.state.online) {
+      modem.state.n_escs = 0;
+      modem.state.in_esc = false;
+      modem.state.online = false;
+      escape = true;
+    } else
+      h_esc_release();
+  }
+  ETS_UART_INTR_ENABLE();
+
+  if(escape)
+    h_result(OKAY);
+}
+LOCAL void ICACHE_FLASH_ATTR h_guard_start() {
+  os_timer_disarm(&h_guard_timer);
+  os_timer_setfn(&h_guard_timer, h_guard_check, NULL);
+  os_timer_arm(&h_guard_timer, HAYES_GUARD_POLL_MS, 1);
 }
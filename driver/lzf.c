@@ -0,0 +1,176 @@
+#include "c_types.h"
+#include "osapi.h"
+
+#include "driver/lzf.h"
+
+/*
+ * LZF compression (the format of liblzf) of single frames for the
+ * compressed link mode.
+ *
+ * Every frame is compressed on its own, a lost frame costs nothing but
+ * itself. To get matches in short frames anyway, both sides act as if
+ * each frame were preceded by the same static dictionary of strings
+ * common in HTTP and JSON. A host side implementation has to use the
+ * exact same bytes.
+ *
+ * Format: a control byte below 32 is followed by ctrl + 1 literal bytes.
+ * Otherwise it is a back reference: length - 2 in the upper 3 bits (7
+ * means an extra byte with length - 9 follows), the upper 5 bits of
+ * distance - 1 in the lower ones, then the low byte of distance - 1.
+ */
+
+static const char lzf_dict[] =
+    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: "
+    "\r\nConnection: keep-alive\r\nCache-Control: no-cache\r\nHost: "
+    "\r\nUser-Agent: \r\nAccept: */*\r\nGET / HTTP/1.1\r\nPOST /api/"
+    "{\"id\":\"\",\"name\":\"\",\"value\":\"\",\"time\":\"\",\"type\":\"\","
+    "\"data\":[{\"temperature\":\"humidity\":\"status\":\"ok\"}]}, true, false, null";
+
+#define LZF_DICT_SIZE   (sizeof(lzf_dict) - 1)
+#define LZF_HSIZE       (1 << LZF_HLOG)
+#define LZF_HEMPTY      0xffff
+#define LZF_MAX_LIT     32
+#define LZF_MAX_REF     (8 + 256)
+#define LZF_MAX_OFF     (1 << 13)
+
+static uint8_t lzf_buf[LZF_DICT_SIZE + LZF_FRAME_MAX];
+static uint16_t lzf_htab[LZF_HSIZE];
+static bool lzf_dict_loaded;
+
+static uint16_t ICACHE_FLASH_ATTR
+lzf_hash(uint8_t *p)
+{
+uint32_t v = ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2];
+
+    return (v * 2654435761u) >> (32 - LZF_HLOG);
+}
+
+uint8_t * ICACHE_FLASH_ATTR
+lzf_frame(void)
+{
+    if (!lzf_dict_loaded) {
+	os_memcpy(lzf_buf, lzf_dict, LZF_DICT_SIZE);
+	lzf_dict_loaded = true;
+    }
+    return &lzf_buf[LZF_DICT_SIZE];
+}
+
+// Writes the literals [from, to) in runs of up to LZF_MAX_LIT
+static uint16_t ICACHE_FLASH_ATTR
+lzf_literals(uint16_t from, uint16_t to, uint8_t *out, uint16_t op, uint16_t out_max)
+{
+uint16_t n;
+
+    while (from < to) {
+	n = to - from;
+	if (n > LZF_MAX_LIT)
+	    n = LZF_MAX_LIT;
+	if (op + 1 + n > out_max)
+	    return 0;
+	out[op++] = n - 1;
+	os_memcpy(&out[op], &lzf_buf[from], n);
+	op += n;
+	from += n;
+    }
+    return op;
+}
+
+uint16_t ICACHE_FLASH_ATTR
+lzf_compress(uint16_t len, uint8_t *out, uint16_t out_max)
+{
+uint16_t ip, end, ref, lit, op = 0;
+uint16_t i, n, max, off;
+
+    if (len > LZF_FRAME_MAX)
+	return 0;
+    lzf_frame();
+
+    // the dictionary is part of the history of every frame
+    os_memset(lzf_htab, 0xff, sizeof(lzf_htab));
+    for (i = 0; i + 3 <= LZF_DICT_SIZE; i++)
+	lzf_htab[lzf_hash(&lzf_buf[i])] = i;
+
+    ip = lit = LZF_DICT_SIZE;
+    end = LZF_DICT_SIZE + len;
+    while (ip + 3 <= end) {
+	i = lzf_hash(&lzf_buf[ip]);
+	ref = lzf_htab[i];
+	lzf_htab[i] = ip;
+
+	if (ref == LZF_HEMPTY || ip - ref > LZF_MAX_OFF ||
+	    lzf_buf[ref] != lzf_buf[ip] || lzf_buf[ref + 1] != lzf_buf[ip + 1] ||
+	    lzf_buf[ref + 2] != lzf_buf[ip + 2]) {
+	    ip++;
+	    continue;
+	}
+
+	max = end - ip;
+	if (max > LZF_MAX_REF)
+	    max = LZF_MAX_REF;
+	for (n = 3; n < max && lzf_buf[ref + n] == lzf_buf[ip + n]; n++)
+	    ;
+
+	if ((op = lzf_literals(lit, ip, out, op, out_max)) == 0 && lit != ip)
+	    return 0;
+	if (op + 3 > out_max)
+	    return 0;
+	off = ip - ref - 1;
+	if (n - 2 < 7) {
+	    out[op++] = ((n - 2) << 5) | (off >> 8);
+	} else {
+	    out[op++] = (7 << 5) | (off >> 8);
+	    out[op++] = n - 2 - 7;
+	}
+	out[op++] = off & 0xff;
+
+	// keep the positions inside the match for later references
+	for (i = ip + 1; i < ip + n && i + 3 <= end; i++)
+	    lzf_htab[lzf_hash(&lzf_buf[i])] = i;
+	ip += n;
+	lit = ip;
+    }
+
+    if (lit < end && (op = lzf_literals(lit, end, out, op, out_max)) == 0)
+	return 0;
+    return op;
+}
+
+int16_t ICACHE_FLASH_ATTR
+lzf_decompress(uint8_t *in, uint16_t len)
+{
+uint8_t *ip = in, *in_end = in + len;
+uint8_t *op = lzf_frame(), *op_end = op + LZF_FRAME_MAX;
+uint8_t *ref;
+uint16_t n, ctrl;
+
+    while (ip < in_end) {
+	ctrl = *ip++;
+
+	if (ctrl < LZF_MAX_LIT) {
+	    n = ctrl + 1;
+	    if (ip + n > in_end || op + n > op_end)
+		return -1;
+	    os_memcpy(op, ip, n);
+	    op += n;
+	    ip += n;
+	    continue;
+	}
+
+	n = ctrl >> 5;
+	if (n == 7) {
+	    if (ip >= in_end)
+		return -1;
+	    n += *ip++;
+	}
+	n += 2;
+	if (ip >= in_end)
+	    return -1;
+	ref = op - ((ctrl & 0x1f) << 8) - 1 - *ip++;
+	if (ref < lzf_buf || op + n > op_end)
+	    return -1;
+	// byte wise, source and destination may overlap
+	while (n--)
+	    *op++ = *ref++;
+    }
+    return op - lzf_frame();
+}
@@ -1,16 +1,36 @@
 #include "lwip/opt.h"
+#include "osapi.h"
 #include "lwip/sio.h"
 #include "gpio.h"
 
 #include "driver/uart.h"
+#include "driver/sio.h"
+#ifdef ENABLE_SLIP2
+#include "driver/softuart.h"
+#endif
 
 // UartDev is defined and initialized in rom code.
 extern UartDevice    UartDev;
-bool uart_poll;
 
 extern u32_t g_bit_rate;
+extern u8_t g_flow_control;
 extern uint64_t Bytes_in, Bytes_out;
 
+// sio_send(), sio_tryread() and sio_write() are on the per byte path and
+// stay in IRAM (no ICACHE_FLASH_ATTR), see "make iram-report" for the budget
+
+#ifdef ENABLE_SLIP2
+// Second serial device: RX is edge timestamped in the GPIO ISR, TX is
+// queued here and bit-banged in bursts by sio_poll()
+static Softuart sio_softuart;
+static uint8_t sio_softuart_tx[SLIP2_TX_BUFF];
+static bool sio_softuart_open;
+
+#define IS_SOFTUART(fd) ((fd) == &sio_softuart)
+#else
+#define IS_SOFTUART(fd) false
+#endif
+
 /**
  * Opens a serial device for communication.
  * 
@@ -18,12 +38,26 @@ extern uint64_t Bytes_in, Bytes_out;
  * @return handle to serial device if successful, NULL otherwise
  */
 sio_fd_t ICACHE_FLASH_ATTR sio_open(u8_t devnum) {
-  if (devnum = 2) {
+  if (devnum == SIO_DEV_UART0) {
     // Initialize HW UART
+    uart0_set_flow_ctrl(g_flow_control);
     uart_init(g_bit_rate);
 
     return &UartDev;
   }
+#ifdef ENABLE_SLIP2
+  if (devnum == SIO_DEV_SOFTUART) {
+    // Opened once, further calls return the same device
+    if (!sio_softuart_open) {
+      Softuart_SetPinRx(&sio_softuart, SLIP2_RX_GPIO);
+      Softuart_SetPinTx(&sio_softuart, SLIP2_TX_GPIO);
+      Softuart_Init(&sio_softuart, SLIP2_BIT_RATE);
+      Softuart_SetTxBuffer(&sio_softuart, sio_softuart_tx, sizeof(sio_softuart_tx));
+      sio_softuart_open = true;
+    }
+    return &sio_softuart;
+  }
+#endif
   return NULL;
 }
 
@@ -36,7 +70,13 @@ sio_fd_t ICACHE_FLASH_ATTR sio_open(u8_t devnum) {
  * 
  * @note This function will block until the character can be sent.
  */
-void ICACHE_FLASH_ATTR sio_send(u8_t c, sio_fd_t fd) {
+void sio_send(u8_t c, sio_fd_t fd) {
+#ifdef ENABLE_SLIP2
+  if (IS_SOFTUART(fd)) {
+    Softuart_Write(fd, &c, 1);
+    return;
+  }
+#endif
   Bytes_in++;
   tx_buff_enq(&c, 1);
 #ifdef STATUS_LED
@@ -55,7 +95,7 @@ void ICACHE_FLASH_ATTR sio_send(u8_t c, sio_fd_t fd) {
 u8_t ICACHE_FLASH_ATTR sio_recv(sio_fd_t fd) {
 u8_t c;
 
-  while (rx_buff_deq(&c, 1) == 0);
+  while (sio_tryread(fd, &c, 1) == 0);
   return c;  
 }
 
@@ -65,17 +105,16 @@ u8_t c;
  * @param fd serial device handle
  * @param data pointer to data buffer for receiving
  * @param len maximum length (in bytes) of data to receive
- * @return number of bytes actually received - may be 0 if aborted by sio_read_abort
+ * @return number of bytes actually received - may be 0
  * 
- * @note This function will block until data can be received. The blocking
- * can be cancelled by calling sio_read_abort().
+ * @note This function does not block: the NONOS SDK is single threaded, so
+ * it returns what is buffered, like sio_tryread().
  */
 u32_t ICACHE_FLASH_ATTR sio_read(sio_fd_t fd, u8_t *data, u32_t len) {
-u32_t r_len;
 
-  uart_poll = true;
-  while (r_len = rx_buff_deq(data, len) == 0 && uart_poll);
-  return r_len;
+  // Without an OS no other task can fill the buffer while we spin here,
+  // so a single attempt is all we can do
+  return sio_tryread(fd, data, len);
 }
 
 
@@ -88,8 +127,16 @@ u32_t r_len;
  * @param len maximum length (in bytes) of data to receive
  * @return number of bytes actually received
  */
-u32_t ICACHE_FLASH_ATTR sio_tryread(sio_fd_t fd, u8_t *data, u32_t len) {
-
+u32_t sio_tryread(sio_fd_t fd, u8_t *data, u32_t len) {
+#ifdef ENABLE_SLIP2
+  if (IS_SOFTUART(fd)) {
+    u32_t r_len;
+
+    for (r_len = 0; r_len < len && Softuart_Available(fd); r_len++)
+      data[r_len] = Softuart_Read(fd);
+    return r_len;
+  }
+#endif
   return rx_buff_deq(data, len);
 }
 
@@ -102,21 +149,69 @@ u32_t ICACHE_FLASH_ATTR sio_tryread(sio_fd_t fd, u8_t *data, u32_t len) {
  * @param len length (in bytes) of data to send
  * @return number of bytes actually sent
  * 
- * @note This function will block until all data can be sent.
+ * @note This function never blocks. If the TX buffer is full a partial
+ * write is returned, use tx_buff_notify() to learn when space is available
+ * (UART0) or sio_write_space() (softuart).
  */
-u32_t ICACHE_FLASH_ATTR sio_write(sio_fd_t fd, u8_t *data, u32_t len) {
+u32_t sio_write(sio_fd_t fd, u8_t *data, u32_t len) {
+u32_t w_len = 0;
 
-  tx_buff_enq(data, len);
+#ifdef ENABLE_SLIP2
+  if (IS_SOFTUART(fd))
+    return Softuart_Write(fd, data, len > 0xffff ? 0xffff : len);
+#endif
+  while (len > 0) {
+    u16_t chunk = len > 0xffff ? 0xffff : len;
+    u16_t done = tx_buff_enq((char *)data + w_len, chunk);
+
+    w_len += done;
+    len -= done;
+    if (done < chunk) break;
+  }
+  return w_len;
 }
 
 
 /**
- * Aborts a blocking sio_read() call.
+ * Aborts a blocking sio_read() call. sio_read() never blocks, so there
+ * is nothing to abort.
  * 
  * @param fd serial device handle
  */
 void ICACHE_FLASH_ATTR sio_read_abort(sio_fd_t fd) {
-   uart_poll = false;
 }
 
 
+
+
+/**
+ * Returns the free space of the TX buffer of the serial device.
+ * 
+ * @param fd serial device handle
+ * @return number of bytes sio_write() takes without a partial write
+ */
+u32_t ICACHE_FLASH_ATTR sio_write_space(sio_fd_t fd) {
+#ifdef ENABLE_SLIP2
+  if (IS_SOFTUART(fd))
+    return Softuart_TxSpace(fd);
+#endif
+  return tx_buff_space();
+}
+
+
+/**
+ * Drives a serial device without interrupt driven TX. No-op for UART0.
+ * 
+ * @param fd serial device handle
+ * @param max_bytes maximum number of queued bytes to send
+ * @return number of bytes sent
+ */
+u32_t ICACHE_FLASH_ATTR sio_poll(sio_fd_t fd, u32_t max_bytes) {
+#ifdef ENABLE_SLIP2
+  if (IS_SOFTUART(fd)) {
+    Softuart_Poll(fd);
+    return Softuart_Flush(fd, max_bytes > 0xffff ? 0xffff : max_bytes);
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,768 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "gpio.h"
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip.h"
+#include "lwip/inet_chksum.h"
+
+#include "driver/uart.h"
+#include "driver/slip.h"
+#include "driver/vjcomp.h"
+#include "driver/codel.h"
+#ifdef ENABLE_LZF
+#include "driver/lzf.h"
+#endif
+#include "router_stats.h"
+#include "trace.h"
+
+#include "user_interface.h"
+#ifdef ENABLE_BENCH
+#include "bench.h"
+#endif
+
+extern uint64_t Bytes_in, Bytes_out;
+extern uint32_t g_bit_rate;
+
+/*
+ * Escape sequences for the two special characters, indexed by
+ * (c == SLIP_ESC)
+ */
+static const uint8_t slip_esc_seq[2][2] = {
+    { SLIP_ESC, SLIP_ESC_END },
+    { SLIP_ESC, SLIP_ESC_ESC }
+};
+
+/*
+ * Packets waiting for space in the UART TX buffer, one queue per traffic
+ * class. They are copied (like etharp does for its queue), as the payload
+ * of forwarded packets may belong to the WiFi driver. Each queue runs
+ * CoDel on the enqueue times of its packets.
+ */
+struct slip_tx_queue {
+    struct pbuf *p[SLIP_TX_QUEUE_LEN];
+    uint16_t enc_len[SLIP_TX_QUEUE_LEN];    // uncompressed, bounds the ring space
+    uint32_t time[SLIP_TX_QUEUE_LEN];       // system_get_time() at enqueue
+    uint8_t head, count;
+    uint16_t bytes;
+    struct codel codel;
+};
+static struct slip_tx_queue slip_tx_queue[SLIP_TX_CLASSES];
+static uint8_t slip_tx_queued;              // packets in all classes
+static uint16_t slip_tx_queued_bytes;
+
+// Classify into the TX classes, else all packets are default
+static bool slip_qos = true;
+
+static const uint16_t slip_tx_prio_ports[] = SLIP_TX_PRIO_PORTS;
+
+/*
+ * Receive arena: fixed slots for decoded frames and a single producer
+ * (UART ISR) / single consumer (user task) index ring. The ISR only
+ * advances slip_rx_head after a frame is complete, the task only advances
+ * slip_rx_tail after the frame was copied, so no locking is needed.
+ */
+static uint8_t slip_rx_slot[SLIP_RX_SLOTS][SLIP_RX_SLOT_SIZE];
+static uint16_t slip_rx_slot_len[SLIP_RX_SLOTS];
+#ifdef ENABLE_BENCH
+static uint32_t slip_rx_slot_time[SLIP_RX_SLOTS];   // system_get_time() at END
+#endif
+static volatile uint8_t slip_rx_head, slip_rx_tail;
+// The frame at slip_rx_tail is expanded already and waits for a pbuf,
+// task only
+static bool slip_rx_tail_plain;
+
+// Decoder state, ISR only
+static uint16_t slip_rx_len;
+static bool slip_rx_esc, slip_rx_skip;
+// Set by the ISR when a frame was lost, the header decompressor has to
+// resync then
+static volatile bool slip_rx_lost;
+
+// CSLIP (RFC 1144 header compression) on the line
+static bool slip_cslip;
+
+#ifdef ENABLE_LZF
+// Compressed link mode, frames are LZF compressed where it helps
+static bool slip_lz;
+static uint8_t slip_lz_out[LZF_FRAME_MAX];
+#endif
+
+static os_timer_t slip_rx_retry_timer;
+
+// Frames with a valid IPv4 header, only counted while slip_rx_verify is set
+bool slip_rx_verify;
+uint32_t slip_rx_valid;
+
+/**
+ * Length of a run of bytes after SLIP encoding.
+ * In IRAM like slip_encode() and slip_output(), they touch every byte sent.
+ */
+static uint16_t
+slip_run_encoded_len(uint8_t *d, uint16_t n)
+{
+uint16_t len = n;
+uint16_t i;
+
+    for (i = 0; i < n; i++) {
+	if (d[i] == SLIP_END || d[i] == SLIP_ESC)
+	    len++;
+    }
+    return len;
+}
+
+/**
+ * Calculates the length of a packet after SLIP encoding, including the
+ * leading and trailing END. The packet is hdr followed by the pbuf chain
+ * without its first skip bytes (all in the first pbuf), as left by the
+ * header compression.
+ */
+static uint16_t
+slip_encoded_len(uint8_t *hdr, uint16_t hdr_len, struct pbuf *p, uint16_t skip)
+{
+struct pbuf *q;
+uint16_t len = 2;
+
+    len += slip_run_encoded_len(hdr, hdr_len);
+    for (q = p; q != NULL; q = q->next) {
+	len += slip_run_encoded_len((uint8_t *)q->payload + skip, q->len - skip);
+	skip = 0;
+    }
+    return len;
+}
+
+/**
+ * Puts a run of bytes SLIP encoded into the UART TX ring
+ */
+static void
+slip_encode_run(uint8_t *d, uint16_t n)
+{
+uint16_t i, run;
+uint8_t c;
+
+    for (run = i = 0; i < n; i++) {
+	c = d[i];
+	if (c != SLIP_END && c != SLIP_ESC)
+	    continue;
+
+	// flush the plain run and insert the escape sequence
+	tx_buff_put(&d[run], i - run);
+	tx_buff_put((uint8_t *)slip_esc_seq[c == SLIP_ESC], 2);
+	run = i + 1;
+    }
+    tx_buff_put(&d[run], n - run);
+}
+
+/**
+ * Encodes a packet (see slip_encoded_len()) into the UART TX ring, the
+ * caller checked the space.
+ * Must be called between tx_buff_begin() and tx_buff_commit().
+ */
+static void
+slip_encode(uint8_t *hdr, uint16_t hdr_len, struct pbuf *p, uint16_t skip, uint16_t enc_len)
+{
+struct pbuf *q;
+uint8_t c;
+
+    // Send END first to flush any line noise the peer received
+    c = SLIP_END;
+    tx_buff_put(&c, 1);
+
+    slip_encode_run(hdr, hdr_len);
+    for (q = p; q != NULL; q = q->next) {
+	slip_encode_run((uint8_t *)q->payload + skip, q->len - skip);
+	skip = 0;
+    }
+
+    c = SLIP_END;
+    tx_buff_put(&c, 1);
+
+    Bytes_in += enc_len;
+    router_stats.slip_tx_packets++;
+#ifdef STATUS_LED
+    // Turn LED on on traffic
+    GPIO_OUTPUT_SET (STATUS_LED, 0);
+#endif
+}
+
+/**
+ * Applies the header compression and the compressed link mode to p. The
+ * frame on the line is then *hdr followed by p without its first *skip
+ * bytes, or *hdr alone if NULL is returned. *enc_len is updated.
+ */
+static struct pbuf * ICACHE_FLASH_ATTR
+slip_tx_compress(struct pbuf *p, uint8_t **hdr, uint16_t *hdr_len, uint16_t *skip, uint16_t *enc_len)
+{
+#ifdef ENABLE_LZF
+uint16_t len, n, lz_enc_len;
+#endif
+
+    if (slip_cslip && vj_compress((uint8_t *)p->payload, p->len, *hdr, hdr_len, skip) != VJ_TYPE_IP)
+	*enc_len = slip_encoded_len(*hdr, *hdr_len, p, *skip);
+
+#ifdef ENABLE_LZF
+    if (!slip_lz)
+	return p;
+
+    len = *hdr_len + p->tot_len - *skip;
+    router_stats.lz_tx_raw += len;
+    if (len <= LZF_FRAME_MAX) {
+	os_memcpy(lzf_frame(), *hdr, *hdr_len);
+	pbuf_copy_partial(p, lzf_frame() + *hdr_len, p->tot_len - *skip, *skip);
+
+	// sent compressed only if that is shorter on the line
+	if ((n = lzf_compress(len, &slip_lz_out[1], len - 1)) != 0) {
+	    slip_lz_out[0] = LZF_FRAME_TYPE;
+	    lz_enc_len = slip_encoded_len(slip_lz_out, n + 1, NULL, 0);
+	    if (lz_enc_len < *enc_len) {
+		router_stats.lz_tx_comp += n + 1;
+		*hdr = slip_lz_out;
+		*hdr_len = n + 1;
+		*skip = 0;
+		*enc_len = lz_enc_len;
+		return NULL;
+	    }
+	}
+    }
+    router_stats.lz_tx_comp += len;
+#endif
+    return p;
+}
+
+/**
+ * Traffic class of an IPv4 packet. DSCP CS4 and above (EF, CS6, ...) or
+ * the old low delay TOS, ICMP up to SLIP_TX_ICMP_MAX bytes, the
+ * SLIP_TX_PRIO_PORTS and TCP segments without payload (the ACKs of
+ * uploads) are interactive. CS1, LE (RFC 8622)
+ * and the old throughput TOS are bulk, everything else is default.
+ * In IRAM like slip_output(), it runs for every packet sent.
+ */
+static SLIP_TX_CLASS
+slip_tx_classify(struct pbuf *p)
+{
+uint8_t *ip = (uint8_t *)p->payload;
+uint8_t *th;
+uint16_t hl, sport, dport;
+uint8_t dscp;
+int i;
+
+    if (p->len < IP_HLEN || (ip[0] >> 4) != 4)
+	return SLIP_TX_DEFAULT;
+
+    dscp = ip[1] >> 2;
+    if (dscp >= 32 || ip[1] == 0x10)
+	return SLIP_TX_INTERACTIVE;
+    if (dscp == 8 || dscp == 1 || ip[1] == 0x08)
+	return SLIP_TX_BULK;
+
+    // the interactive class has no byte limit, so no pings of any size
+    if (ip[9] == IP_PROTO_ICMP)
+	return p->tot_len <= SLIP_TX_ICMP_MAX ? SLIP_TX_INTERACTIVE : SLIP_TX_DEFAULT;
+
+    // only the first fragment has the ports
+    hl = (ip[0] & 0x0f) * 4;
+    if ((ip[9] != IP_PROTO_TCP && ip[9] != IP_PROTO_UDP) ||
+	((ip[6] & 0x1f) | ip[7]) != 0 || p->len < hl + 4)
+	return SLIP_TX_DEFAULT;
+
+    th = &ip[hl];
+    sport = (th[0] << 8) | th[1];
+    dport = (th[2] << 8) | th[3];
+    for (i = 0; i < sizeof(slip_tx_prio_ports)/sizeof(slip_tx_prio_ports[0]); i++) {
+	if (sport == slip_tx_prio_ports[i] || dport == slip_tx_prio_ports[i])
+	    return SLIP_TX_INTERACTIVE;
+    }
+
+    // no payload: the total length is just the IP and TCP header
+    if (ip[9] == IP_PROTO_TCP && p->len > hl + 12 &&
+	((ip[2] << 8) | ip[3]) == hl + (th[12] >> 4) * 4)
+	return SLIP_TX_INTERACTIVE;
+
+    return SLIP_TX_DEFAULT;
+}
+
+/**
+ * Max. fill of the UART TX ring: the bytes of SLIP_TX_RING_MS on the line
+ * at the current bit rate (10 bits per byte). The rest of the backlog
+ * waits in the class queues, where it can be scheduled and dropped.
+ * In IRAM, slip_tx_fits() asks for it per packet.
+ */
+static uint16_t
+slip_tx_ring_limit(void)
+{
+uint32_t limit = g_bit_rate / 10 * SLIP_TX_RING_MS / 1000;
+
+    if (limit < SLIP_TX_RING_MIN)
+	limit = SLIP_TX_RING_MIN;
+    if (limit > UART_TX_BUFFER_SIZE)
+	limit = UART_TX_BUFFER_SIZE;
+    return limit;
+}
+
+/**
+ * Max. bytes held back in the default and bulk class together: the bytes
+ * of SLIP_TX_QUEUE_MS on the line, at least two full frames and at most
+ * SLIP_TX_QUEUE_BYTES for the heap.
+ */
+static uint16_t ICACHE_FLASH_ATTR
+slip_tx_queue_limit(void)
+{
+uint32_t limit = g_bit_rate / 10 * SLIP_TX_QUEUE_MS / 1000;
+
+    if (limit < SLIP_TX_QUEUE_MIN)
+	limit = SLIP_TX_QUEUE_MIN;
+    if (limit > SLIP_TX_QUEUE_BYTES)
+	limit = SLIP_TX_QUEUE_BYTES;
+    return limit;
+}
+
+/**
+ * Whether a frame of enc_len bytes may go into the UART TX ring now: it
+ * fits and the ring is below its limit. So at least one frame
+ * always gets in, whatever the limit. The space only grows in the ISR, a
+ * true result holds until the caller writes.
+ */
+static bool
+slip_tx_fits(uint16_t enc_len)
+{
+uint16_t space = tx_buff_space();
+
+    return space >= enc_len && UART_TX_BUFFER_SIZE - space < slip_tx_ring_limit();
+}
+
+/**
+ * Compresses a packet and encodes it into the UART TX ring, the caller
+ * checked slip_tx_fits() for its uncompressed enc_len.
+ */
+static void
+slip_tx_send(struct pbuf *p, uint16_t enc_len)
+{
+uint8_t hdr_buf[VJ_MAX_HDR];
+uint8_t *hdr = hdr_buf;
+uint16_t hdr_len = 0, skip = 0;
+
+    // the codecs run from flash, plain SLIP calls nothing there
+#ifdef ENABLE_LZF
+    if (slip_cslip || slip_lz)
+#else
+    if (slip_cslip)
+#endif
+	p = slip_tx_compress(p, &hdr, &hdr_len, &skip, &enc_len);
+
+    tx_buff_begin();
+    slip_encode(hdr, hdr_len, p, skip, enc_len);
+    tx_buff_commit();
+}
+
+/**
+ * Takes the head packet off a class queue.
+ */
+static struct pbuf * ICACHE_FLASH_ATTR
+slip_tx_dequeue(struct slip_tx_queue *tq)
+{
+struct pbuf *q = tq->p[tq->head];
+
+    tq->p[tq->head] = NULL;
+    tq->head = (tq->head + 1) % SLIP_TX_QUEUE_LEN;
+    tq->count--;
+    tq->bytes -= q->tot_len;
+    slip_tx_queued--;
+    slip_tx_queued_bytes -= q->tot_len;
+    if (tq->count == 0)
+	codel_empty(&tq->codel);
+    return q;
+}
+
+/**
+ * Moves held back packets into the UART TX ring as long as they may go,
+ * the interactive class first, and re-arms the TX space notification for
+ * the rest. Strict priority is fine here: the interactive class carries
+ * small packets at a low rate and cannot starve the others for long, bulk
+ * is meant to get only what is left.
+ *
+ * A packet that may go is first checked by CoDel, a queue that stood
+ * above the target for too long loses its head packets instead.
+ */
+static void ICACHE_FLASH_ATTR
+slip_tx_run(void)
+{
+struct slip_tx_queue *tq;
+struct pbuf *q;
+uint16_t enc_len, limit;
+uint32_t now;
+uint8_t cls;
+
+    codel_set_rate(g_bit_rate);
+
+    while (slip_tx_queued > 0) {
+	for (cls = 0; slip_tx_queue[cls].count == 0; cls++)
+	    ;
+	tq = &slip_tx_queue[cls];
+	enc_len = tq->enc_len[tq->head];
+
+	// Check and request with the TX interrupt masked, so the request
+	// cannot race with the ISR. If the frame may not go, the ring is not
+	// empty and the ISR will serve the request
+	tx_buff_begin();
+	if (!slip_tx_fits(enc_len)) {
+	    limit = slip_tx_ring_limit();
+	    tx_buff_notify(enc_len > UART_TX_BUFFER_SIZE - limit ? enc_len : UART_TX_BUFFER_SIZE - limit + 1);
+	    tx_buff_commit();
+	    return;
+	}
+	tx_buff_commit();
+
+	now = system_get_time();
+	if (codel_drop(&tq->codel, now, now - tq->time[tq->head], tq->bytes)) {
+	    pbuf_free(slip_tx_dequeue(tq));
+	    router_stats.slip_tx_dropped++;
+	    router_stats.codel_drop++;
+	    continue;
+	}
+
+	q = slip_tx_dequeue(tq);
+	slip_tx_send(q, enc_len);
+	router_stats.qos_tx[cls]++;
+	pbuf_free(q);
+    }
+}
+
+/**
+ * Holds back a copy of p in the queue of its class. The tail is dropped
+ * if the class queue is full, or for the default and bulk class if the
+ * bytes of all queues would exceed slip_tx_queue_limit().
+ */
+static err_t ICACHE_FLASH_ATTR
+slip_tx_enqueue(struct pbuf *p, SLIP_TX_CLASS cls, uint16_t enc_len)
+{
+struct slip_tx_queue *tq = &slip_tx_queue[cls];
+struct pbuf *q;
+uint8_t idx;
+
+    if (tq->count >= SLIP_TX_QUEUE_LEN ||
+	(cls != SLIP_TX_INTERACTIVE && slip_tx_queued_bytes + p->tot_len > slip_tx_queue_limit())) {
+	router_stats.slip_tx_dropped++;
+	router_stats.qos_drop[cls]++;
+	return ERR_MEM;
+    }
+
+    if ((q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM)) == NULL) {
+	router_stats.slip_tx_dropped++;
+	router_stats.pbuf_alloc_fail++;
+	return ERR_MEM;
+    }
+    pbuf_copy_partial(p, q->payload, p->tot_len, 0);
+
+    idx = (tq->head + tq->count) % SLIP_TX_QUEUE_LEN;
+    tq->p[idx] = q;
+    tq->enc_len[idx] = enc_len;
+    tq->time[idx] = system_get_time();
+    tq->count++;
+    tq->bytes += q->tot_len;
+    slip_tx_queued++;
+    slip_tx_queued_bytes += q->tot_len;
+
+    slip_tx_run();
+    return ERR_OK;
+}
+
+/**
+ * Send a pbuf chain out on the SLIP line.
+ *
+ * The chain is encoded straight into the UART TX ring: runs without
+ * special characters are copied in one piece and the TX interrupt is
+ * masked only once for the whole packet. Stats and LED are updated once
+ * per packet.
+ *
+ * The ring is only filled up to SLIP_TX_RING_MS of line time. Everything
+ * else waits in a queue per class and slip_output_resume() moves it into
+ * the ring when the UART signals free space, the interactive class first
+ * if QoS (slip_set_qos()) classified the packets. So a keystroke waits
+ * behind one frame of a download instead of 4 KiB in the ring. The queues
+ * are kept short by CoDel, the tail is dropped only if the queue of the
+ * class is full.
+ *
+ * With CSLIP the TCP/IP header is compressed only when the packet goes
+ * into the ring, as the peer sees the packets in that order and a drop
+ * after compression would leave it with a wrong header state. Compression
+ * runs before the TX interrupt is masked.
+ *
+ * @param netif the lwip network interface structure for this slipif
+ * @param p the pbuf chain packet to send
+ * @param ipaddr the ip address to send the packet to (not used for slipif)
+ * @return ERR_OK if the packet was sent or queued, ERR_MEM if it was dropped
+ */
+err_t
+slip_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+SLIP_TX_CLASS cls;
+uint16_t enc_len;
+
+    // a compressed frame is never longer after encoding than this, so
+    // the space checks hold for both
+    enc_len = slip_encoded_len(NULL, 0, p, 0);
+    if (enc_len > UART_TX_BUFFER_SIZE) {
+	router_stats.slip_tx_dropped++;
+	return ERR_MEM;
+    }
+
+    cls = slip_qos ? slip_tx_classify(p) : SLIP_TX_DEFAULT;
+
+    if (slip_tx_queued == 0 && slip_tx_fits(enc_len)) {
+	slip_tx_send(p, enc_len);
+	router_stats.qos_tx[cls]++;
+	return ERR_OK;
+    }
+    return slip_tx_enqueue(p, cls, enc_len);
+}
+
+/**
+ * Sends the held back packets as long as they may go into the UART TX
+ * ring and re-arms the TX space notification for the rest.
+ *
+ * @param netif the lwip network interface structure for this slipif
+ */
+void ICACHE_FLASH_ATTR
+slip_output_resume(struct netif *netif)
+{
+    slip_tx_run();
+}
+
+/**
+ * Decodes received SLIP bytes into the arena.
+ *
+ * Runs in ISR context, so it lives in IRAM and calls nothing in flash.
+ * When all slots are full, the frame is dropped up to the next END.
+ *
+ * @param data received bytes
+ * @param len number of bytes
+ */
+void
+slip_rx_bytes(uint8_t *data, uint16_t len)
+{
+uint16_t i;
+uint8_t c;
+
+    for (i = 0; i < len; i++) {
+	c = data[i];
+
+	if (c == SLIP_END) {
+	    if (slip_rx_len > 0 && !slip_rx_skip) {
+		// commit the frame to the consumer
+		slip_rx_slot_len[slip_rx_head % SLIP_RX_SLOTS] = slip_rx_len;
+#ifdef ENABLE_BENCH
+		slip_rx_slot_time[slip_rx_head % SLIP_RX_SLOTS] = system_get_time();
+#endif
+		slip_rx_head++;
+		router_stats.slip_rx_packets++;
+	    }
+	    slip_rx_len = 0;
+	    slip_rx_esc = false;
+	    slip_rx_skip = false;
+	    continue;
+	}
+	if (slip_rx_skip)
+	    continue;
+
+	if (slip_rx_esc) {
+	    slip_rx_esc = false;
+	    if (c == SLIP_ESC_END) {
+		c = SLIP_END;
+	    } else if (c == SLIP_ESC_ESC) {
+		c = SLIP_ESC;
+	    } else {
+		// protocol violation, drop the frame
+		router_stats.slip_rx_errors++;
+		slip_rx_lost = slip_rx_skip = true;
+		continue;
+	    }
+	} else if (c == SLIP_ESC) {
+	    slip_rx_esc = true;
+	    continue;
+	}
+
+	if (slip_rx_len == 0 &&
+	    (uint8_t)(slip_rx_head - slip_rx_tail) >= SLIP_RX_SLOTS) {
+	    // no slot free for a new frame
+	    router_stats.slip_rx_dropped++;
+	    slip_rx_lost = slip_rx_skip = true;
+	    continue;
+	}
+	if (slip_rx_len >= SLIP_RX_SLOT_SIZE) {
+	    router_stats.slip_rx_errors++;
+	    slip_rx_lost = slip_rx_skip = true;
+	    continue;
+	}
+	slip_rx_slot[slip_rx_head % SLIP_RX_SLOTS][slip_rx_len++] = c;
+    }
+}
+
+/**
+ * Checks version, header length and header checksum of a decoded frame.
+ * Noise on a line with mismatched bit rates may well contain END bytes,
+ * but practically never a valid IPv4 header.
+ */
+static bool ICACHE_FLASH_ATTR
+slip_rx_ip_valid(uint8_t *data, uint16_t len)
+{
+uint16_t hlen;
+
+    if (len < IP_HLEN || (data[0] >> 4) != 4)
+	return false;
+    hlen = (data[0] & 0x0f) * 4;
+    if (hlen < IP_HLEN || hlen > len)
+	return false;
+    return inet_chksum(data, hlen) == 0;
+}
+
+/**
+ * Turns a compressed or CSLIP frame in the arena into a plain IP packet
+ * in place. Returns false if it has to be dropped.
+ */
+static bool ICACHE_FLASH_ATTR
+slip_rx_uncompress(uint8_t idx)
+{
+uint8_t *data = slip_rx_slot[idx];
+uint16_t len = slip_rx_slot_len[idx];
+uint8_t hdr[VJ_MAX_HDR];
+uint16_t hdr_len;
+int16_t n;
+
+#ifdef ENABLE_LZF
+    if (slip_lz) {
+	router_stats.lz_rx_comp += len;
+	if (data[0] == LZF_FRAME_TYPE) {
+	    if ((n = lzf_decompress(&data[1], len - 1)) < 0 || n > SLIP_RX_SLOT_SIZE) {
+		vj_toss();
+		return false;
+	    }
+	    os_memcpy(data, lzf_frame(), n);
+	    slip_rx_slot_len[idx] = len = n;
+	}
+	router_stats.lz_rx_raw += len;
+    }
+#endif
+    if (!slip_cslip)
+	return true;
+
+    if (slip_rx_lost) {
+	slip_rx_lost = false;
+	vj_toss();
+    }
+
+    if (data[0] & VJ_TYPE_COMPRESSED_TCP) {
+	if ((n = vj_uncompress(data, len, hdr, &hdr_len)) < 0)
+	    return false;
+	if (len - n + hdr_len > SLIP_RX_SLOT_SIZE) {
+	    vj_toss();
+	    return false;
+	}
+	os_memmove(&data[hdr_len], &data[n], len - n);
+	os_memcpy(data, hdr, hdr_len);
+	slip_rx_slot_len[idx] = len - n + hdr_len;
+	return true;
+    }
+
+    if (data[0] >= VJ_TYPE_UNCOMPRESSED_TCP)
+	return vj_remember(data, len);
+
+    return true;
+}
+
+void ICACHE_FLASH_ATTR
+slip_set_cslip(bool on)
+{
+    vj_init();
+    slip_cslip = on;
+}
+
+bool ICACHE_FLASH_ATTR
+slip_get_cslip(void)
+{
+    return slip_cslip;
+}
+
+void ICACHE_FLASH_ATTR
+slip_set_qos(bool on)
+{
+    slip_qos = on;
+}
+
+bool ICACHE_FLASH_ATTR
+slip_get_qos(void)
+{
+    return slip_qos;
+}
+
+#ifdef ENABLE_LZF
+void ICACHE_FLASH_ATTR
+slip_set_lz(bool on)
+{
+    slip_lz = on;
+}
+
+bool ICACHE_FLASH_ATTR
+slip_get_lz(void)
+{
+    return slip_lz;
+}
+#endif
+
+static void ICACHE_FLASH_ATTR
+slip_rx_retry(void *arg)
+{
+    slip_process_rxqueue((struct netif *)arg);
+}
+
+/**
+ * Copies the completed frames from the arena into pbufs and feeds them
+ * into the stack. If the pbuf pool is empty, the frames stay in the arena
+ * and delivery is retried shortly. CSLIP frames are expanded first.
+ *
+ * @param netif the SLIP netif
+ */
+void ICACHE_FLASH_ATTR
+slip_process_rxqueue(struct netif *netif)
+{
+struct pbuf *p;
+uint8_t idx;
+
+    while (slip_rx_tail != slip_rx_head) {
+	idx = slip_rx_tail % SLIP_RX_SLOTS;
+
+	// the slot holds plain IP afterwards, a retry neither expands it nor
+	// counts it twice
+	if (!slip_rx_tail_plain && !slip_rx_uncompress(idx)) {
+	    router_stats.slip_rx_errors++;
+	    slip_rx_tail++;
+	    continue;
+	}
+	slip_rx_tail_plain = true;
+
+	p = pbuf_alloc(PBUF_LINK, slip_rx_slot_len[idx], PBUF_POOL);
+	if (p == NULL) {
+	    router_stats.pbuf_alloc_fail++;
+	    os_timer_disarm(&slip_rx_retry_timer);
+	    os_timer_setfn(&slip_rx_retry_timer, slip_rx_retry, netif);
+	    os_timer_arm(&slip_rx_retry_timer, SLIP_RX_RETRY_MS, 0);
+	    return;
+	}
+	pbuf_take(p, slip_rx_slot[idx], slip_rx_slot_len[idx]);
+	if (slip_rx_verify && slip_rx_ip_valid(slip_rx_slot[idx], slip_rx_slot_len[idx]))
+	    slip_rx_valid++;
+#ifdef ENABLE_BENCH
+	bench_rx_latency(system_get_time() - slip_rx_slot_time[idx]);
+#endif
+
+	// slot is free again for the ISR
+	slip_rx_tail_plain = false;
+	slip_rx_tail++;
+
+	TRACE(TRACE_IP_INPUT, p->tot_len);
+	if (netif->input(p, netif) != ERR_OK)
+	    pbuf_free(p);
+	TRACE(TRACE_IP_INPUT_END, 0);
+    }
+}
@@ -103,6 +103,10 @@ void ICACHE_FLASH_ATTR Softuart_Init(Softuart *s, uint32_t baudrate)
 	//disable rs485
 	s->is_rs485 = 0;
 
+	//no byte in reception
+	s->rx.busy = 0;
+	s->rx.frame_error = 0;
+
 	if(! _Softuart_Instances_Count) {
 		os_printf("SOFTUART initialize gpio\r\n");
 		//Initilaize gpio subsystem
@@ -193,88 +197,109 @@ void ICACHE_FLASH_ATTR Softuart_Init(Softuart *s, uint32_t baudrate)
 	os_printf("SOFTUART INIT DONE\r\n");
 }
 
-void Softuart_Intr_Handler(Softuart *s)
+//store byte in buffer, if it is full set the overflow flag
+static void Softuart_Store(Softuart *s, uint8_t d)
 {
-	uint8_t level, gpio_id;
-// clear gpio status. Say ESP8266EX SDK Programming Guide in  5.1.6. GPIO interrupt handler
+	uint16_t next = (s->buffer.receive_buffer_tail + 1) % SOFTUART_MAX_RX_BUFF;
 
-    uint32_t gpio_status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
-	gpio_id = Softuart_Bitcount(gpio_status);
+	if (next != s->buffer.receive_buffer_head)
+	{
+	  // save new data in buffer: tail points to where byte goes
+	  s->buffer.receive_buffer[s->buffer.receive_buffer_tail] = d;
+	  s->buffer.receive_buffer_tail = next;
+	}
+	else
+	{
+	  s->buffer.buffer_overflow = 1;
+	}
+}
 
-	//if interrupt was by an attached rx pin
-    if (gpio_id != 0xFF)
-    {
-		//load instance which has rx pin on interrupt pin attached
-		s = _Softuart_GPIO_Instances[gpio_id];
+//the line had 'level' in all bit cells from rx.cell up to (not incl.) 'upto'
+static void Softuart_Fill(Softuart *s, uint32_t upto, uint8_t level)
+{
+	if (upto > 9) upto = 9;
+	for (; s->rx.cell < upto; s->rx.cell++) {
+		if (level) s->rx.data |= 1 << (s->rx.cell - 1);
+	}
+}
 
-// disable interrupt for GPIO0
-        gpio_pin_intr_state_set(GPIO_ID_PIN(s->pin_rx.gpio_id), GPIO_PIN_INTR_DISABLE);
-
-// Do something, for example, increment whatyouwant indirectly
-		//check level
-		level = GPIO_INPUT_GET(GPIO_ID_PIN(s->pin_rx.gpio_id));
-		if(!level) {
-			//pin is low
-			//therefore we have a start bit
-
-			//wait till start bit is half over so we can sample the next one in the center
-			os_delay_us(s->bit_time/2);	
-
-			//now sample bits
-			unsigned i;
-			unsigned d = 0;
-			unsigned start_time = 0x7FFFFFFF & system_get_time();
-
-			for(i = 0; i < 8; i ++ )
-			{
-				while ((0x7FFFFFFF & system_get_time()) < (start_time + (s->bit_time*(i+1))))
-				{
-					//If system timer overflow, escape from while loop
-					if ((0x7FFFFFFF & system_get_time()) < start_time){break;}
-				}
-				//shift d to the right
-				d >>= 1;
-
-				//read bit
-				if(GPIO_INPUT_GET(GPIO_ID_PIN(s->pin_rx.gpio_id))) {
-					//if high, set msb of 8bit to 1
-					d |= 0x80;
-				}
-			}
+//one edge on the rx pin at time now, the line is at level after it
+static void Softuart_Edge(Softuart *s, uint32_t now, uint8_t level)
+{
+	if (s->rx.busy) {
+		//edges are on bit cell boundaries, round to the nearest one.
+		//Cell 0 is the start bit, 1..8 the data bits, 9 the stop bit
+		uint32_t cells = (now - s->rx.start + s->bit_time/2) / s->bit_time;
+
+		Softuart_Fill(s, cells, !level);
+		if (cells < 9)
+			return;
+
+		s->rx.busy = 0;
+		if (cells == 9 && !level) {
+			//falling edge into the stop bit
+			s->rx.frame_error = 1;
+			return;
+		}
+		Softuart_Store(s, s->rx.data);
+		if (cells == 9)
+			return;
+		//a falling edge after the stop bit is the next start bit
+	}
 
-			//store byte in buffer
-
-			// if buffer full, set the overflow flag and return
-			uint8 next = (s->buffer.receive_buffer_tail + 1) % SOFTUART_MAX_RX_BUFF;
-			if (next != s->buffer.receive_buffer_head)
-			{
-			  // save new data in buffer: tail points to where byte goes
-			  s->buffer.receive_buffer[s->buffer.receive_buffer_tail] = d; // save new byte
-			  s->buffer.receive_buffer_tail = next;
-			} 
-			else 
-			{
-			  s->buffer.buffer_overflow = 1;
-			}
+	if (!level) {
+		s->rx.start = now;
+		s->rx.cell = 1;
+		s->rx.data = 0;
+		s->rx.busy = 1;
+	}
+}
 
-			//wait for stop bit
-			os_delay_us(s->bit_time);	
+//The handler only timestamps the edge and does the bookkeeping of the
+//decoder, a few us per edge instead of busy waiting a whole byte. The
+//last byte of a burst may end without an edge (high data bits into the
+//stop bit), Softuart_Poll() completes it
+void Softuart_Intr_Handler(Softuart *s)
+{
+	uint32_t now = system_get_time();
+	uint8_t gpio_id;
+// clear gpio status. Say ESP8266EX SDK Programming Guide in  5.1.6. GPIO interrupt handler
 
-			//done
-		}
+	uint32_t gpio_status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
+	uint32_t pending = gpio_status;
 
-		//clear interrupt
-        GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status);
+	//clear interrupt, no matter from which pin, otherwise this interrupt
+	//will be called again forever. An edge from now on raises it again
+	GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status);
 
-// Reactivate interrupts for GPIO0
-        gpio_pin_intr_state_set(GPIO_ID_PIN(s->pin_rx.gpio_id), 3);
-	} else {
-		//clear interrupt, no matter from which pin
-		//otherwise, this interrupt will be called again forever
-        GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status);
+	while ((gpio_id = Softuart_Bitcount(pending)) < SOFTUART_GPIO_COUNT)
+	{
+		pending &= ~BIT(gpio_id);
+
+		//load instance which has rx pin on interrupt pin attached
+		s = _Softuart_GPIO_Instances[gpio_id];
+		if (s != NULL)
+			Softuart_Edge(s, now, GPIO_INPUT_GET(GPIO_ID_PIN(gpio_id)));
 	}
 }
 
+void ICACHE_FLASH_ATTR Softuart_Poll(Softuart *s)
+{
+	ETS_GPIO_INTR_DISABLE();
+	if (s->rx.busy && system_get_time() - s->rx.start >= 10 * s->bit_time) {
+		//no edge since the last bit of the byte, the line kept its level
+		//through the stop bit: idle high is a byte, low a break
+		if (GPIO_INPUT_GET(GPIO_ID_PIN(s->pin_rx.gpio_id))) {
+			Softuart_Fill(s, 9, 1);
+			Softuart_Store(s, s->rx.data);
+		} else {
+			s->rx.frame_error = 1;
+		}
+		s->rx.busy = 0;
+	}
+	ETS_GPIO_INTR_ENABLE();
+}
+
 
 
 // Read data from buffer
@@ -308,18 +333,12 @@ static inline u8 chbit(u8 data, u8 bit)
     }
 }
 
-// Function for printing individual characters
-void Softuart_Putchar(Softuart *s, char data)
+//start bit, 8 data bits and stop bit, returns at the end of the stop bit
+static void Softuart_Frame(Softuart *s, uint8_t data)
 {
 	unsigned i;
 	unsigned start_time = 0x7FFFFFFF & system_get_time();
 
-	//if rs485 set tx enable
-	if(s->is_rs485 == 1)
-	{
-		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_rs485_tx_enable), 1);
-	}
-
 	//Start Bit
 	GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_tx.gpio_id), 0);
 	for(i = 0; i <= 8; i ++ )
@@ -329,16 +348,28 @@ void Softuart_Putchar(Softuart *s, char data)
 			//If system timer overflow, escape from while loop
 			if ((0x7FFFFFFF & system_get_time()) < start_time){break;}
 		}
-		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_tx.gpio_id), chbit(data,1<<i));
+		//data bits, then the stop bit
+		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_tx.gpio_id), i < 8 ? chbit(data,1<<i) : 1);
 	}
 
 	// Stop bit
-	while ((0x7FFFFFFF & system_get_time()) < (start_time + (s->bit_time*9)))
+	while ((0x7FFFFFFF & system_get_time()) < (start_time + (s->bit_time*10)))
 	{
 		//If system timer overflow, escape from while loop
 		if ((0x7FFFFFFF & system_get_time()) < start_time){break;}
 	}
-	GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_tx.gpio_id), 1);
+}
+
+// Function for printing individual characters
+void Softuart_Putchar(Softuart *s, char data)
+{
+	//if rs485 set tx enable
+	if(s->is_rs485 == 1)
+	{
+		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_rs485_tx_enable), 1);
+	}
+
+	Softuart_Frame(s, data);
 
 	// Delay after byte, for new sync
 	os_delay_us(s->bit_time*6);
@@ -390,3 +421,55 @@ uint8_t ICACHE_FLASH_ATTR Softuart_Readline(Softuart *s, char* Buffer, uint8_t M
 	return len;
 }
 
+
+void ICACHE_FLASH_ATTR Softuart_SetTxBuffer(Softuart *s, uint8_t *buf, uint16_t size)
+{
+	s->tx_buffer = buf;
+	s->tx_size = size;
+	s->tx_head = s->tx_tail = 0;
+}
+
+uint16_t Softuart_TxSpace(Softuart *s)
+{
+	if (s->tx_buffer == NULL)
+		return 0;
+	return s->tx_size - 1 - (s->tx_tail + s->tx_size - s->tx_head) % s->tx_size;
+}
+
+uint16_t Softuart_Write(Softuart *s, const uint8_t *data, uint16_t len)
+{
+	uint16_t i, space = Softuart_TxSpace(s);
+
+	if (len > space) len = space;
+	for (i = 0; i < len; i++) {
+		s->tx_buffer[s->tx_tail] = data[i];
+		s->tx_tail = (s->tx_tail + 1) % s->tx_size;
+	}
+	return len;
+}
+
+uint16_t ICACHE_FLASH_ATTR Softuart_Flush(Softuart *s, uint16_t max_bytes)
+{
+	uint16_t sent = 0;
+
+	if (s->tx_buffer == NULL || s->tx_head == s->tx_tail)
+		return 0;
+
+	if(s->is_rs485 == 1)
+	{
+		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_rs485_tx_enable), 1);
+	}
+
+	//back to back frames, the receiver syncs on each start bit
+	while (s->tx_head != s->tx_tail && sent < max_bytes) {
+		Softuart_Frame(s, s->tx_buffer[s->tx_head]);
+		s->tx_head = (s->tx_head + 1) % s->tx_size;
+		sent++;
+	}
+
+	if(s->is_rs485 == 1)
+	{
+		GPIO_OUTPUT_SET(GPIO_ID_PIN(s->pin_rs485_tx_enable), 0);
+	}
+	return sent;
+}
@@ -27,6 +27,8 @@
 #include "driver/uart.h"
 #include "osapi.h"
 #include "driver/uart_register.h"
+#include "router_stats.h"
+#include "trace.h"
 #include "mem.h"
 #include "os_type.h"
 
@@ -37,6 +39,21 @@ LOCAL struct UartBuffer* pTxBuffer = NULL;
 LOCAL struct UartBuffer* pRxBuffer = NULL;
 
 uart_unload_fn uart0_unload_fn = NULL;
+uart_unload_block_fn uart0_unload_block_fn = NULL;
+
+// Drain buffer for the block unload path, one full RX FIFO
+LOCAL uint8 rx_unload_buf[UART_FIFO_LEN];
+
+// Free space in the tx buffer requested by tx_buff_notify(), 0 if none
+LOCAL volatile uint16 tx_notify_space = 0;
+
+// FIFO interrupt thresholds of UART0, scaled with the bit rate
+LOCAL uint8 uart0_rx_full_thresh = UART_RX_FULL_THRESH_VAL;
+LOCAL uint8 uart0_tx_empty_thresh = UART_TX_EMPTY_THRESH_VAL;
+LOCAL uint8 uart0_rx_flow_thresh = 110;
+
+// Runtime selected HW flow control of UART0
+LOCAL UART_HwFlowCtrl uart0_flow_ctrl = USART_HardwareFlowControl_None;
 
 #define DBG  
 #define DBG1 uart1_sendStr_no_wait
@@ -45,6 +62,41 @@ uart_unload_fn uart0_unload_fn = NULL;
 
 LOCAL void uart0_rx_intr_handler(void *para);
 
+/******************************************************************************
+ * FunctionName : uart_calc_fifo_thresholds
+ * Description  : Internal used function
+ *                Derive the RX full and TX empty thresholds of UART0 from the
+ *                bit rate. At low rates the defaults (100/0x10) are used, at
+ *                higher rates the RX interrupt fires earlier and the TX FIFO is
+ *                refilled earlier, so the ISR latency does not overrun or starve the FIFO
+ * Parameters   : uint32 baud_rate - bit rate of UART0
+ * Returns      : NONE
+*******************************************************************************/
+LOCAL void ICACHE_FLASH_ATTR
+uart_calc_fifo_thresholds(uint32 baud_rate)
+{
+    uint32 margin = UART_LATENCY_BYTES(baud_rate);
+
+    if (margin < UART_FIFO_LEN - UART_RX_FULL_THRESH_VAL)
+        margin = UART_FIFO_LEN - UART_RX_FULL_THRESH_VAL;
+    if (margin > UART_FIFO_LEN / 2)
+        margin = UART_FIFO_LEN / 2;
+    uart0_rx_full_thresh = UART_FIFO_LEN - margin;
+
+    margin = UART_LATENCY_BYTES(baud_rate);
+    if (margin < UART_TX_EMPTY_THRESH_VAL)
+        margin = UART_TX_EMPTY_THRESH_VAL;
+    if (margin > UART_FIFO_LEN / 2)
+        margin = UART_FIFO_LEN / 2;
+    uart0_tx_empty_thresh = margin;
+
+    // RTS is deasserted early enough, that the bytes still in flight fit
+    margin = UART_FLOW_MARGIN(baud_rate);
+    if (margin > UART_FIFO_LEN / 2)
+        margin = UART_FIFO_LEN / 2;
+    uart0_rx_flow_thresh = UART_FIFO_LEN - margin;
+}
+
 /******************************************************************************
  * FunctionName : uart_config
  * Description  : Internal used function
@@ -71,6 +123,9 @@ uart_config(uint8 uart_no)
         #endif
     }
     uart_div_modify(uart_no, UART_CLK_FREQ / (UartDev.baut_rate));//SET BAUDRATE
+    if (uart_no == UART0){
+        uart_calc_fifo_thresholds(UartDev.baut_rate);
+    }
     
     WRITE_PERI_REG(UART_CONF0(uart_no), ((UartDev.exist_parity & UART_PARITY_EN_M)  <<  UART_PARITY_EN_S) //SET BIT AND PARITY MODE
                                                                         | ((UartDev.parity & UART_PARITY_M)  <<UART_PARITY_S )
@@ -84,14 +139,14 @@ uart_config(uint8 uart_no)
     if (uart_no == UART0){
         //set rx fifo trigger
         WRITE_PERI_REG(UART_CONF1(uart_no),
-        ((100 & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
+        ((uart0_rx_full_thresh & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
         #if UART_HW_RTS
-        ((110 & UART_RX_FLOW_THRHD) << UART_RX_FLOW_THRHD_S) |
+        ((uart0_rx_flow_thresh & UART_RX_FLOW_THRHD) << UART_RX_FLOW_THRHD_S) |
         UART_RX_FLOW_EN |   //enbale rx flow control
         #endif
         (0x02 & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S |
         UART_RX_TOUT_EN|
-        ((0x10 & UART_TXFIFO_EMPTY_THRHD)<<UART_TXFIFO_EMPTY_THRHD_S));//wjl 
+        ((uart0_tx_empty_thresh & UART_TXFIFO_EMPTY_THRHD)<<UART_TXFIFO_EMPTY_THRHD_S));//wjl 
         #if UART_HW_CTS
         SET_PERI_REG_MASK( UART_CONF0(uart_no),UART_TX_FLOW_EN);  //add this sentense to add a tx flow control via MTCK( CTS )
         #endif
@@ -217,24 +272,25 @@ uart0_rx_intr_handler(void *para)
 	/*IN NON-OS VERSION SDK, DO NOT USE "ICACHE_FLASH_ATTR" FUNCTIONS IN THE WHOLE HANDLER PROCESS*/
 	/*ALL THE FUNCTIONS CALLED IN INTERRUPT HANDLER MUST BE DECLARED IN RAM */
 	/*IF NOT , POST AN EVENT AND PROCESS IN SYSTEM TASK */
-    if(UART_FRM_ERR_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_FRM_ERR_INT_ST)){
+    uint32 int_st = READ_PERI_REG(UART_INT_ST(uart_no));
+    TRACE(TRACE_UART_ISR, int_st);
+
+    // Serve all pending sources in one go, at high bit rates RX and TX
+    // are usually due at the same time and each extra ISR entry costs
+    if(UART_FRM_ERR_INT_ST == (int_st & UART_FRM_ERR_INT_ST)){
         DBG1("FRM_ERR\r\n");
+        router_stats.uart_frm_err++;
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_FRM_ERR_INT_CLR);
-    }else if(UART_RXFIFO_FULL_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_FULL_INT_ST)){
-
-        uart_rx_intr_disable(UART0);
-        WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR);
-
-	external_unload();
-
-    }else if(UART_RXFIFO_TOUT_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_TOUT_INT_ST)){
+    }
+    if(int_st & (UART_RXFIFO_FULL_INT_ST | UART_RXFIFO_TOUT_INT_ST)){
 
         uart_rx_intr_disable(UART0);
-        WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_TOUT_INT_CLR);
+        WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR | UART_RXFIFO_TOUT_INT_CLR);
 
 	external_unload();
 
-    }else if(UART_TXFIFO_EMPTY_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_TXFIFO_EMPTY_INT_ST)){
+    }
+    if(UART_TXFIFO_EMPTY_INT_ST == (int_st & UART_TXFIFO_EMPTY_INT_ST)){
 	/* to output uart data from uart buffer directly in empty interrupt handler*/
 	/*instead of processing in system event, in order not to wait for current task/function to quit */
 
@@ -243,11 +299,13 @@ uart0_rx_intr_handler(void *para)
 
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_TXFIFO_EMPTY_INT_CLR);
         
-    }else if(UART_RXFIFO_OVF_INT_ST  == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_OVF_INT_ST)){
+    }
+    if(UART_RXFIFO_OVF_INT_ST  == (int_st & UART_RXFIFO_OVF_INT_ST)){
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_RXFIFO_OVF_INT_CLR);
         DBG1("RX OVF!!\r\n");
+        router_stats.uart_rx_ovf++;
     }
-
+    TRACE(TRACE_UART_ISR_END, 0);
 }
 
 /******************************************************************************
@@ -267,10 +325,37 @@ uart_init(UartBautRate uart0_br)
     UartDev.baut_rate = uart0_br;
 
     uart_config(UART0);
+    if (uart0_flow_ctrl != USART_HardwareFlowControl_None){
+        UART_SetFlowCtrl(UART0, uart0_flow_ctrl, uart0_rx_flow_thresh);
+    }
 
     ETS_UART_INTR_ENABLE();
 }
 
+/******************************************************************************
+ * FunctionName : uart0_set_flow_ctrl
+ * Description  : select the HW flow control of UART0 at runtime. Can be called
+ *                before uart_init() or anytime later, the RX flow threshold
+ *                follows the bit rate
+ * Parameters   : UART_HwFlowCtrl flow_ctrl - none, RTS, CTS or both
+ * Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+uart0_set_flow_ctrl(UART_HwFlowCtrl flow_ctrl)
+{
+    uart0_flow_ctrl = flow_ctrl & USART_HardwareFlowControl_CTS_RTS;
+    if (pTxBuffer != NULL){
+        // already running
+        UART_SetFlowCtrl(UART0, uart0_flow_ctrl, uart0_rx_flow_thresh);
+    }
+}
+
+UART_HwFlowCtrl ICACHE_FLASH_ATTR
+uart0_get_flow_ctrl(void)
+{
+    return uart0_flow_ctrl;
+}
+
 /******************************************************************************
  * FunctionName : uart_tx_one_char_no_wait
  * Description  : uart tx a single char without waiting for fifo 
@@ -378,10 +463,12 @@ uart_buf_free(struct UartBuffer* pBuff)
 }
 
 
-//rx buffer dequeue
-uint16 ICACHE_FLASH_ATTR
+//rx buffer dequeue (IRAM, called per read by sio)
+uint16
 rx_buff_deq(char* pdata, uint16 data_len )
 {
+    if(pRxBuffer == NULL || pRxBuffer->UartBuffSize == 0) return 0;
+
     uint16 buf_len =  (pRxBuffer->UartBuffSize- pRxBuffer->Space);
     uint16 tail_len = pRxBuffer->pUartBuff + pRxBuffer->UartBuffSize - pRxBuffer->pOutPos ;
     uint16 len_tmp = 0;
@@ -415,16 +502,33 @@ rx_buff_deq(char* pdata, uint16 data_len )
     return len_tmp; 
 }
 
-//move data from uart fifo to some buffer via the callback uart0_unload_fn()
+//move data from uart fifo to some buffer via the callback uart0_unload_block_fn()
+//(whole fifo in one call) or uart0_unload_fn() (one call per char)
 void external_unload()
 {
     uint8 fifo_len;
     uint8 fifo_data;
+    uint16 i;
+    uint8 passes;
 
     fifo_len = (READ_PERI_REG(UART_STATUS(UART0))>>UART_RXFIFO_CNT_S)&UART_RXFIFO_CNT;
-    while (fifo_len-- > 0) {
-      fifo_data = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
-      if (uart0_unload_fn != NULL) uart0_unload_fn(fifo_data);
+    if (uart0_unload_block_fn != NULL) {
+      // Bytes that arrived while the previous block was decoded are taken
+      // in the same interrupt instead of waiting for the next threshold
+      for (passes = 0; fifo_len > 0 && passes < UART_UNLOAD_MAX_PASSES; passes++) {
+        if (fifo_len > UART_FIFO_LEN) fifo_len = UART_FIFO_LEN;
+        TRACE(TRACE_RX_UNLOAD, fifo_len);
+        for (i = 0; i < fifo_len; i++) {
+          rx_unload_buf[i] = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+        }
+        uart0_unload_block_fn(rx_unload_buf, fifo_len);
+        fifo_len = (READ_PERI_REG(UART_STATUS(UART0))>>UART_RXFIFO_CNT_S)&UART_RXFIFO_CNT;
+      }
+    } else {
+      while (fifo_len-- > 0) {
+        fifo_data = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
+        if (uart0_unload_fn != NULL) uart0_unload_fn(fifo_data);
+      }
     }
 
     uart_rx_intr_enable(UART0);
@@ -461,29 +565,101 @@ void Uart_rx_buff_enq()
 }
 
 
-//fill the uart tx buffer
-void ICACHE_FLASH_ATTR
+//fill the uart tx buffer, returns the number of bytes accepted (IRAM, called per write by sio)
+uint16
 tx_buff_enq(char* pdata, uint16 data_len )
 {
-    CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+    tx_buff_begin();
 
     if(pTxBuffer == NULL){
         DBG1("\n\rnull, create buffer struct\n\r");
         pTxBuffer = Uart_Buf_Init(UART_TX_BUFFER_SIZE);
-        if(pTxBuffer!= NULL){
-            Uart_Buf_Cpy(pTxBuffer ,  pdata,  data_len );
-        }else{
+        if(pTxBuffer == NULL){
             DBG1("uart tx MALLOC no buf \n\r");
+            data_len = 0;
         }
-    }else{
-        if(data_len <= pTxBuffer->Space){
-        Uart_Buf_Cpy(pTxBuffer ,  pdata,  data_len);
-        }else{
-            DBG1("UART TX BUF FULL!!!!\n\r");
-        }
+    }
+    if(pTxBuffer != NULL && data_len > pTxBuffer->Space){
+        DBG1("UART TX BUF FULL!!!!\n\r");
+        router_stats.uart_tx_full += data_len - pTxBuffer->Space;
+        data_len = pTxBuffer->Space;
+    }
+    if(data_len > 0){
+        Uart_Buf_Cpy(pTxBuffer, pdata, data_len);
     }
 
-    SET_PERI_REG_MASK(UART_CONF1(UART0), (UART_TX_EMPTY_THRESH_VAL & UART_TXFIFO_EMPTY_THRHD)<<UART_TXFIFO_EMPTY_THRHD_S);
+    tx_buff_commit();
+    return data_len;
+}
+
+/******************************************************************************
+ * FunctionName : tx_buff_notify
+ * Description  : request a UART0_TX_SIGNAL once the tx buffer has at least
+ *                space bytes free. The signal is posted from the tx empty
+ *                interrupt, one request is served only once
+ * Parameters   : uint16 space - required free space, 0 cancels the request
+ * Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+tx_buff_notify(uint16 space)
+{
+    if(space > UART_TX_BUFFER_SIZE) space = UART_TX_BUFFER_SIZE;
+    tx_notify_space = space;
+}
+
+/******************************************************************************
+ * FunctionName : tx_buff_begin
+ * Description  : start a bulk write into the tx buffer: the TXFIFO_EMPTY interrupt
+ *                is masked until tx_buff_commit(), so a whole packet can be copied
+ *                with tx_buff_put() at the cost of one mask/unmask
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+// IRAM, called per packet, as are tx_buff_space/put/commit
+void
+tx_buff_begin(void)
+{
+    CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
+}
+
+/******************************************************************************
+ * FunctionName : tx_buff_space
+ * Description  : free space of the tx buffer
+ * Parameters   : NONE
+ * Returns      : number of bytes that can be put without loss
+*******************************************************************************/
+uint16
+tx_buff_space(void)
+{
+    if(pTxBuffer == NULL) return 0;
+    return pTxBuffer->Space;
+}
+
+/******************************************************************************
+ * FunctionName : tx_buff_put
+ * Description  : copy data into the tx buffer, only between tx_buff_begin()
+ *                and tx_buff_commit(). The caller checks tx_buff_space() before
+ * Parameters   : uint8 *pdata - data to be enqueued
+ *                uint16 data_len - data len
+ * Returns      : NONE
+*******************************************************************************/
+void
+tx_buff_put(uint8* pdata, uint16 data_len)
+{
+    if(pTxBuffer == NULL || data_len > pTxBuffer->Space) return;
+    Uart_Buf_Cpy(pTxBuffer, (char *)pdata, data_len);
+}
+
+/******************************************************************************
+ * FunctionName : tx_buff_commit
+ * Description  : end a bulk write, (re)start the transfer to the tx fifo
+ * Parameters   : NONE
+ * Returns      : NONE
+*******************************************************************************/
+void
+tx_buff_commit(void)
+{
+    SET_PERI_REG_BITS(UART_CONF1(UART0), UART_TXFIFO_EMPTY_THRHD, uart0_tx_empty_thresh, UART_TXFIFO_EMPTY_THRHD_S);
     SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
 }
 
@@ -528,6 +704,12 @@ void tx_start_uart_buffer(uint8 uart_no)
             len_tmp = data_len;
             tx_fifo_insert( pTxBuffer,len_tmp,uart_no);
         }
+        TRACE(TRACE_TX_FILL, len_tmp);
+        // Tell the task, when the space it waits for is available
+        if(tx_notify_space != 0 && pTxBuffer->Space >= tx_notify_space){
+            tx_notify_space = 0;
+            system_os_post(0, UART0_TX_SIGNAL, 0);
+        }
     }else{
         DBG1("pTxBuff null \n\r");
     }
@@ -591,6 +773,20 @@ void ICACHE_FLASH_ATTR
 UART_SetBaudrate(uint8 uart_no,uint32 baud_rate)
 {
     uart_div_modify(uart_no, UART_CLK_FREQ /baud_rate);
+    if (uart_no == UART0){
+        UART_SetFifoThresholds(uart_no, baud_rate);
+    }
+}
+
+void ICACHE_FLASH_ATTR
+UART_SetFifoThresholds(uint8 uart_no, uint32 baud_rate)
+{
+    if (uart_no != UART0) return;
+
+    uart_calc_fifo_thresholds(baud_rate);
+    SET_PERI_REG_BITS(UART_CONF1(uart_no), UART_RXFIFO_FULL_THRHD, uart0_rx_full_thresh, UART_RXFIFO_FULL_THRHD_S);
+    SET_PERI_REG_BITS(UART_CONF1(uart_no), UART_TXFIFO_EMPTY_THRHD, uart0_tx_empty_thresh, UART_TXFIFO_EMPTY_THRHD_S);
+    SET_PERI_REG_BITS(UART_CONF1(uart_no), UART_RX_FLOW_THRHD, uart0_rx_flow_thresh, UART_RX_FLOW_THRHD_S);
 }
 
 void ICACHE_FLASH_ATTR
@@ -0,0 +1,450 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/opt.h"
+#include "lwip/inet_chksum.h"
+
+#include "driver/vjcomp.h"
+
+/*
+ * Van Jacobson TCP/IP header compression (RFC 1144), wire compatible
+ * with the cslip mode of Linux slattach.
+ *
+ * Both sides keep the last header of each TCP connection in a slot. The
+ * compressor sends the first packet of a connection (and any packet it
+ * cannot express as a delta) as TYPE_UNCOMPRESSED_TCP with the slot id
+ * in the protocol field, later ones as TYPE_COMPRESSED_TCP: a change mask,
+ * the slot id if it changed, the TCP checksum and the deltas of the
+ * fields that changed, usually 3 to 7 bytes instead of 40.
+ *
+ * Headers are kept as byte arrays and read with byte accesses, the
+ * payload of a frame has no alignment guarantee.
+ */
+
+// Bits of the change mask
+#define NEW_C   0x40    // connection id follows
+#define NEW_I   0x20    // IP id delta
+#define NEW_S   0x08    // sequence number delta
+#define NEW_A   0x04    // ack delta
+#define NEW_W   0x02    // window delta
+#define NEW_U   0x01    // urgent pointer
+#define TCP_PUSH_BIT 0x10
+
+// Impossible combinations of the bits above used for the common cases
+// of unidirectional data (SPECIAL_D) and echoed interactive traffic
+#define SPECIAL_I   (NEW_S|NEW_W|NEW_U)
+#define SPECIAL_D   (NEW_S|NEW_A|NEW_W|NEW_U)
+#define SPECIALS_MASK (NEW_S|NEW_A|NEW_W|NEW_U)
+
+// TCP flags
+#define TH_FIN  0x01
+#define TH_SYN  0x02
+#define TH_RST  0x04
+#define TH_PUSH 0x08
+#define TH_ACK  0x10
+#define TH_URG  0x20
+
+// Offsets in the IP header
+#define IP_VHL  0
+#define IP_TOS  1
+#define IP_LEN  2
+#define IP_ID   4
+#define IP_OFF  6
+#define IP_TTL  8
+#define IP_PROTO 9
+#define IP_SUM  10
+#define IP_SRC  12
+#define IP_DST  16
+// and in the TCP header
+#define TH_SPORT 0
+#define TH_DPORT 2
+#define TH_SEQ  4
+#define TH_ACKN 8
+#define TH_OFF  12
+#define TH_FLAGS 13
+#define TH_WIN  14
+#define TH_SUM  16
+#define TH_URP  18
+
+#define IP_PROTO_TCP 6
+
+struct vj_slot {
+    uint8_t     hdr[VJ_MAX_HDR];
+    uint8_t     hlen;       // IP + TCP header length, 0 if unused
+    uint8_t     age;        // tx only, 0 is the most recently used
+};
+
+static struct vj_slot vj_tx[VJ_TX_SLOTS];
+static struct vj_slot vj_rx[VJ_RX_SLOTS];
+static uint8_t vj_last_xmit, vj_last_recv;
+static bool vj_rx_toss;
+
+static uint16_t ICACHE_FLASH_ATTR
+get16(uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t ICACHE_FLASH_ATTR
+get32(uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void ICACHE_FLASH_ATTR
+put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void ICACHE_FLASH_ATTR
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// Deltas of 1-255 take one byte, 0 and larger ones a 0 and two bytes
+static uint8_t * ICACHE_FLASH_ATTR
+vj_encode(uint8_t *cp, uint16_t n)
+{
+    if (n == 0 || n >= 256) {
+	*cp++ = 0;
+	*cp++ = n >> 8;
+    }
+    *cp++ = n;
+    return cp;
+}
+
+static uint8_t * ICACHE_FLASH_ATTR
+vj_decode(uint8_t *cp, uint16_t *n)
+{
+    if (*cp == 0) {
+	*n = (cp[1] << 8) | cp[2];
+	return cp + 3;
+    }
+    *n = *cp;
+    return cp + 1;
+}
+
+// Marks slot as the most recently used one
+static void ICACHE_FLASH_ATTR
+vj_touch(struct vj_slot *s)
+{
+int i;
+
+    for (i = 0; i < VJ_TX_SLOTS; i++)
+	if (vj_tx[i].age < s->age && vj_tx[i].age < 255)
+	    vj_tx[i].age++;
+    s->age = 0;
+}
+
+void ICACHE_FLASH_ATTR
+vj_init(void)
+{
+int i;
+
+    os_memset(vj_tx, 0, sizeof(vj_tx));
+    os_memset(vj_rx, 0, sizeof(vj_rx));
+    for (i = 0; i < VJ_TX_SLOTS; i++)
+	vj_tx[i].age = i;
+    vj_last_xmit = vj_last_recv = 255;
+    vj_rx_toss = true;
+}
+
+uint8_t ICACHE_FLASH_ATTR
+vj_compress(uint8_t *pkt, uint16_t len, uint8_t *hdr, uint16_t *hdr_len, uint16_t *skip)
+{
+struct vj_slot *s = NULL;
+uint8_t *th, *oth, *cp;
+uint16_t iphl, hlen, delta, olen;
+uint32_t deltaA, deltaS;
+uint8_t changes = 0, id;
+int i;
+
+    *hdr_len = *skip = 0;
+
+    if (len < 40 || (pkt[IP_VHL] >> 4) != 4 || pkt[IP_PROTO] != IP_PROTO_TCP)
+	return VJ_TYPE_IP;
+    if ((get16(&pkt[IP_OFF]) & 0x3fff) != 0)
+	return VJ_TYPE_IP;
+    iphl = (pkt[IP_VHL] & 0x0f) * 4;
+    if (iphl < 20 || len < iphl + 20)
+	return VJ_TYPE_IP;
+    th = &pkt[iphl];
+    hlen = iphl + (th[TH_OFF] >> 4) * 4;
+    if ((th[TH_OFF] >> 4) < 5 || hlen > len || hlen > VJ_MAX_HDR)
+	return VJ_TYPE_IP;
+    // connection setup and teardown are sent as they are
+    if ((th[TH_FLAGS] & (TH_SYN|TH_FIN|TH_RST|TH_ACK)) != TH_ACK)
+	return VJ_TYPE_IP;
+
+    for (i = 0; i < VJ_TX_SLOTS; i++) {
+	struct vj_slot *t = &vj_tx[i];
+	if (t->hlen != 0 &&
+	    os_memcmp(&t->hdr[IP_SRC], &pkt[IP_SRC], 8) == 0 &&
+	    os_memcmp(&t->hdr[(t->hdr[IP_VHL] & 0x0f) * 4], th, 4) == 0) {
+	    s = t;
+	    break;
+	}
+    }
+    if (s == NULL) {
+	// reuse the least recently used slot
+	for (s = &vj_tx[0], i = 1; i < VJ_TX_SLOTS; i++)
+	    if (vj_tx[i].age > s->age)
+		s = &vj_tx[i];
+	goto uncompressed;
+    }
+
+    oth = &s->hdr[(s->hdr[IP_VHL] & 0x0f) * 4];
+    // anything but the expected per packet changes needs a full header:
+    // version, header length, tos, fragment field, ttl, options
+    if (s->hlen != hlen ||
+	os_memcmp(&pkt[IP_VHL], &s->hdr[IP_VHL], 2) != 0 ||
+	os_memcmp(&pkt[IP_OFF], &s->hdr[IP_OFF], 4) != 0 ||
+	th[TH_OFF] != oth[TH_OFF] ||
+	(iphl > 20 && os_memcmp(&pkt[20], &s->hdr[20], iphl - 20) != 0) ||
+	(hlen - iphl > 20 && os_memcmp(&th[20], &oth[20], hlen - iphl - 20) != 0))
+	goto uncompressed;
+
+    // deltas start after change mask, connection id and checksum
+    cp = &hdr[4];
+
+    if (th[TH_FLAGS] & TH_URG) {
+	cp = vj_encode(cp, get16(&th[TH_URP]));
+	changes |= NEW_U;
+    } else if (get16(&th[TH_URP]) != get16(&oth[TH_URP])) {
+	goto uncompressed;
+    }
+
+    if ((delta = get16(&th[TH_WIN]) - get16(&oth[TH_WIN])) != 0) {
+	cp = vj_encode(cp, delta);
+	changes |= NEW_W;
+    }
+
+    if ((deltaA = get32(&th[TH_ACKN]) - get32(&oth[TH_ACKN])) != 0) {
+	if (deltaA > 0xffff)
+	    goto uncompressed;
+	cp = vj_encode(cp, deltaA);
+	changes |= NEW_A;
+    }
+
+    if ((deltaS = get32(&th[TH_SEQ]) - get32(&oth[TH_SEQ])) != 0) {
+	if (deltaS > 0xffff)
+	    goto uncompressed;
+	cp = vj_encode(cp, deltaS);
+	changes |= NEW_S;
+    }
+
+    olen = get16(&s->hdr[IP_LEN]);
+    switch (changes) {
+    case 0:
+	// nothing changed: only a data packet after a pure ack is fine,
+	// everything else is probably a retransmission
+	if (get16(&pkt[IP_LEN]) != olen && olen == hlen)
+	    break;
+	goto uncompressed;
+
+    case SPECIAL_I:
+    case SPECIAL_D:
+	// the plain encoding would be ambiguous
+	goto uncompressed;
+
+    case NEW_S|NEW_A:
+	if (deltaS == deltaA && deltaS == olen - hlen) {
+	    // echoed interactive traffic
+	    changes = SPECIAL_I;
+	    cp = &hdr[4];
+	}
+	break;
+
+    case NEW_S:
+	if (deltaS == olen - hlen) {
+	    // unidirectional data
+	    changes = SPECIAL_D;
+	    cp = &hdr[4];
+	}
+	break;
+    }
+
+    if ((delta = get16(&pkt[IP_ID]) - get16(&s->hdr[IP_ID])) != 1) {
+	cp = vj_encode(cp, delta);
+	changes |= NEW_I;
+    }
+    if (th[TH_FLAGS] & TH_PUSH)
+	changes |= TCP_PUSH_BIT;
+
+    os_memcpy(s->hdr, pkt, hlen);
+    vj_touch(s);
+
+    // move the deltas down if the connection id is left out
+    id = s - vj_tx;
+    if (vj_last_xmit != id) {
+	vj_last_xmit = id;
+	hdr[0] = changes | NEW_C | VJ_TYPE_COMPRESSED_TCP;
+	hdr[1] = id;
+	os_memcpy(&hdr[2], &th[TH_SUM], 2);
+	*hdr_len = 4 + (cp - &hdr[4]);
+    } else {
+	hdr[0] = changes | VJ_TYPE_COMPRESSED_TCP;
+	os_memcpy(&hdr[1], &th[TH_SUM], 2);
+	os_memmove(&hdr[3], &hdr[4], cp - &hdr[4]);
+	*hdr_len = 3 + (cp - &hdr[4]);
+    }
+    *skip = hlen;
+    return VJ_TYPE_COMPRESSED_TCP;
+
+uncompressed:
+    // full header with the slot id in the protocol field, the peer restores
+    // the protocol before it checks the IP checksum
+    os_memcpy(s->hdr, pkt, hlen);
+    s->hlen = hlen;
+    vj_touch(s);
+    id = s - vj_tx;
+    vj_last_xmit = id;
+
+    os_memcpy(hdr, pkt, hlen);
+    hdr[IP_VHL] = (hdr[IP_VHL] & 0x0f) | VJ_TYPE_UNCOMPRESSED_TCP;
+    hdr[IP_PROTO] = id;
+    *hdr_len = *skip = hlen;
+    return VJ_TYPE_UNCOMPRESSED_TCP;
+}
+
+int16_t ICACHE_FLASH_ATTR
+vj_uncompress(uint8_t *pkt, uint16_t len, uint8_t *hdr, uint16_t *hdr_len)
+{
+struct vj_slot *s;
+uint8_t *cp = pkt, *th;
+uint8_t changes;
+uint16_t n, olen, sum;
+
+    if (len < 3)
+	goto bad;
+    changes = *cp++;
+    if (changes & NEW_C) {
+	if (*cp >= VJ_RX_SLOTS)
+	    goto bad;
+	vj_rx_toss = false;
+	vj_last_recv = *cp++;
+    } else if (vj_rx_toss) {
+	// state is lost until the next explicit connection id
+	return -1;
+    }
+
+    s = &vj_rx[vj_last_recv];
+    if (s->hlen == 0)
+	goto bad;
+    th = &s->hdr[(s->hdr[IP_VHL] & 0x0f) * 4];
+    // the deltas are checked against len after decoding, the frame is in
+    // a buffer of SLIP_RX_SLOT_SIZE, so reading a few bytes past it is safe
+    if (len < (cp - pkt) + 2)
+	goto bad;
+
+    os_memcpy(&th[TH_SUM], cp, 2);
+    cp += 2;
+    if (changes & TCP_PUSH_BIT)
+	th[TH_FLAGS] |= TH_PUSH;
+    else
+	th[TH_FLAGS] &= ~TH_PUSH;
+
+    olen = get16(&s->hdr[IP_LEN]);
+    switch (changes & SPECIALS_MASK) {
+    case SPECIAL_I:
+	n = olen - s->hlen;
+	put32(&th[TH_ACKN], get32(&th[TH_ACKN]) + n);
+	put32(&th[TH_SEQ], get32(&th[TH_SEQ]) + n);
+	break;
+
+    case SPECIAL_D:
+	put32(&th[TH_SEQ], get32(&th[TH_SEQ]) + olen - s->hlen);
+	break;
+
+    default:
+	if (changes & NEW_U) {
+	    th[TH_FLAGS] |= TH_URG;
+	    cp = vj_decode(cp, &n);
+	    put16(&th[TH_URP], n);
+	} else {
+	    th[TH_FLAGS] &= ~TH_URG;
+	}
+	if (changes & NEW_W) {
+	    cp = vj_decode(cp, &n);
+	    put16(&th[TH_WIN], get16(&th[TH_WIN]) + n);
+	}
+	if (changes & NEW_A) {
+	    cp = vj_decode(cp, &n);
+	    put32(&th[TH_ACKN], get32(&th[TH_ACKN]) + n);
+	}
+	if (changes & NEW_S) {
+	    cp = vj_decode(cp, &n);
+	    put32(&th[TH_SEQ], get32(&th[TH_SEQ]) + n);
+	}
+	break;
+    }
+    if (changes & NEW_I) {
+	cp = vj_decode(cp, &n);
+	put16(&s->hdr[IP_ID], get16(&s->hdr[IP_ID]) + n);
+    } else {
+	put16(&s->hdr[IP_ID], get16(&s->hdr[IP_ID]) + 1);
+    }
+
+    if (cp - pkt > len)
+	goto bad;
+
+    // new length and a fresh IP checksum
+    put16(&s->hdr[IP_LEN], len - (cp - pkt) + s->hlen);
+    put16(&s->hdr[IP_SUM], 0);
+    sum = inet_chksum(s->hdr, (s->hdr[IP_VHL] & 0x0f) * 4);
+    os_memcpy(&s->hdr[IP_SUM], &sum, 2);
+
+    os_memcpy(hdr, s->hdr, s->hlen);
+    *hdr_len = s->hlen;
+    return cp - pkt;
+
+bad:
+    vj_rx_toss = true;
+    return -1;
+}
+
+bool ICACHE_FLASH_ATTR
+vj_remember(uint8_t *pkt, uint16_t len)
+{
+struct vj_slot *s;
+uint16_t iphl, hlen;
+
+    if (len < 40 || pkt[IP_PROTO] >= VJ_RX_SLOTS)
+	goto bad;
+    pkt[IP_VHL] = (pkt[IP_VHL] & 0x0f) | VJ_TYPE_IP;
+    iphl = (pkt[IP_VHL] & 0x0f) * 4;
+    if (iphl < 20 || len < iphl + 20)
+	goto bad;
+    hlen = iphl + (pkt[iphl + TH_OFF] >> 4) * 4;
+    if (hlen > len || hlen > VJ_MAX_HDR)
+	goto bad;
+
+    s = &vj_rx[pkt[IP_PROTO]];
+    pkt[IP_PROTO] = IP_PROTO_TCP;
+    // a corrupt header would be the base of all following compressed
+    // packets of the slot
+    if (inet_chksum(pkt, iphl) != 0)
+	goto bad;
+
+    vj_last_recv = s - vj_rx;
+    vj_rx_toss = false;
+
+    os_memcpy(s->hdr, pkt, hlen);
+    s->hlen = hlen;
+    return true;
+
+bad:
+    vj_rx_toss = true;
+    return false;
+}
+
+void ICACHE_FLASH_ATTR
+vj_toss(void)
+{
+    vj_rx_toss = true;
+}
@@ -0,0 +1,36 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "c_types.h"
+#include "lwip/netif.h"
+#include "ringbuf.h"
+
+//
+// Ports of the discard and echo sinks (UDP and TCP)
+//
+#define BENCH_DISCARD_PORT      9
+#define BENCH_ECHO_PORT         7
+
+//
+// Default duration (s) of the SLIP loopback. The console is not reachable
+// via SLIP while it runs, so it always ends by itself
+//
+#define BENCH_LOOPBACK_SECS     10
+
+typedef enum {BENCH_OFF=0, BENCH_DISCARD, BENCH_ECHO, BENCH_LOOPBACK} BENCH_MODE;
+
+// Remembers the SLIP netif for the loopback mode, call after netif_add()
+void bench_init(struct netif *slip_if);
+
+// Starts a run, secs is only used by the loopback (0 for the default)
+bool bench_start(BENCH_MODE mode, uint32_t secs);
+
+void bench_stop(void);
+
+// Writes the results of the current or last run to the console buffer
+void bench_report(ringbuf_t rb);
+
+// Adds the delay between the end of a frame in the UART ISR and ip_input()
+void bench_rx_latency(uint32_t us);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _BITRATE_H_
+#define _BITRATE_H_
+
+#include "c_types.h"
+
+//
+// Range of bit rates accepted for UART0
+//
+#define BITRATE_MIN             300
+#define BITRATE_MAX             4000000
+
+//
+// Delay (ms) before the TX side is drained, so that the console answer to
+// the command is still sent at the old rate, and max. time (ms) the drain
+// may take before the new rate is set anyway
+//
+#define BITRATE_SETTLE_MS       100
+#define BITRATE_DRAIN_MS        2000
+
+//
+// Default time (ms) the host has to follow to the new rate. If no valid
+// SLIP frame arrives within it, the old rate is restored
+//
+#define BITRATE_CONFIRM_MS      10000
+#define BITRATE_POLL_MS         10
+
+//
+// Autobaud: each candidate rate is kept for BITRATE_PROBE_MS after the
+// host followed, it is clean with at least BITRATE_PROBE_FRAMES valid
+// frames and neither UART framing nor SLIP decode errors
+//
+#define BITRATE_AUTOBAUD_RATES  {115200, 230400, 460800, 921600, 1500000, 2000000, 3000000}
+#define BITRATE_PROBE_MS        5000
+#define BITRATE_PROBE_FRAMES    10
+
+typedef enum {BITRATE_IDLE=0, BITRATE_DRAIN, BITRATE_CONFIRM} BITRATE_STATE;
+
+// Called when a switch is over: confirmed at rate, or fell back to the old one
+typedef void (*bitrate_done_fn)(uint32_t rate, bool confirmed);
+
+// Starts a live switch of UART0 to rate, false if one is in progress or the
+// rate is out of range
+bool bitrate_switch(uint32_t rate, uint32_t confirm_ms, bitrate_done_fn done);
+
+BITRATE_STATE bitrate_state(void);
+
+// Target rate of the switch in progress
+uint32_t bitrate_pending(void);
+
+// Steps through BITRATE_AUTOBAUD_RATES until a rate is not clean, ends at
+// the fastest clean one, done gets it (confirmed false if none was clean)
+bool bitrate_autobaud(bitrate_done_fn done);
+
+bool bitrate_autobaud_running(void);
+
+#endif
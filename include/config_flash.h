@@ -9,6 +9,7 @@
 #include "os_type.h"
 #include "spi_flash.h"
 
+// First of the two sectors of the flash log (FLASH_LOG_SECTOR)
 #define FLASH_BLOCK_NO 0x68
 
 #define MAGIC_NUMBER    0x01200583
@@ -41,14 +42,48 @@ typedef struct
 
     uint16_t	clock_speed;	// Freq of the CPU
     uint32_t    bit_rate;       // Bit rate of serial link
+    uint8_t     flow_control;   // HW flow control of serial link (0 none, 1 RTS, 2 CTS, 3 both)
+
+    uint16_t    nat_entries;    // Size of the NAPT table (applied at boot, needs IP_NAPT_DYNAMIC)
+    uint8_t     portmap_entries;// Size of the portmap table (dito)
+    uint32_t    tcp_timeout;    // NAPT idle timeout of established TCP in s, 0 for default
+    uint32_t    udp_timeout;    // NAPT idle timeout of UDP in s, 0 for default
+
+    uint16_t    metrics_interval;   // UDP metrics push interval in s, 0 off
+    ip_addr_t   metrics_collector;  // Address and UDP port of the collector
+    uint16_t    metrics_port;
+
+    uint16_t    mss_clamp;      // Max. MSS of forwarded TCP SYNs, 0 from the SLIP MTU
+    uint8_t     cslip;          // RFC 1144 header compression on the serial link
+    uint8_t     compress;       // LZF compressed link mode
+    uint8_t     qos;            // Priority classes on the serial TX path
+    ip_addr_t   slip2_addr;     // Address of the second SLIP interface (ENABLE_SLIP2)
+    uint8_t     slip2_nat;      // NAPT for traffic from the second SLIP interface
 } sysconfig_t, *sysconfig_p;
 
+// Last AP the station connected to, for a directed connect without a scan
+// at boot. Kept in its own blob (blob 0 is the portmap table) and saved
+// only when it changed. Blob 2 are the static routes (route.h)
+#define WIFI_CACHE_BLOB 1
+#define WIFI_CACHE_MAGIC 0x57494649
+
+typedef struct
+{
+    uint32_t    magic_number;
+    uint8_t     ssid[32];       // config.ssid it belongs to
+    uint8_t     bssid[6];
+    uint8_t     channel;
+    uint8_t     pad;
+} wifi_cache_t;
+
 int config_load(sysconfig_p config);
 void config_load_default(sysconfig_p config);
-void config_save(sysconfig_p config);
+// The saves return false if the record does not fit into the flash log
+bool config_save(sysconfig_p config);
+bool config_save_bit_rate(uint32_t bit_rate);
 
-void blob_save(uint8_t blob_no, uint32_t *data, uint16_t len);
+bool blob_save(uint8_t blob_no, uint32_t *data, uint16_t len);
 void blob_load(uint8_t blob_no, uint32_t *data, uint16_t len);
-void blob_zero(uint8_t blob_no, uint16_t len);
+bool blob_zero(uint8_t blob_no, uint16_t len);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef _CODEL_H_
+#define _CODEL_H_
+// c_types needed for uint8_t, etc.
+#include "c_types.h"
+
+// Target sojourn time (us) and interval (us) of RFC 8289. On slow lines
+// the target is raised to the line time of one CODEL_MTU frame and the
+// interval to twice the target, a queue of one frame is never too long
+#define CODEL_TARGET_US     5000
+#define CODEL_INTERVAL_US   100000
+#define CODEL_MTU           1500
+
+// State of one queue
+struct codel {
+    uint32_t    first_above;    // when the sojourn time may drop, 0 if below target
+    uint32_t    drop_next;      // time of the next drop while dropping
+    uint16_t    count;          // drops since dropping started
+    uint16_t    lastcount;
+    bool        dropping;
+};
+
+// Sets target and interval for the bit rate of the line
+void codel_set_rate(uint32_t bit_rate);
+
+// Called for the head packet of a queue before it is sent (sojourn time in
+// us, backlog in bytes including the packet), true if it has to be dropped
+bool codel_drop(struct codel *c, uint32_t now, uint32_t sojourn, uint16_t backlog);
+
+// Called when the queue ran empty
+void codel_empty(struct codel *c);
+
+// Current target sojourn time in us
+uint32_t codel_target(void);
+
+#endif /* _CODEL_H_ */
@@ -20,11 +20,14 @@
 #define HAYES_CMD_MODE_AT_BOOT true
 #endif
 
+// Interval (ms) of the check for the guard time after an escape sequence
+#define HAYES_GUARD_POLL_MS 50
+
 // Macros
 // Shorthand for writing a character out
-#define CHAR_OUT(c) uart_tx_one_char(UART0, ##c)
+#define CHAR_OUT(c) uart_tx_one_char(UART0, (c))
 // Shorthand for accessing a register
-#define REG_S(register) modem.prefs.regs[##register]
+#define REG_S(register) modem.prefs.regs[(register)]
 
 // Shorthand definitions
 #define BS 8
@@ -124,6 +127,8 @@ typedef struct {
 } hayes_t;
 
 void h_init(sysconfig_p);
-bool h_handler(char, void (*)(struct netif*, u8_t), struct netif*, uint64_t*);
+// Takes a block of received chars in ISR context: commands in command
+// mode, in online mode everything but the escape sequence goes to data_rx
+void h_rx_block(uint8_t *data, uint16_t len, uart_unload_block_fn data_rx);
 void h_result(hayes_result_t);
 #endif
@@ -0,0 +1,31 @@
+#ifndef _LZF_H_
+#define _LZF_H_
+// c_types needed for uint8_t, etc.
+#include "c_types.h"
+
+// First byte of a compressed frame on the line. Plain IP starts with
+// 0x4x and CSLIP uses 0x70 and up, so both pass through unchanged
+#define LZF_FRAME_TYPE  0x20
+
+// Max. length of an uncompressed frame
+#define LZF_FRAME_MAX   1500
+
+// log2 of the size of the match hash table (uint16 entries)
+#ifndef LZF_HLOG
+#define LZF_HLOG        10
+#endif
+
+// Buffer of LZF_FRAME_MAX bytes behind the static dictionary. Frames are
+// compressed from and decompressed into it, so that matches can refer to
+// the dictionary
+uint8_t *lzf_frame(void);
+
+// Compresses len bytes at lzf_frame() into out, returns the compressed
+// length or 0 if it would not fit into out_max bytes
+uint16_t lzf_compress(uint16_t len, uint8_t *out, uint16_t out_max);
+
+// Decompresses len bytes of in into lzf_frame(), returns the length or
+// -1 for a corrupt frame
+int16_t lzf_decompress(uint8_t *in, uint16_t len);
+
+#endif /* _LZF_H_ */
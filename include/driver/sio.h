@@ -0,0 +1,21 @@
+#ifndef _SIO_H_
+#define _SIO_H_
+
+#include "lwip/sio.h"
+
+//
+// Device numbers of sio_open(). The netif number passed as state to
+// slipif_init() selects the device
+//
+#define SIO_DEV_UART0       2   // HW UART, fd is &UartDev
+#define SIO_DEV_SOFTUART    3   // Softuart on SLIP2_RX_GPIO/SLIP2_TX_GPIO (ENABLE_SLIP2)
+
+// Bytes sio_write() takes right now without a partial write
+u32_t sio_write_space(sio_fd_t fd);
+
+// Drives a device without interrupt driven TX (the softuart): sends up to
+// max_bytes of the queued bytes, blocking for their line time, and
+// completes a pending RX byte. Returns the number of bytes sent
+u32_t sio_poll(sio_fd_t fd, u32_t max_bytes);
+
+#endif
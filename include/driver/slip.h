@@ -0,0 +1,95 @@
+#ifndef _SLIP_H_
+#define _SLIP_H_
+// c_types needed for uint8_t, etc.
+#include "c_types.h"
+// netif and pbuf needed for the output hook
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+// SLIP special characters (RFC 1055)
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+// Traffic classes of the TX scheduler, served in strict priority order
+typedef enum {SLIP_TX_INTERACTIVE=0, SLIP_TX_DEFAULT, SLIP_TX_BULK} SLIP_TX_CLASS;
+#define SLIP_TX_CLASSES 3
+
+// Number of packets held back per class while the UART TX buffer is busy.
+// The default and bulk class together hold back at most the bytes of
+// SLIP_TX_QUEUE_MS on the line, within SLIP_TX_QUEUE_MIN (two full frames)
+// and SLIP_TX_QUEUE_BYTES (heap). CoDel usually drops well before
+#ifndef SLIP_TX_QUEUE_LEN
+#define SLIP_TX_QUEUE_LEN 8
+#endif
+#ifndef SLIP_TX_QUEUE_MS
+#define SLIP_TX_QUEUE_MS 250
+#endif
+#define SLIP_TX_QUEUE_MIN 3072
+#ifndef SLIP_TX_QUEUE_BYTES
+#define SLIP_TX_QUEUE_BYTES 6144
+#endif
+
+// The UART TX buffer is filled only up to the bytes of this many ms on the
+// line (min. SLIP_TX_RING_MIN bytes), the backlog waits in the queues,
+// where an interactive packet can pass and CoDel can drop
+#ifndef SLIP_TX_RING_MS
+#define SLIP_TX_RING_MS 10
+#endif
+#define SLIP_TX_RING_MIN 128
+
+// Ports of interactive traffic: ssh, telnet, dns, ntp
+#define SLIP_TX_PRIO_PORTS {22, 23, 53, 123}
+
+// Max. IP length of ICMP in the interactive class, larger ones (echo
+// floods) are default traffic
+#define SLIP_TX_ICMP_MAX 128
+
+// Receive arena: number of slots (power of 2, max 128) and max packet
+// size per slot
+#ifndef SLIP_RX_SLOTS
+#define SLIP_RX_SLOTS 4
+#endif
+#ifndef SLIP_RX_SLOT_SIZE
+#define SLIP_RX_SLOT_SIZE 1500
+#endif
+
+// Retry interval (ms) if no pbuf was available to deliver a packet
+#define SLIP_RX_RETRY_MS 5
+
+// Packet level output hook for the SLIP netif, replaces slipif_output()
+// that sends each encoded byte with sio_send()
+err_t slip_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr);
+
+// Sends held back packets, call on UART0_TX_SIGNAL
+void slip_output_resume(struct netif *netif);
+
+// SLIP decoder into the receive arena, called from the UART ISR
+void slip_rx_bytes(uint8_t *data, uint16_t len);
+
+// While slip_rx_verify is set, slip_process_rxqueue() counts the frames
+// with a valid IPv4 header in slip_rx_valid (proof of a working bit rate)
+extern bool slip_rx_verify;
+extern uint32_t slip_rx_valid;
+
+// Switches RFC 1144 header compression (Linux slattach -p cslip) on or
+// off, both ends start over with empty connection state
+void slip_set_cslip(bool on);
+bool slip_get_cslip(void);
+
+// Switches the classification into the TX classes on or off, off is one
+// FIFO (still with CoDel)
+void slip_set_qos(bool on);
+bool slip_get_qos(void);
+
+// Compressed link mode (ENABLE_LZF): frames that get shorter are sent as
+// LZF_FRAME_TYPE and the LZF data, see driver/lzf.c for the format
+void slip_set_lz(bool on);
+bool slip_get_lz(void);
+
+// Hands the completed frames of the arena to netif->input, call on UART0_SIGNAL
+void slip_process_rxqueue(struct netif *netif);
+
+#endif /* _SLIP_H_ */
@@ -3,7 +3,9 @@
 
 #include "user_interface.h"
 
-#define SOFTUART_MAX_RX_BUFF 64 
+#ifndef SOFTUART_MAX_RX_BUFF
+#define SOFTUART_MAX_RX_BUFF 64
+#endif
 
 #define SOFTUART_GPIO_COUNT 16
 
@@ -15,11 +17,21 @@ typedef struct softuart_pin_t {
 
 typedef struct softuart_buffer_t {
 	char receive_buffer[SOFTUART_MAX_RX_BUFF]; 
-	uint8_t receive_buffer_tail;
-	uint8_t receive_buffer_head;
+	uint16_t receive_buffer_tail;
+	uint16_t receive_buffer_head;
 	uint8_t buffer_overflow; 
 } softuart_buffer_t;
 
+//RX decoder state: the ISR only timestamps the edges, the bits of a byte
+//follow from the time between them (see Softuart_Intr_Handler)
+typedef struct softuart_rx_t {
+	uint32_t start;		//system_get_time() of the start bit edge
+	uint8_t cell;		//next bit cell to fill, 1..8 are the data bits
+	uint8_t data;
+	uint8_t busy;		//inside a byte
+	uint8_t frame_error;	//stop bit was low, set until cleared by the user
+} softuart_rx_t;
+
 typedef struct {
 	softuart_pin_t pin_rx;
 	softuart_pin_t pin_tx;
@@ -28,7 +40,13 @@ typedef struct {
 	//wether or not this softuart is rs485 and controlls rs485 tx enable pin
 	uint8_t is_rs485;
 	volatile softuart_buffer_t buffer;
+	volatile softuart_rx_t rx;
 	uint16_t bit_time;
+	//optional TX ring for Softuart_Write(), drained by Softuart_Flush()
+	uint8_t *tx_buffer;
+	uint16_t tx_size;
+	uint16_t tx_head;
+	uint16_t tx_tail;
 } Softuart;
 
 
@@ -43,6 +61,19 @@ void Softuart_Puts(Softuart *s, const char *c );
 uint8_t Softuart_Read(Softuart *s);
 uint8_t Softuart_Readline(Softuart *s, char* Buffer, uint8_t MaxLen );
 
+//Completes a received byte whose last bits ended without an edge, call
+//at least every few bit times while data is expected
+void Softuart_Poll(Softuart *s);
+
+//Non blocking TX: Softuart_Write() queues into the ring set with
+//Softuart_SetTxBuffer() and returns the number of bytes taken,
+//Softuart_Flush() bit-bangs up to max_bytes of it (without the extra
+//sync gap of Softuart_Putchar) and returns the number sent
+void Softuart_SetTxBuffer(Softuart *s, uint8_t *buf, uint16_t size);
+uint16_t Softuart_TxSpace(Softuart *s);
+uint16_t Softuart_Write(Softuart *s, const uint8_t *data, uint16_t len);
+uint16_t Softuart_Flush(Softuart *s, uint16_t max_bytes);
+
 //define mapping from pin to functio mode
 typedef struct {
 	uint32_t gpio_mux_name;
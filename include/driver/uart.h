@@ -31,6 +31,7 @@
 #define UART1   1
 
 typedef void (*uart_unload_fn)(char c);
+typedef void (*uart_unload_block_fn)(uint8 *data, uint16 len);
 
 typedef enum {
     FIVE_BITS = 0x0,
@@ -140,6 +141,7 @@ typedef struct {
 } UartDevice;
 
 extern uart_unload_fn	uart0_unload_fn;
+extern uart_unload_block_fn	uart0_unload_block_fn;
 
 void uart_init(UartBautRate uart0_br);
 void uart0_sendStr(const char *str);
@@ -148,6 +150,16 @@ void uart0_sendStr(const char *str);
 ///////////////////////////////////////
 #define UART_FIFO_LEN  128  //define the tx fifo length
 #define UART_TX_EMPTY_THRESH_VAL 0x10
+#define UART_RX_FULL_THRESH_VAL  100
+
+// Bytes that arrive (or leave) during the worst case ISR latency (~100us) plus slack,
+// used to scale the FIFO thresholds with the bit rate
+#define UART_LATENCY_BYTES(baud)  ((baud) / 100000 + 8)
+// Bytes the peer may still send after RTS was deasserted (its own FIFO plus
+// reaction time), used to set the RX flow threshold below the FIFO size
+#define UART_FLOW_MARGIN(baud)  ((baud) / 100000 + 16)
+// Max number of times external_unload() re-drains the RX FIFO in one interrupt
+#define UART_UNLOAD_MAX_PASSES  4
 
 
  struct UartBuffer{
@@ -185,7 +197,12 @@ void external_unload();
 
 LOCAL void  Uart_Buf_Cpy(struct UartBuffer* pCur, char* pdata , uint16 data_len);
 void  uart_buf_free(struct UartBuffer* pBuff);
-void  tx_buff_enq(char* pdata, uint16 data_len );
+uint16  tx_buff_enq(char* pdata, uint16 data_len );
+void  tx_buff_notify(uint16 space);
+void  tx_buff_begin(void);
+uint16  tx_buff_space(void);
+void  tx_buff_put(uint8* pdata, uint16 data_len);
+void  tx_buff_commit(void);
 LOCAL void  tx_fifo_insert(struct UartBuffer* pTxBuff, uint8 data_len,  uint8 uart_no);
 void  tx_start_uart_buffer(uint8 uart_no);
 uint16  rx_buff_deq(char* pdata, uint16 data_len );
@@ -205,6 +222,9 @@ void UART_SetStopBits(uint8 uart_no, UartStopBitsNum bit_num);
 void UART_SetLineInverse(uint8 uart_no, UART_LineLevelInverse inverse_mask);
 void UART_SetParity(uint8 uart_no, UartParityMode Parity_mode);
 void UART_SetBaudrate(uint8 uart_no,uint32 baud_rate);
+void UART_SetFifoThresholds(uint8 uart_no, uint32 baud_rate);
+void uart0_set_flow_ctrl(UART_HwFlowCtrl flow_ctrl);
+UART_HwFlowCtrl uart0_get_flow_ctrl(void);
 void UART_SetFlowCtrl(uint8 uart_no,UART_HwFlowCtrl flow_ctrl,uint8 rx_thresh);
 void UART_WaitTxFifoEmpty(uint8 uart_no , uint32 time_out_us); //do not use if tx flow control enabled
 void UART_ResetFifo(uint8 uart_no);
@@ -216,5 +236,8 @@ bool UART_CheckOutputFinished(uint8 uart_no, uint32 time_out_us);
 
 #define UART0_SIGNAL    1
 #define UART1_SIGNAL    2
+// Posted when the space requested by tx_buff_notify() is free,
+// kept clear of the USER_SIGNALS in user_config.h
+#define UART0_TX_SIGNAL 0x10
 #endif
 
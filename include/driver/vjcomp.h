@@ -0,0 +1,44 @@
+#ifndef _VJCOMP_H_
+#define _VJCOMP_H_
+// c_types needed for uint8_t, etc.
+#include "c_types.h"
+
+// Packet types in the upper bits of the first byte (RFC 1144)
+#define VJ_TYPE_IP                  0x40
+#define VJ_TYPE_UNCOMPRESSED_TCP    0x70
+#define VJ_TYPE_COMPRESSED_TCP      0x80
+
+// Number of connection slots per direction. The receive side has to
+// accept all slot ids of the peer, Linux cslip uses 16
+#ifndef VJ_RX_SLOTS
+#define VJ_RX_SLOTS 16
+#endif
+#ifndef VJ_TX_SLOTS
+#define VJ_TX_SLOTS 16
+#endif
+
+// Max. length of the IP and TCP header of a slot
+#define VJ_MAX_HDR 128
+
+// Forgets all connection state of both directions
+void vj_init(void);
+
+// Compresses the TCP/IP header at the start of pkt (len contiguous bytes).
+// Returns the packet type: for a TCP type hdr gets *hdr_len bytes that
+// replace the first *skip bytes of the packet, for VJ_TYPE_IP both are 0
+uint8_t vj_compress(uint8_t *pkt, uint16_t len, uint8_t *hdr, uint16_t *hdr_len, uint16_t *skip);
+
+// Expands a VJ_TYPE_COMPRESSED_TCP packet: hdr gets the full header of
+// *hdr_len bytes, the return value is the number of bytes it replaces,
+// -1 if the packet has to be dropped
+int16_t vj_uncompress(uint8_t *pkt, uint16_t len, uint8_t *hdr, uint16_t *hdr_len);
+
+// Restores a VJ_TYPE_UNCOMPRESSED_TCP packet in place into plain IP and
+// saves its header, false if the packet has to be dropped
+bool vj_remember(uint8_t *pkt, uint16_t len);
+
+// Drops compressed packets until the peer resyncs the slot, call after a
+// receive error
+void vj_toss(void);
+
+#endif /* _VJCOMP_H_ */
@@ -0,0 +1,69 @@
+#ifndef _FASTPATH_H_
+#define _FASTPATH_H_
+
+#include "c_types.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+
+//
+// Number of cached flows and how often (us) a cached flow is sent once
+// through the full ip_forward/NAPT path again. This keeps the NAPT entry
+// of the lwip lib alive and picks up changed routes or mappings
+//
+#define FASTPATH_FLOWS              32
+#define FASTPATH_REVALIDATE_US      1000000
+
+//
+// Flows without traffic for this time (us) are expired
+//
+#define FASTPATH_IDLE_US            (60*1000000)
+
+//
+// Slots of the outbound and inbound hash index, power of 2 and at least
+// twice FASTPATH_FLOWS to keep the probe sequences short
+//
+#define FASTPATH_HASH_SIZE          64
+
+struct fastpath_flow {
+    uint8_t     valid;
+    uint8_t     proto;
+    uint32_t    src;            // Original addresses and ports as seen on
+    uint32_t    dst;            // the SLIP side, network order
+    uint16_t    sport;
+    uint16_t    dport;
+
+    struct netif *out;          // Resolved output netif
+    uint32_t    nat_src;        // Source address and port after NAPT
+    uint16_t    nat_sport;
+    uint16_t    ip_adj;         // Checksum deltas of the NAPT rewrite
+    uint16_t    l4_adj;         // outbound
+    uint16_t    in_ip_adj;      // and inbound
+    uint16_t    in_l4_adj;
+
+    uint32_t    last_used;      // system_get_time() of last hit
+    uint32_t    last_check;     // system_get_time() of last outbound and
+    uint32_t    last_check_in;  // inbound slow path pass
+};
+
+struct fastpath_stats {
+    uint32_t    hits;           // Packets forwarded by the fast path outbound
+    uint32_t    hits_in;        // and inbound
+    uint32_t    misses;         // Packets handed to ip_input
+    uint32_t    learned;        // Flows entered into the cache
+};
+
+extern struct fastpath_stats fastpath_stats;
+
+// Takes over the input and output of the SLIP netif, call after netif_add()
+void fastpath_init(struct netif *slip_if);
+
+// Takes over input and output of an egress netif (STA) to learn flows
+void fastpath_hook_netif(struct netif *nif);
+
+// Drops all cached flows, e.g. when the external address changes
+void fastpath_flush(void);
+
+// Number of currently cached flows
+uint8_t fastpath_flows_used(void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _FLASH_LOG_H_
+#define _FLASH_LOG_H_
+
+#include "c_types.h"
+
+//
+// Append-only record store in two flash sectors from FLASH_LOG_SECTOR.
+// A save appends a new version of a record to the active sector, only
+// when it is full the latest versions are copied into the other one
+// (the only sector erase)
+//
+#define FLASH_LOG_SECTOR    0x68    // FLASH_BLOCK_NO
+#define FLASH_LOG_MAGIC     0x474f4c43
+
+// Flash used by a record of len bytes (8 bytes header, the data padded to
+// 4), and the room for the data of one more record in a sector (8 bytes
+// header) next to records of others bytes in total
+#define FLASH_LOG_REC_SIZE(len) (8 + (((len) + 3) & ~3))
+#define FLASH_LOG_ROOM(others)  (SPI_FLASH_SEC_SIZE - 8 - (others) - 8)
+
+// Record ids: the config and the blobs of config_flash.h
+#define FLASH_LOG_CONFIG    0
+#define FLASH_LOG_BLOB      1
+#define FLASH_LOG_IDS       4
+
+// Scans the store and builds the index, false if there is none yet. The
+// sectors are left untouched then until the first write
+bool flash_log_init(void);
+
+// Reads the latest version of a record into data, the part beyond it is
+// zeroed. Returns the stored length, 0 if there is none
+uint16_t flash_log_read(uint8_t id, uint32_t *data, uint16_t len);
+
+// Appends a new version of a record (nothing if the latest has the same
+// content), len 0 deletes it. False if it does not fit into a sector
+bool flash_log_write(uint8_t id, uint32_t *data, uint16_t len);
+
+// Number of sector erases since boot
+uint32_t flash_log_erases(void);
+
+#endif
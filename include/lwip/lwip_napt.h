@@ -51,6 +51,16 @@ struct portmap_table {
 
 extern struct portmap_table *ip_portmap_table;
 
+/* Current table sizes, set by ip_napt_init() */
+extern u16_t ip_napt_max;
+extern u8_t ip_portmap_max;
+
+/* Number of active NAPT entries per protocol */
+extern int nr_active_napt_tcp, nr_active_napt_udp, nr_active_napt_icmp;
+
+/* Idle timeouts in ms of established TCP and of UDP entries */
+extern u32_t ip_napt_tcp_timeout, ip_napt_udp_timeout;
+
 /**
  * Allocates and initializes the NAPT tables.
  *
@@ -105,6 +115,22 @@ ip_portmap_add(u8_t proto, u32_t maddr, u16_t mport, u32_t daddr, u16_t dport);
 u8_t ICACHE_FLASH_ATTR
 ip_portmap_remove(u8_t proto, u16_t mport);
 
+/**
+ * Sets the NAPT timeout for TCP connections.
+ *
+ * @param secs timeout in secs
+ */
+void ICACHE_FLASH_ATTR
+ip_napt_set_tcp_timeout(u32_t secs);
+
+/**
+ * Sets the NAPT timeout for UDP 'connections'.
+ *
+ * @param secs timeout in secs
+ */
+void ICACHE_FLASH_ATTR
+ip_napt_set_udp_timeout(u32_t secs);
+
 #endif /* IP_NAPT */
 #endif /* IP_FORWARD */
 
@@ -0,0 +1,34 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "c_types.h"
+#include "lwip/ip_addr.h"
+
+//
+// Size of the buffer a full set of metrics is formatted into
+//
+#define METRICS_BUF_SIZE        3584
+
+//
+// Max. payload of a UDP push datagram, 1500 MTU less IP and UDP header.
+// The set is split at line ends, so each datagram stands alone
+//
+#define METRICS_UDP_SIZE        1472
+
+typedef enum {METRICS_PLAIN=0, METRICS_PROMETHEUS} METRICS_FORMAT;
+
+// Writes all metrics into buf, "name value" lines or Prometheus text
+// format, returns the length
+uint16_t metrics_format(char *buf, uint16_t size, METRICS_FORMAT format);
+
+// Same from metric *index on, as many whole lines as fit. *index is the
+// next metric afterwards, -1 after the last one
+uint16_t metrics_format_from(char *buf, uint16_t size, METRICS_FORMAT format, int *index);
+
+// Starts the HTTP /metrics listener on port and the UDP push
+void metrics_init(uint16_t port);
+
+// (Re)starts the UDP push to collector:port every interval s, 0 stops it
+void metrics_set_push(uint16_t interval, ip_addr_t *collector, uint16_t port);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _MSS_CLAMP_H_
+#define _MSS_CLAMP_H_
+
+#include "c_types.h"
+#include "lwip/netif.h"
+
+//
+// Smallest MSS accepted by "set mss_clamp" (RFC 879 default)
+//
+#define MSS_CLAMP_MIN           536
+
+struct mss_clamp_stats {
+    uint32_t    clamped;        // SYNs with a rewritten MSS option
+};
+
+extern struct mss_clamp_stats mss_clamp_stats;
+
+// Takes over input and output of the SLIP netif, call after netif_add()
+// and after the hooks of the fast path
+void mss_clamp_init(struct netif *slip_if, uint16_t mss);
+
+// Sets the max. MSS in forwarded SYNs, 0 derives it from the SLIP MTU
+void mss_clamp_set(uint16_t mss);
+
+// Max. MSS currently in effect
+uint16_t mss_clamp_get(void);
+
+#endif
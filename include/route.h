@@ -0,0 +1,48 @@
+#ifndef _ROUTE_H_
+#define _ROUTE_H_
+
+#include "c_types.h"
+#include "lwip/ip_addr.h"
+#include "lwip/ip_route.h"
+
+//
+// Static routes (e.g. subnets behind the SLIP host in AP mode). The table
+// replaces the ip_rt_table of the lwip lib: the lib's ip_route() calls
+// ip_find_route(), which the linker redirects to __wrap_ip_find_route()
+// (-Wl,--wrap=ip_find_route)
+//
+#define ROUTE_MAX               32
+
+// Direct mapped cache of the last lookups per destination (power of 2)
+#define ROUTE_CACHE_SIZE        8
+
+// Blob of the saved table (config_flash.h)
+#define ROUTE_BLOB              2
+
+struct route_stats {
+    uint32_t    cache_hits;
+    uint32_t    cache_misses;
+};
+
+extern struct route_stats route_stats;
+
+// Adds a route or replaces the gateway of the one for the same net and
+// mask, false if the mask is not contiguous, gw is 0 or the table is full
+bool route_add(ip_addr_t ip, ip_addr_t mask, ip_addr_t gw);
+
+// Removes a route, false if there is none
+bool route_del(ip_addr_t ip, ip_addr_t mask);
+
+// The n_th route, most specific first, false if there are fewer
+bool route_get(uint8_t no, ip_addr_t *ip, ip_addr_t *mask, ip_addr_t *gw);
+
+uint8_t route_count(void);
+
+// Loads and saves the table from and to ROUTE_BLOB
+void route_load(void);
+bool route_save(void);
+
+// Longest prefix match for ip, NULL if no route
+struct route_entry *__wrap_ip_find_route(ip_addr_t ip);
+
+#endif
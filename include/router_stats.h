@@ -0,0 +1,44 @@
+#ifndef _ROUTER_STATS_H_
+#define _ROUTER_STATS_H_
+
+#include "c_types.h"
+
+//
+// Packet and error counters of the router. All are plain u32, a single
+// increment is atomic on the Xtensa core, so they can be bumped from the
+// UART ISR as well as from the task without locking
+//
+struct router_stats {
+    uint32_t    slip_rx_packets;    // Frames decoded from the SLIP line
+    uint32_t    slip_tx_packets;    // Frames sent on the SLIP line
+    uint32_t    slip_rx_errors;     // Bad escapes and oversized frames
+    uint32_t    slip_rx_dropped;    // Frames lost because the RX arena was full
+    uint32_t    slip_tx_dropped;    // Frames lost because the TX queue was full
+    uint32_t    uart_rx_ovf;        // UART RX FIFO overflows
+    uint32_t    uart_frm_err;       // UART framing errors
+    uint32_t    uart_tx_full;       // Bytes refused by a full UART TX buffer
+    uint32_t    pbuf_alloc_fail;    // Failed pbuf allocations on the SLIP path
+    uint32_t    napt_hwm;           // Max. number of NAPT entries in use
+    uint32_t    lz_tx_raw;          // Bytes of frames before and after the
+    uint32_t    lz_tx_comp;         // compressed link mode, both directions
+    uint32_t    lz_rx_raw;
+    uint32_t    lz_rx_comp;
+    uint32_t    qos_tx[3];          // Frames sent per SLIP_TX_CLASS and tail
+    uint32_t    qos_drop[3];        // drops per class (also in slip_tx_dropped)
+    uint32_t    codel_drop;         // Head drops by CoDel (dito)
+    uint32_t    slip2_rx_packets;   // Second SLIP link (ENABLE_SLIP2)
+    uint32_t    slip2_tx_packets;
+    uint32_t    slip2_tx_dropped;   // Frames that did not fit the TX buffer
+    uint32_t    slip2_rx_ovf;       // Softuart RX buffer overflows
+    uint32_t    slip2_frm_err;      // Softuart framing errors
+};
+
+extern struct router_stats router_stats;
+
+// Updates the NAPT high-water mark, returns the current number of entries
+uint32_t router_stats_napt_update(void);
+
+// Clears all counters
+void router_stats_reset(void);
+
+#endif
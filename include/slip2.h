@@ -0,0 +1,16 @@
+#ifndef _SLIP2_H_
+#define _SLIP2_H_
+
+#include "c_types.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+
+// Adds and brings up the second SLIP netif on the softuart (ENABLE_SLIP2)
+// with addr/24, the peer is expected in the same /24. nat enables NAPT
+// for traffic from it (applied at boot)
+void slip2_init(ip_addr_t *addr, bool nat);
+
+// The netif, NULL before slip2_init()
+struct netif *slip2_netif(void);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "c_types.h"
+#include "ringbuf.h"
+
+//
+// Number of trace records (8 bytes each) kept in RAM, the oldest are
+// overwritten
+//
+#define TRACE_ENTRIES       256
+
+typedef enum {
+    TRACE_NONE=0,
+    TRACE_UART_ISR,         // Entry of uart0_rx_intr_handler, arg: int status
+    TRACE_UART_ISR_END,
+    TRACE_RX_UNLOAD,        // external_unload, arg: bytes taken from the FIFO
+    TRACE_TX_FILL,          // tx_start_uart_buffer, arg: bytes put into the FIFO
+    TRACE_TASK_RX,          // UART0_SIGNAL in user_procTask
+    TRACE_TASK_RX_END,
+    TRACE_IP_INPUT,         // SLIP frame to netif->input (forward and NAPT), arg: length
+    TRACE_IP_INPUT_END,
+    TRACE_FP_OUT,           // Fast path hit outbound, arg: length
+    TRACE_FP_IN,            // and inbound
+    TRACE_IDS
+} TRACE_ID;
+
+#ifdef ENABLE_TRACE
+// Records CCOUNT, id and arg, callable from the ISR (IRAM)
+#define TRACE(id, arg)      trace_record((id), (arg))
+#else
+#define TRACE(id, arg)
+#endif
+
+void trace_init(void);
+void trace_record(uint16_t id, uint16_t arg);
+void trace_clear(void);
+
+// Number of records in the ring
+uint16_t trace_count(void);
+
+// Moves up to max records as text into rb as long as they fit, returns
+// the number moved
+uint16_t trace_dump(ringbuf_t rb, uint16_t max);
+
+#endif
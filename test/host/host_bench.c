@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include "driver/uart.h"
+#include "driver/uart_register.h"
+#include "driver/slip.h"
+#include "driver/hayes.h"
+
+#include "host_sdk.h"
+#include "pcap_trace.h"
+#include "slip_link.h"
+
+/*
+ * Micro benchmarks of the serial path on the host CPU. The numbers are
+ * no device figures, they are for comparing a change against its base:
+ *
+ * - bytes/s of IP packets through each codec path of driver/slip.c, TX
+ *   (compression, encoder, UART TX ring, TX ISR) and RX (RX ISR, decoder,
+ *   expansion, delivery) separately, and of the Hayes escape scanner
+ * - time per UART ISR entry for the heaviest inputs: a full RX FIFO of
+ *   data, of escaped bytes and of tiny frames, a TX refill, and both
+ */
+
+#define BENCH_NS        300000000ULL   // min. run time per codec path
+#define ISR_RUNS        20000
+
+extern hayes_t modem;
+
+static double
+mbps(uint64_t bytes, uint64_t ns)
+{
+    return ns ? bytes * 1000.0 / ns : 0;
+}
+
+static void
+bench_codec(struct pcap_trace *t, const char *mode, bool cslip, bool lz)
+{
+uint64_t tx_ns = 0, rx_ns = 0, bytes = 0, wire = 0, t0, t1, t2;
+uint32_t i, passes = 0;
+
+    slip_set_lz(lz);
+    while (tx_ns + rx_ns < BENCH_NS) {
+	// every pass starts with fresh connection state on both ends
+	slip_set_cslip(cslip);
+	for (i = 0; i < t->count; i++) {
+	    t0 = host_ns();
+	    link_send(t->pkt[i], t->len[i]);
+	    t1 = host_ns();
+	    wire += host_wire_len;
+	    link_loopback();
+	    t2 = host_ns();
+	    tx_ns += t1 - t0;
+	    rx_ns += t2 - t1;
+	    bytes += t->len[i];
+	}
+	passes++;
+    }
+    printf("  %-10s %8.1f %8.1f %8.3f %6u\n", mode, mbps(bytes, tx_ns), mbps(bytes, rx_ns),
+	   (double)wire / bytes, passes);
+}
+
+static void
+discard(uint8_t *d, uint16_t len)
+{
+}
+
+static void
+bench_hayes(void)
+{
+static sysconfig_t cfg;
+uint8_t block[HOST_UART_FIFO_LEN];
+uint64_t bytes = 0, t0;
+uint32_t i;
+
+    memset(block, 0x55, sizeof(block));
+    h_init(&cfg);
+    modem.state.on_hook = false;
+    modem.state.in_call = true;
+    modem.state.online = true;
+
+    t0 = host_ns();
+    for (i = 0; i < 1000000; i++) {
+	h_rx_block(block, sizeof(block), discard);
+	bytes += sizeof(block);
+    }
+    printf("  %-10s %8.1f\n", "hayes scan", mbps(bytes, host_ns() - t0));
+}
+
+/*
+ * ISR timing
+ */
+static uint8_t stream[64 * 1024];
+static uint32_t stream_len, stream_pos;
+
+// A stream of SLIP frames of n bytes each, all of them c or random if c < 0
+static void
+stream_frames(uint16_t n, int c)
+{
+uint32_t seed = 7;
+uint8_t b;
+uint16_t i;
+
+    stream_len = stream_pos = 0;
+    while (stream_len + 2 * n + 1 <= sizeof(stream)) {
+	for (i = 0; i < n; i++) {
+	    seed = seed * 1103515245 + 12345;
+	    b = c >= 0 ? c : seed >> 16;
+	    if (c < 0 && (b == SLIP_END || b == SLIP_ESC))
+		b = 0x55;
+	    if (b == SLIP_END || b == SLIP_ESC) {
+		stream[stream_len++] = SLIP_ESC;
+		stream[stream_len++] = b == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+	    } else {
+		stream[stream_len++] = b;
+	    }
+	}
+	stream[stream_len++] = SLIP_END;
+    }
+}
+
+static void
+stream_feed(void)
+{
+uint16_t n;
+
+    if (stream_pos + HOST_UART_FIFO_LEN > stream_len)
+	stream_pos = 0;
+    n = host_uart_feed(&stream[stream_pos], HOST_UART_FIFO_LEN);
+    stream_pos += n;
+}
+
+static int
+cmp_ns(const void *a, const void *b)
+{
+uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void
+bench_isr(const char *name, bool rx, bool tx)
+{
+static uint64_t ns[ISR_RUNS];
+static uint8_t fill[UART_TX_BUFFER_SIZE];
+uint64_t sum = 0, t0;
+uint32_t i, st = (rx ? UART_RXFIFO_FULL_INT_ST : 0) | (tx ? UART_TXFIFO_EMPTY_INT_ST : 0);
+
+    for (i = 0; i < ISR_RUNS; i++) {
+	// set up outside of the measurement: a full RX FIFO, a TX ring
+	// with more than a FIFO in it, a free arena
+	if (rx)
+	    stream_feed();
+	if (tx && tx_buff_space() > UART_TX_BUFFER_SIZE - HOST_UART_FIFO_LEN)
+	    tx_buff_enq((char *)fill, tx_buff_space());
+	host_wire_clear();
+
+	t0 = host_ns();
+	host_uart_isr(st);
+	ns[i] = host_ns() - t0;
+
+	link_tasks();
+    }
+    // leave the rings empty for the next run
+    host_uart_tx_drain();
+    host_wire_clear();
+
+    for (i = 0; i < ISR_RUNS; i++)
+	sum += ns[i];
+    qsort(ns, ISR_RUNS, sizeof(ns[0]), cmp_ns);
+    printf("  %-22s %8.0f %8llu %8llu\n", name, (double)sum / ISR_RUNS,
+	   (unsigned long long)ns[ISR_RUNS * 99 / 100], (unsigned long long)ns[ISR_RUNS - 1]);
+}
+
+int
+main(int argc, char **argv)
+{
+struct pcap_trace t;
+
+    link_init();
+    g_bit_rate = 921600;
+    trace_from_args(&t, argc, argv);
+
+    printf("codec paths, MB/s of IP packets:\n");
+    printf("  %-10s %8s %8s %8s %6s\n", "mode", "tx", "rx", "wire/ip", "passes");
+    bench_codec(&t, "slip", false, false);
+    bench_codec(&t, "cslip", true, false);
+    bench_codec(&t, "lzf", false, true);
+    bench_codec(&t, "cslip+lzf", true, true);
+    slip_set_cslip(false);
+    slip_set_lz(false);
+    bench_hayes();
+    trace_free(&t);
+
+    printf("UART ISR per entry, ns (%u runs):\n", ISR_RUNS);
+    printf("  %-22s %8s %8s %8s\n", "input", "mean", "p99", "max");
+    stream_frames(1400, -1);
+    bench_isr("rx 128 B data", true, false);
+    stream_frames(700, SLIP_END);
+    bench_isr("rx 128 B escaped", true, false);
+    stream_frames(1, 0x45);
+    bench_isr("rx 128 B tiny frames", true, false);
+    bench_isr("tx 128 B refill", false, true);
+    stream_frames(1400, -1);
+    bench_isr("rx data + tx refill", true, true);
+    return 0;
+}
@@ -0,0 +1,530 @@
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "c_types.h"
+#include "osapi.h"
+#include "mem.h"
+#include "user_interface.h"
+#include "lwip/inet_chksum.h"
+
+#include "driver/uart.h"
+#include "driver/uart_register.h"
+#include "router_stats.h"
+
+#include "host_sdk.h"
+
+/*
+ * Globals that user_main.c defines on the target
+ */
+struct router_stats router_stats;
+uint32_t g_bit_rate = 115200;
+uint64_t Bytes_in, Bytes_out;
+
+// In ROM on the target
+UartDevice UartDev;
+
+// user/bench.c needs espconn, it is not part of the host build
+void
+bench_rx_latency(uint32_t us)
+{
+}
+
+uint32_t host_checks, host_failures;
+
+int
+host_test_result(const char *name)
+{
+    printf("%s: %u checks, %u failed\n", name, host_checks, host_failures);
+    return host_failures != 0;
+}
+
+uint64_t
+host_ns(void)
+{
+struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Output
+ */
+int
+os_printf_plus(const char *format, ...)
+{
+va_list ap;
+int n = 0;
+
+    if (getenv("HOST_VERBOSE") != NULL) {
+	va_start(ap, format);
+	n = vprintf(format, ap);
+	va_end(ap);
+    }
+    return n;
+}
+
+int
+ets_sprintf(char *str, const char *format, ...)
+{
+va_list ap;
+int n;
+
+    va_start(ap, format);
+    n = vsprintf(str, format, ap);
+    va_end(ap);
+    return n;
+}
+
+/*
+ * Heap
+ */
+void *
+pvPortMalloc(size_t sz, const char *file, unsigned line)
+{
+    return malloc(sz ? sz : 1);
+}
+
+void *
+pvPortZalloc(size_t sz, const char *file, unsigned line)
+{
+    return calloc(1, sz ? sz : 1);
+}
+
+void *
+pvPortRealloc(void *p, size_t n, const char *file, unsigned line)
+{
+    return realloc(p, n);
+}
+
+void
+vPortFree(void *p, const char *file, unsigned line)
+{
+    free(p);
+}
+
+uint32
+system_get_free_heap_size(void)
+{
+    return 40000;
+}
+
+/*
+ * Clock and timers. The timers fire only from host_advance_us(), in the
+ * order they are due, with host_time set to their expiry.
+ */
+#define HOST_TIMERS 32
+
+uint32_t host_time;
+LOCAL os_timer_t *host_timers[HOST_TIMERS];
+
+uint32
+system_get_time(void)
+{
+    return host_time;
+}
+
+void
+ets_delay_us(uint32_t us)
+{
+    host_time += us;
+}
+
+void
+ets_timer_setfn(os_timer_t *ptimer, os_timer_func_t *pfunction, void *parg)
+{
+    ptimer->timer_func = pfunction;
+    ptimer->timer_arg = parg;
+}
+
+void
+ets_timer_disarm(os_timer_t *ptimer)
+{
+int i;
+
+    for (i = 0; i < HOST_TIMERS; i++)
+	if (host_timers[i] == ptimer)
+	    host_timers[i] = NULL;
+}
+
+void
+ets_timer_arm_new(os_timer_t *ptimer, uint32_t time, bool repeat_flag, bool ms_flag)
+{
+uint32_t us = ms_flag ? time * 1000 : time;
+int i, free_slot = -1;
+
+    ptimer->timer_expire = host_time + us;
+    ptimer->timer_period = repeat_flag ? us : 0;
+    for (i = 0; i < HOST_TIMERS; i++) {
+	if (host_timers[i] == ptimer)
+	    return;
+	if (host_timers[i] == NULL && free_slot < 0)
+	    free_slot = i;
+    }
+    if (free_slot < 0) {
+	fprintf(stderr, "host: out of timers\n");
+	abort();
+    }
+    host_timers[free_slot] = ptimer;
+}
+
+void
+host_advance_us(uint32_t us)
+{
+uint32_t end = host_time + us;
+os_timer_t *t;
+int i, next;
+
+    for (;;) {
+	next = -1;
+	for (i = 0; i < HOST_TIMERS; i++) {
+	    if (host_timers[i] == NULL || (int32_t)(host_timers[i]->timer_expire - end) > 0)
+		continue;
+	    if (next < 0 || (int32_t)(host_timers[i]->timer_expire - host_timers[next]->timer_expire) < 0)
+		next = i;
+	}
+	if (next < 0)
+	    break;
+
+	t = host_timers[next];
+	host_time = t->timer_expire;
+	if (t->timer_period != 0)
+	    t->timer_expire += t->timer_period;
+	else
+	    host_timers[next] = NULL;
+	t->timer_func(t->timer_arg);
+    }
+    host_time = end;
+}
+
+/*
+ * Task queue
+ */
+#define HOST_SIGNALS 64
+
+LOCAL os_signal_t host_signals[HOST_SIGNALS];
+LOCAL uint16_t host_sig_head, host_sig_tail;
+
+bool
+system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen)
+{
+    return true;
+}
+
+bool
+system_os_post(uint8 prio, os_signal_t sig, os_param_t par)
+{
+    if ((uint16_t)(host_sig_head - host_sig_tail) >= HOST_SIGNALS)
+	return false;
+    host_signals[host_sig_head++ % HOST_SIGNALS] = sig;
+    return true;
+}
+
+bool
+host_os_take(os_signal_t *sig)
+{
+    if (host_sig_tail == host_sig_head)
+	return false;
+    *sig = host_signals[host_sig_tail++ % HOST_SIGNALS];
+    return true;
+}
+
+void
+host_os_clear(void)
+{
+    host_sig_tail = host_sig_head;
+}
+
+void
+system_restart(void)
+{
+}
+
+/*
+ * Interrupts
+ */
+LOCAL ets_isr_t host_isr[32];
+LOCAL void *host_isr_arg[32];
+LOCAL uint32_t host_isr_masked;
+
+void
+ets_isr_attach(int i, ets_isr_t func, void *arg)
+{
+    host_isr[i] = func;
+    host_isr_arg[i] = arg;
+}
+
+void
+ets_isr_mask(uint32 mask)
+{
+    host_isr_masked |= mask;
+}
+
+void
+ets_isr_unmask(uint32 unmask)
+{
+    host_isr_masked &= ~unmask;
+}
+
+void
+ets_intr_lock(void)
+{
+}
+
+void
+ets_intr_unlock(void)
+{
+}
+
+/*
+ * UART0 model. Only the FIFO, STATUS, INT_ST and INT_CLR registers of
+ * UART0 behave like the hardware, everything else below 0x60001000 is
+ * plain storage; other addresses read 0.
+ */
+#define HOST_REG_BASE   0x60000000
+#define HOST_REG_WORDS  (0x1000 / 4)
+
+LOCAL uint32_t host_regs[HOST_REG_WORDS];
+LOCAL uint32_t host_int_st;
+
+LOCAL uint8_t host_rx_fifo[HOST_UART_FIFO_LEN];
+LOCAL uint16_t host_rx_head, host_rx_count;
+
+uint8_t host_wire[HOST_WIRE_SIZE];
+uint32_t host_wire_len;
+bool host_wire_overflow;
+
+uint32_t
+host_reg_read(uint32_t addr)
+{
+uint8_t c;
+
+    if (addr == UART_FIFO(UART0)) {
+	if (host_rx_count == 0)
+	    return 0;
+	c = host_rx_fifo[host_rx_head];
+	host_rx_head = (host_rx_head + 1) % HOST_UART_FIFO_LEN;
+	host_rx_count--;
+	return c;
+    }
+    if (addr == UART_STATUS(UART0) || addr == UART_STATUS(UART1))
+	// the TX FIFO is always empty, it goes on the wire at once
+	return addr == UART_STATUS(UART0) ? (host_rx_count & UART_RXFIFO_CNT) << UART_RXFIFO_CNT_S : 0;
+    if (addr == UART_INT_ST(UART0))
+	return host_int_st;
+    if (addr < HOST_REG_BASE || addr >= HOST_REG_BASE + 4 * HOST_REG_WORDS)
+	return 0;
+    return host_regs[(addr - HOST_REG_BASE) / 4];
+}
+
+void
+host_reg_write(uint32_t addr, uint32_t val)
+{
+    if (addr == UART_FIFO(UART0)) {
+	if (host_wire_len < HOST_WIRE_SIZE)
+	    host_wire[host_wire_len++] = val;
+	else
+	    host_wire_overflow = true;
+	return;
+    }
+    if (addr == UART_FIFO(UART1))
+	return;
+    if (addr == UART_INT_CLR(UART0)) {
+	host_int_st &= ~val;
+	return;
+    }
+    if (addr < HOST_REG_BASE || addr >= HOST_REG_BASE + 4 * HOST_REG_WORDS)
+	return;
+    host_regs[(addr - HOST_REG_BASE) / 4] = val;
+}
+
+void
+host_wire_clear(void)
+{
+    host_wire_len = 0;
+    host_wire_overflow = false;
+}
+
+uint16_t
+host_uart_feed(const uint8_t *data, uint16_t len)
+{
+uint16_t i;
+
+    for (i = 0; i < len && host_rx_count < HOST_UART_FIFO_LEN; i++, host_rx_count++)
+	host_rx_fifo[(host_rx_head + host_rx_count) % HOST_UART_FIFO_LEN] = data[i];
+    return i;
+}
+
+void
+host_uart_isr(uint32_t int_st)
+{
+    if (host_isr[ETS_UART_INUM] == NULL) {
+	fprintf(stderr, "host: no UART ISR, uart_init() not called\n");
+	abort();
+    }
+    host_int_st |= int_st;
+    host_isr[ETS_UART_INUM](host_isr_arg[ETS_UART_INUM]);
+}
+
+void
+host_uart_rx(const uint8_t *data, uint32_t len)
+{
+uint16_t n;
+
+    while (len > 0) {
+	n = host_uart_feed(data, len > HOST_UART_FIFO_LEN ? HOST_UART_FIFO_LEN : len);
+	data += n;
+	len -= n;
+	host_uart_isr(UART_RXFIFO_FULL_INT_ST);
+    }
+}
+
+void
+host_uart_tx_drain(void)
+{
+    while (host_reg_read(UART_INT_ENA(UART0)) & UART_TXFIFO_EMPTY_INT_ENA)
+	host_uart_isr(UART_TXFIFO_EMPTY_INT_ST);
+}
+
+void
+uart_div_modify(uint8 uart_no, uint32 DivLatchValue)
+{
+}
+
+/*
+ * GPIO (status LED)
+ */
+void
+gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask)
+{
+}
+
+uint32
+gpio_input_get(void)
+{
+    return 0;
+}
+
+/*
+ * lwIP: byte order, checksum and pbufs. PBUF_POOL allocations are chains
+ * of HOST_PBUF_POOL_BUFSIZE pieces, so the chain walks in the code under
+ * test are exercised.
+ */
+u16_t lwip_htons(u16_t x) { return __builtin_bswap16(x); }
+u16_t lwip_ntohs(u16_t x) { return __builtin_bswap16(x); }
+u32_t lwip_htonl(u32_t x) { return __builtin_bswap32(x); }
+u32_t lwip_ntohl(u32_t x) { return __builtin_bswap32(x); }
+
+u16_t
+inet_chksum(void *dataptr, u16_t len)
+{
+uint8_t *d = dataptr;
+uint32_t sum = 0;
+
+    for (; len > 1; len -= 2, d += 2)
+	sum += d[0] | d[1] << 8;
+    if (len)
+	sum += d[0];
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum & 0xffff;
+}
+
+uint16_t host_pbuf_fail;
+int32_t host_pbuf_used;
+
+struct pbuf *
+pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type)
+{
+struct pbuf *p, *head = NULL, **tail = &head;
+u16_t rest = length, n;
+
+    if (host_pbuf_fail > 0) {
+	host_pbuf_fail--;
+	return NULL;
+    }
+    do {
+	n = type == PBUF_POOL && rest > HOST_PBUF_POOL_BUFSIZE ? HOST_PBUF_POOL_BUFSIZE : rest;
+	p = calloc(1, sizeof(struct pbuf) + n);
+	p->payload = p + 1;
+	p->len = n;
+	p->tot_len = rest;
+	p->type = type;
+	p->ref = 1;
+	*tail = p;
+	tail = &p->next;
+	host_pbuf_used++;
+	rest -= n;
+    } while (rest > 0);
+    return head;
+}
+
+u8_t
+pbuf_free(struct pbuf *p)
+{
+struct pbuf *q;
+u8_t n = 0;
+
+    while (p != NULL && --p->ref == 0) {
+	q = p->next;
+	free(p);
+	host_pbuf_used--;
+	n++;
+	p = q;
+    }
+    return n;
+}
+
+void
+pbuf_ref(struct pbuf *p)
+{
+    if (p != NULL)
+	p->ref++;
+}
+
+u16_t
+pbuf_copy_partial(struct pbuf *p, void *dataptr, u16_t len, u16_t offset)
+{
+u16_t copied = 0, n;
+
+    for (; p != NULL && copied < len; p = p->next) {
+	if (offset >= p->len) {
+	    offset -= p->len;
+	    continue;
+	}
+	n = p->len - offset;
+	if (n > len - copied)
+	    n = len - copied;
+	memcpy((uint8_t *)dataptr + copied, (uint8_t *)p->payload + offset, n);
+	copied += n;
+	offset = 0;
+    }
+    return copied;
+}
+
+err_t
+pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len)
+{
+u16_t copied = 0, n;
+
+    if (buf == NULL || buf->tot_len < len)
+	return ERR_ARG;
+    for (; buf != NULL && copied < len; buf = buf->next) {
+	n = buf->len < len - copied ? buf->len : len - copied;
+	memcpy(buf->payload, (const uint8_t *)dataptr + copied, n);
+	copied += n;
+    }
+    return ERR_OK;
+}
+
+u8_t
+pbuf_get_at(struct pbuf *p, u16_t offset)
+{
+    for (; p != NULL; p = p->next) {
+	if (offset < p->len)
+	    return ((u8_t *)p->payload)[offset];
+	offset -= p->len;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _HOST_SDK_H_
+#define _HOST_SDK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "c_types.h"
+#include "os_type.h"
+#include "lwip/pbuf.h"
+
+/*
+ * Fake SDK and hardware for the host build: a virtual clock with the
+ * os_timer list, the task queue, heap, pbufs and a UART0 model behind
+ * READ_PERI_REG/WRITE_PERI_REG. The RX FIFO is filled by the test, bytes
+ * written to the TX FIFO leave on the "wire" at once and are collected
+ * in host_wire.
+ */
+
+#define HOST_UART_FIFO_LEN  128
+#define HOST_WIRE_SIZE      (1024 * 1024)
+
+// Bit rate of UART0 for the SLIP TX scheduler, from user_main.c
+extern uint32_t g_bit_rate;
+
+// Virtual time of system_get_time() in us
+extern uint32_t host_time;
+
+// Moves the clock forward and fires the timers that are due on the way
+void host_advance_us(uint32_t us);
+
+// Takes the oldest signal posted with system_os_post(), false if none
+bool host_os_take(os_signal_t *sig);
+void host_os_clear(void);
+
+// Bytes written to the UART0 TX FIFO
+extern uint8_t host_wire[HOST_WIRE_SIZE];
+extern uint32_t host_wire_len;
+extern bool host_wire_overflow;
+void host_wire_clear(void);
+
+// Puts up to len bytes into the RX FIFO, returns the number taken
+uint16_t host_uart_feed(const uint8_t *data, uint16_t len);
+
+// Enters the UART ISR attached by uart_init() with int_st pending
+void host_uart_isr(uint32_t int_st);
+
+// Feeds data in FIFO sized chunks, one RX interrupt each
+void host_uart_rx(const uint8_t *data, uint32_t len);
+
+// Serves the TX empty interrupt as long as it is enabled, i.e. until the
+// UART TX ring is on the wire
+void host_uart_tx_drain(void);
+
+// pbuf_alloc() of PBUF_POOL chains in pieces of this size, like lwIP
+#define HOST_PBUF_POOL_BUFSIZE  512
+
+// The next n pbuf_alloc() calls fail
+extern uint16_t host_pbuf_fail;
+// Number of pbufs allocated and not freed
+extern int32_t host_pbuf_used;
+
+// Wall clock in ns for the benchmarks
+uint64_t host_ns(void);
+
+// Test bookkeeping: CHECK() counts and reports failures, the test main
+// returns host_test_result()
+extern uint32_t host_checks, host_failures;
+
+#define CHECK(cond) do { \
+    host_checks++; \
+    if (!(cond)) { \
+	host_failures++; \
+	fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+int host_test_result(const char *name);
+
+#endif
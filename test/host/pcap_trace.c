@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcap_trace.h"
+
+#define PCAP_MAGIC      0xa1b2c3d4
+#define PCAP_MAGIC_NS   0xa1b23c4d
+
+// Link types (www.tcpdump.org/linktypes.html)
+#define LINKTYPE_NULL       0
+#define LINKTYPE_ETHERNET   1
+#define LINKTYPE_RAW_BSD    12
+#define LINKTYPE_RAW_BSD2   14
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LINUX_SLL  113
+#define LINKTYPE_IPV4       228
+#define LINKTYPE_LINUX_SLL2 276
+
+static void
+trace_add(struct pcap_trace *t, const uint8_t *d, uint16_t len)
+{
+    t->pkt = realloc(t->pkt, (t->count + 1) * sizeof(*t->pkt));
+    t->len = realloc(t->len, (t->count + 1) * sizeof(*t->len));
+    t->pkt[t->count] = malloc(len);
+    memcpy(t->pkt[t->count], d, len);
+    t->len[t->count] = len;
+    t->count++;
+    t->bytes += len;
+}
+
+static uint32_t
+get32(const uint8_t *d, bool swap)
+{
+uint32_t v = d[0] | d[1] << 8 | d[2] << 16 | (uint32_t)d[3] << 24;
+
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t
+get16be(const uint8_t *d)
+{
+    return d[0] << 8 | d[1];
+}
+
+/*
+ * Offset of the IPv4 header in a frame of the link type, -1 if the frame
+ * carries something else
+ */
+static int
+trace_ip_offset(uint32_t linktype, const uint8_t *d, uint32_t len)
+{
+uint32_t off;
+
+    switch (linktype) {
+    case LINKTYPE_NULL:
+	// AF_INET in the byte order of the capturing host
+	return len >= 4 && (get32(d, false) == 2 || get32(d, true) == 2) ? 4 : -1;
+    case LINKTYPE_ETHERNET:
+	if (len < 14)
+	    return -1;
+	off = 12;
+	if (get16be(&d[off]) == 0x8100 && len >= 18)
+	    off += 4;
+	return get16be(&d[off]) == 0x0800 ? off + 2 : -1;
+    case LINKTYPE_RAW_BSD:
+    case LINKTYPE_RAW_BSD2:
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+	return 0;
+    case LINKTYPE_LINUX_SLL:
+	return len >= 16 && get16be(&d[14]) == 0x0800 ? 16 : -1;
+    case LINKTYPE_LINUX_SLL2:
+	return len >= 20 && get16be(&d[0]) == 0x0800 ? 20 : -1;
+    default:
+	return -1;
+    }
+}
+
+bool
+trace_load_pcap(struct pcap_trace *t, const char *path)
+{
+FILE *f;
+uint8_t hdr[24], rec[16];
+uint8_t *buf;
+uint32_t magic, linktype, incl, orig, ip_len;
+bool swap;
+int off;
+
+    memset(t, 0, sizeof(*t));
+    if ((f = fopen(path, "rb")) == NULL)
+	return false;
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+	fclose(f);
+	return false;
+    }
+    magic = get32(hdr, false);
+    swap = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS;
+    magic = get32(hdr, swap);
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS) {
+	fclose(f);
+	return false;
+    }
+    linktype = get32(&hdr[20], swap) & 0xffff;
+
+    buf = malloc(65536);
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+	incl = get32(&rec[8], swap);
+	orig = get32(&rec[12], swap);
+	if (incl > 65536 || fread(buf, 1, incl, f) != incl)
+	    break;
+
+	// truncated frames cannot be replayed
+	if (incl < orig || (off = trace_ip_offset(linktype, buf, incl)) < 0)
+	    continue;
+	if (incl - off < 20 || (buf[off] >> 4) != 4)
+	    continue;
+	// the IP length, Ethernet may pad short frames
+	ip_len = get16be(&buf[off + 2]);
+	if (ip_len < 20 || ip_len > incl - off || ip_len > TRACE_MTU)
+	    continue;
+	trace_add(t, &buf[off], ip_len);
+    }
+    free(buf);
+    fclose(f);
+    return true;
+}
+
+/*
+ * Synthetic trace
+ */
+static uint32_t trace_seed;
+
+static uint32_t
+trace_rnd(void)
+{
+    trace_seed = trace_seed * 1103515245 + 12345;
+    return trace_seed >> 8;
+}
+
+static uint32_t
+csum_add(uint32_t sum, const uint8_t *d, uint16_t len)
+{
+    for (; len > 1; len -= 2, d += 2)
+	sum += d[0] << 8 | d[1];
+    if (len)
+	sum += d[0] << 8;
+    return sum;
+}
+
+static uint16_t
+csum_fold(uint32_t sum)
+{
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum & 0xffff;
+}
+
+static void
+put16(uint8_t *d, uint16_t v)
+{
+    d[0] = v >> 8;
+    d[1] = v;
+}
+
+static void
+put32(uint8_t *d, uint32_t v)
+{
+    put16(d, v >> 16);
+    put16(d + 2, v);
+}
+
+struct flow {
+    uint8_t     src[4], dst[4];
+    uint16_t    sport, dport;
+    uint32_t    seq, ack;
+    uint16_t    ip_id;
+};
+
+/*
+ * Appends an IPv4 packet of proto with the transport header th (th_len
+ * bytes, its checksum is filled in) and payload
+ */
+static void
+trace_ip(struct pcap_trace *t, struct flow *f, uint8_t proto, uint8_t tos,
+	 uint8_t *th, uint16_t th_len, const uint8_t *payload, uint16_t len)
+{
+uint8_t pkt[TRACE_MTU];
+uint16_t tot = 20 + th_len + len;
+uint16_t csum_off = proto == 6 ? 16 : proto == 17 ? 6 : 2;
+uint32_t sum = 0;
+
+    memset(pkt, 0, 20);
+    pkt[0] = 0x45;
+    pkt[1] = tos;
+    put16(&pkt[2], tot);
+    put16(&pkt[4], f->ip_id++);
+    put16(&pkt[6], 0x4000);
+    pkt[8] = 64;
+    pkt[9] = proto;
+    memcpy(&pkt[12], f->src, 4);
+    memcpy(&pkt[16], f->dst, 4);
+    put16(&pkt[10], csum_fold(csum_add(0, pkt, 20)));
+
+    memcpy(&pkt[20], th, th_len);
+    if (len > 0)
+	memcpy(&pkt[20 + th_len], payload, len);
+    put16(&pkt[20 + csum_off], 0);
+    if (proto != 1) {
+	// pseudo header
+	sum = csum_add(sum, &pkt[12], 8);
+	sum += proto + th_len + len;
+    }
+    put16(&pkt[20 + csum_off], csum_fold(csum_add(sum, &pkt[20], th_len + len)));
+
+    trace_add(t, pkt, tot);
+}
+
+static void
+trace_tcp(struct pcap_trace *t, struct flow *f, uint8_t flags, const uint8_t *payload, uint16_t len)
+{
+uint8_t th[20];
+
+    memset(th, 0, sizeof(th));
+    put16(&th[0], f->sport);
+    put16(&th[2], f->dport);
+    put32(&th[4], f->seq);
+    put32(&th[8], f->ack);
+    th[12] = 5 << 4;
+    th[13] = flags;
+    put16(&th[14], 29200);
+    trace_ip(t, f, 6, 0, th, sizeof(th), payload, len);
+    f->seq += len;
+}
+
+static void
+trace_udp(struct pcap_trace *t, struct flow *f, const uint8_t *payload, uint16_t len)
+{
+uint8_t th[8];
+
+    put16(&th[0], f->sport);
+    put16(&th[2], f->dport);
+    put16(&th[4], 8 + len);
+    put16(&th[6], 0);
+    trace_ip(t, f, 17, 0, th, sizeof(th), payload, len);
+}
+
+static void
+trace_payload(uint8_t *d, uint16_t len, bool text)
+{
+static const char words[] = "GET /index.html HTTP/1.1 Host: example.org Accept: text/html "
+			    "<html><body><p>The quick brown fox jumps over the lazy dog</p> ";
+uint16_t i, w = trace_rnd() % (sizeof(words) - 1);
+
+    for (i = 0; i < len; i++) {
+	if (text) {
+	    d[i] = words[w];
+	    w = (w + 1) % (sizeof(words) - 1);
+	} else {
+	    d[i] = trace_rnd();
+	}
+	// a sprinkle of SLIP specials in both kinds
+	if (trace_rnd() % 97 == 0)
+	    d[i] = trace_rnd() & 1 ? 0xc0 : 0xdb;
+    }
+}
+
+static void
+trace_reverse(struct flow *r, const struct flow *f)
+{
+    memcpy(r->src, f->dst, 4);
+    memcpy(r->dst, f->src, 4);
+    r->sport = f->dport;
+    r->dport = f->sport;
+    r->seq = f->ack;
+    r->ack = f->seq;
+    r->ip_id = f->ip_id * 7;
+}
+
+void
+trace_synthetic(struct pcap_trace *t)
+{
+struct flow dl = {{93, 184, 216, 34}, {192, 168, 4, 2}, 80, 40001, 1000, 5000, 100};
+struct flow ssh = {{192, 168, 4, 2}, {10, 1, 2, 3}, 40002, 22, 7000, 9000, 200};
+struct flow dns = {{192, 168, 4, 2}, {8, 8, 8, 8}, 40003, 53, 0, 0, 300};
+struct flow ack, ssh_r, dns_r;
+uint8_t payload[TRACE_MTU];
+uint8_t icmp[8 + 56];
+uint16_t len;
+int i;
+
+    memset(t, 0, sizeof(*t));
+    trace_seed = 1;
+    trace_reverse(&ack, &dl);
+    trace_reverse(&ssh_r, &ssh);
+
+    for (i = 0; i < 400; i++) {
+	// download: full segments, every 4th one random (compressed media)
+	len = i % 10 == 9 ? 1 + trace_rnd() % 1460 : 1460;
+	trace_payload(payload, len, i % 4 != 3);
+	trace_tcp(t, &dl, 0x18, payload, len);
+
+	if (i % 2 == 1) {
+	    ack.ack = dl.seq;
+	    trace_tcp(t, &ack, 0x10, NULL, 0);
+	}
+
+	if (i % 16 == 0) {
+	    // keystroke, echo and ACK
+	    trace_payload(payload, 36, false);
+	    trace_tcp(t, &ssh, 0x18, payload, 36);
+	    ssh_r.ack = ssh.seq;
+	    trace_payload(payload, 36, false);
+	    trace_tcp(t, &ssh_r, 0x18, payload, 36);
+	    ssh.ack = ssh_r.seq;
+	    trace_tcp(t, &ssh, 0x10, NULL, 0);
+	}
+
+	if (i % 50 == 25) {
+	    trace_payload(payload, 32, true);
+	    trace_udp(t, &dns, payload, 32);
+	    trace_reverse(&dns_r, &dns);
+	    trace_payload(payload, 160, true);
+	    trace_udp(t, &dns_r, payload, 160);
+	    dns.sport++;
+	}
+
+	if (i % 100 == 50) {
+	    memset(icmp, 0, sizeof(icmp));
+	    icmp[0] = 8;
+	    put16(&icmp[4], 0x1234);
+	    put16(&icmp[6], i);
+	    trace_payload(&icmp[8], 56, false);
+	    trace_ip(t, &ssh, 1, 0, icmp, 8, &icmp[8], 56);
+	}
+    }
+}
+
+void
+trace_from_args(struct pcap_trace *t, int argc, char **argv)
+{
+    if (argc < 2 || argv[1][0] == '\0') {
+	trace_synthetic(t);
+	printf("trace: synthetic, %u packets, %u bytes\n", t->count, t->bytes);
+	return;
+    }
+    if (!trace_load_pcap(t, argv[1])) {
+	fprintf(stderr, "%s: not a pcap file\n", argv[1]);
+	exit(2);
+    }
+    printf("trace: %s, %u IPv4 packets, %u bytes\n", argv[1], t->count, t->bytes);
+}
+
+void
+trace_free(struct pcap_trace *t)
+{
+uint32_t i;
+
+    for (i = 0; i < t->count; i++)
+	free(t->pkt[i]);
+    free(t->pkt);
+    free(t->len);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,35 @@
+#ifndef _PCAP_TRACE_H_
+#define _PCAP_TRACE_H_
+
+#include "c_types.h"
+
+/*
+ * IPv4 packet traces for the SLIP tests and benchmarks: a capture file
+ * (classic libpcap format, Ethernet, raw IP, BSD loopback or Linux cooked
+ * link type) or a built in synthetic mix. Non-IPv4 frames and packets
+ * above TRACE_MTU are skipped.
+ */
+
+#define TRACE_MTU 1500
+
+struct pcap_trace {
+    uint32_t    count;
+    uint32_t    bytes;
+    uint8_t     **pkt;
+    uint16_t    *len;
+};
+
+// Reads the IPv4 packets of a capture file, false if it is not a pcap file
+bool trace_load_pcap(struct pcap_trace *t, const char *path);
+
+// A deterministic mix of a TCP download with its ACKs, an interactive ssh
+// session, DNS over UDP and pings. Part of the payload is text, part
+// random, with SLIP END and ESC bytes in both
+void trace_synthetic(struct pcap_trace *t);
+
+// The trace named in argv[1] or the synthetic one, exits on a bad file
+void trace_from_args(struct pcap_trace *t, int argc, char **argv);
+
+void trace_free(struct pcap_trace *t);
+
+#endif
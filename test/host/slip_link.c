@@ -0,0 +1,87 @@
+#include <string.h>
+
+#include "c_types.h"
+#include "lwip/pbuf.h"
+
+#include "driver/uart.h"
+#include "driver/uart_register.h"
+#include "driver/slip.h"
+
+#include "host_sdk.h"
+#include "slip_link.h"
+
+struct netif host_slip_if;
+link_rx_fn link_rx;
+
+static uint8_t link_buf[HOST_WIRE_SIZE];
+
+static err_t
+link_input(struct pbuf *p, struct netif *inp)
+{
+static uint8_t pkt[SLIP_RX_SLOT_SIZE];
+uint16_t len = pbuf_copy_partial(p, pkt, sizeof(pkt), 0);
+
+    pbuf_free(p);
+    if (link_rx != NULL)
+	link_rx(pkt, len);
+    return ERR_OK;
+}
+
+void
+link_init(void)
+{
+    uart_init(BIT_RATE_115200);
+    uart0_unload_block_fn = slip_rx_bytes;
+
+    memset(&host_slip_if, 0, sizeof(host_slip_if));
+    host_slip_if.input = link_input;
+    host_slip_if.mtu = 1500;
+}
+
+bool
+link_tasks(void)
+{
+os_signal_t sig;
+bool any = false;
+
+    while (host_os_take(&sig)) {
+	any = true;
+	if (sig == UART0_SIGNAL)
+	    slip_process_rxqueue(&host_slip_if);
+	else if (sig == UART0_TX_SIGNAL)
+	    slip_output_resume(&host_slip_if);
+    }
+    return any;
+}
+
+err_t
+link_send(const uint8_t *pkt, uint16_t len)
+{
+struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+err_t err;
+
+    pbuf_take(p, pkt, len);
+    err = slip_output(&host_slip_if, p, NULL);
+    pbuf_free(p);
+
+    do {
+	host_uart_tx_drain();
+    } while (link_tasks());
+    return err;
+}
+
+void
+link_loopback(void)
+{
+uint32_t len = host_wire_len, done;
+uint16_t n;
+
+    memcpy(link_buf, host_wire, len);
+    host_wire_clear();
+
+    for (done = 0; done < len; done += n) {
+	n = host_uart_feed(&link_buf[done], len - done > HOST_UART_FIFO_LEN ? HOST_UART_FIFO_LEN : len - done);
+	host_uart_isr(n == HOST_UART_FIFO_LEN ? UART_RXFIFO_FULL_INT_ST : UART_RXFIFO_TOUT_INT_ST);
+	link_tasks();
+    }
+}
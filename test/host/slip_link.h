@@ -0,0 +1,34 @@
+#ifndef _SLIP_LINK_H_
+#define _SLIP_LINK_H_
+
+#include "c_types.h"
+#include "lwip/netif.h"
+
+/*
+ * The SLIP netif looped back to itself over the UART model: what
+ * slip_output() puts on the wire is fed into the RX FIFO again, so the
+ * TX side (compressor, encoder, UART TX ring and ISR) and the RX side
+ * (ISR, decoder, arena, expander) of driver/slip.c talk to each other
+ * like two routers.
+ */
+
+// Called for each packet the netif delivers to the stack
+typedef void (*link_rx_fn)(const uint8_t *pkt, uint16_t len);
+
+extern struct netif host_slip_if;
+extern link_rx_fn link_rx;
+
+void link_init(void);
+
+// Sends a packet (in PBUF_POOL pieces) and serves the TX interrupts
+// until it is on the wire, the result of slip_output()
+err_t link_send(const uint8_t *pkt, uint16_t len);
+
+// Feeds the wire into the RX FIFO, one RX interrupt per FIFO, and
+// delivers the decoded packets after each
+void link_loopback(void);
+
+// Runs the task signals posted by the ISR, false if there were none
+bool link_tasks(void);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+typedef uint8_t uint8; typedef uint16_t uint16; typedef uint32_t uint32; typedef uint64_t uint64;
+typedef int8_t sint8; typedef int16_t sint16; typedef int32_t sint32; typedef int64_t sint64;
+typedef uint8_t u8; typedef uint16_t u16; typedef uint32_t u32; typedef int8_t s8; typedef int16_t s16; typedef int32_t s32;
+typedef unsigned char BOOL;
+#define TRUE 1
+#define FALSE 0
+typedef enum { OK = 0, FAIL, PENDING, BUSY, CANCEL } STATUS;
+#define LOCAL static
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define IRAM_ATTR
+#define BIT(nr) (1UL << (nr))
+#define __packed __attribute__((packed))
+#endif
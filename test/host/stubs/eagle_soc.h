@@ -0,0 +1,40 @@
+#ifndef _EAGLE_SOC_H_
+#define _EAGLE_SOC_H_
+#include "c_types.h"
+// Peripheral registers go to the fake hardware in host_sdk.c
+uint32_t host_reg_read(uint32_t addr);
+void host_reg_write(uint32_t addr, uint32_t val);
+#define READ_PERI_REG(addr) host_reg_read((uint32_t)(addr))
+#define WRITE_PERI_REG(addr, val) host_reg_write((uint32_t)(addr), (uint32_t)(val))
+#define CLEAR_PERI_REG_MASK(reg, mask) WRITE_PERI_REG((reg), (READ_PERI_REG(reg)&(~(mask))))
+#define SET_PERI_REG_MASK(reg, mask)   WRITE_PERI_REG((reg), (READ_PERI_REG(reg)|(mask)))
+#define GET_PERI_REG_BITS(reg, hipos,lowpos) ((READ_PERI_REG(reg)>>(lowpos))&((1<<((hipos)-(lowpos)+1))-1))
+#define SET_PERI_REG_BITS(reg,bit_map,value,shift) (WRITE_PERI_REG((reg),(READ_PERI_REG(reg)&(~((bit_map)<<(shift))))|((value)<<(shift)) ))
+#define APB_CLK_FREQ 80*1000000
+#define UART_CLK_FREQ APB_CLK_FREQ
+#define PERIPHS_IO_MUX_U0TXD_U 0x60000818
+#define PERIPHS_IO_MUX_U0RXD_U 0x60000814
+#define PERIPHS_IO_MUX_MTDO_U 0x60000810
+#define PERIPHS_IO_MUX_MTCK_U 0x6000080C
+#define PERIPHS_IO_MUX_MTMS_U 0x60000808
+#define PERIPHS_IO_MUX_MTDI_U 0x60000804
+#define PERIPHS_IO_MUX_GPIO0_U 0x60000834
+#define PERIPHS_IO_MUX_GPIO2_U 0x60000838
+#define PERIPHS_IO_MUX_GPIO4_U 0x6000083C
+#define PERIPHS_IO_MUX_GPIO5_U 0x60000840
+#define FUNC_U0TXD 0
+#define FUNC_U0RTS 4
+#define FUNC_GPIO0 0
+#define FUNC_GPIO1 3
+#define FUNC_GPIO2 0
+#define FUNC_GPIO3 3
+#define FUNC_GPIO4 0
+#define FUNC_GPIO5 0
+#define FUNC_GPIO12 3
+#define FUNC_GPIO13 3
+#define FUNC_GPIO14 3
+#define FUNC_GPIO15 3
+#define PIN_FUNC_SELECT(PIN_NAME, FUNC) do { (void)(PIN_NAME); (void)(FUNC); } while (0)
+#define PIN_PULLUP_DIS(PIN_NAME) do { (void)(PIN_NAME); } while (0)
+#define PIN_PULLUP_EN(PIN_NAME) do { (void)(PIN_NAME); } while (0)
+#endif
@@ -0,0 +1,29 @@
+#ifndef _ETS_SYS_H
+#define _ETS_SYS_H
+#include "c_types.h"
+#include "eagle_soc.h"
+typedef uint32_t ETSSignal;
+typedef uint32_t ETSParam;
+typedef struct ETSEventTag { ETSSignal sig; ETSParam par; } ETSEvent;
+typedef void (*ETSTask)(ETSEvent *e);
+typedef void (* ets_isr_t)(void *);
+typedef void ETSTimerFunc(void *timer_arg);
+typedef struct _ETSTIMER_ { struct _ETSTIMER_ *timer_next; uint32_t timer_expire; uint32_t timer_period; ETSTimerFunc *timer_func; void *timer_arg; } ETSTimer;
+void ets_isr_attach(int i, ets_isr_t func, void *arg);
+void ets_isr_mask(uint32 mask);
+void ets_isr_unmask(uint32 unmask);
+#define ETS_UART_INUM 5
+#define ETS_GPIO_INUM 4
+#define ETS_INTR_ENABLE(inum) ets_isr_unmask((1<<inum))
+#define ETS_INTR_DISABLE(inum) ets_isr_mask((1<<inum))
+#define ETS_UART_INTR_ATTACH(func, arg) ets_isr_attach(ETS_UART_INUM, (ets_isr_t)(func), (void *)(arg))
+#define ETS_UART_INTR_ENABLE() ETS_INTR_ENABLE(ETS_UART_INUM)
+#define ETS_UART_INTR_DISABLE() ETS_INTR_DISABLE(ETS_UART_INUM)
+#define ETS_GPIO_INTR_ATTACH(func, arg) ets_isr_attach(ETS_GPIO_INUM, (ets_isr_t)(func), (void *)(arg))
+#define ETS_GPIO_INTR_ENABLE() ETS_INTR_ENABLE(ETS_GPIO_INUM)
+#define ETS_GPIO_INTR_DISABLE() ETS_INTR_DISABLE(ETS_GPIO_INUM)
+#define ETS_INTR_LOCK() ets_intr_lock()
+#define ETS_INTR_UNLOCK() ets_intr_unlock()
+void ets_intr_lock(void);
+void ets_intr_unlock(void);
+#endif
@@ -0,0 +1,11 @@
+#ifndef __LWIP_ARCH_H__
+#define __LWIP_ARCH_H__
+#ifndef LITTLE_ENDIAN
+#define LITTLE_ENDIAN 1234
+#endif
+#ifndef BIG_ENDIAN
+#define BIG_ENDIAN 4321
+#endif
+#include "arch/cc.h"
+#define LWIP_UNUSED_ARG(x) (void)x
+#endif
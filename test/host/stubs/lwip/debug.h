@@ -0,0 +1,7 @@
+#ifndef __LWIP_DEBUG_H__
+#define __LWIP_DEBUG_H__
+#include "lwip/arch.h"
+#define LWIP_ASSERT(message, assertion)
+#define LWIP_ERROR(message, expression, handler) do { if (!(expression)) { handler;}} while(0)
+#define LWIP_DEBUGF(debug, message)
+#endif
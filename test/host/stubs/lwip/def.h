@@ -0,0 +1,16 @@
+#ifndef __LWIP_DEF_H__
+#define __LWIP_DEF_H__
+#include "lwip/arch.h"
+#define LWIP_MAX(x , y)  (((x) > (y)) ? (x) : (y))
+#define LWIP_MIN(x , y)  (((x) < (y)) ? (x) : (y))
+#define LWIP_MEM_ALIGN_SIZE(size) (((size) + 4 - 1) & ~(4-1))
+u16_t lwip_htons(u16_t x); u16_t lwip_ntohs(u16_t x); u32_t lwip_htonl(u32_t x); u32_t lwip_ntohl(u32_t x);
+#define htons(x) lwip_htons(x)
+#define ntohs(x) lwip_ntohs(x)
+#define htonl(x) lwip_htonl(x)
+#define ntohl(x) lwip_ntohl(x)
+#define PP_HTONS(x) ((((x) & 0xff) << 8) | (((x) & 0xff00) >> 8))
+#define PP_NTOHS(x) PP_HTONS(x)
+#define PP_HTONL(x) ((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | (((x) & 0xff0000UL) >> 8) | (((x) & 0xff000000UL) >> 24))
+#define PP_NTOHL(x) PP_HTONL(x)
+#endif
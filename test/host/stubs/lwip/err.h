@@ -0,0 +1,17 @@
+#ifndef __LWIP_ERR_H__
+#define __LWIP_ERR_H__
+#include "lwip/opt.h"
+#include "lwip/arch.h"
+typedef s8_t err_t;
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_BUF -2
+#define ERR_TIMEOUT -3
+#define ERR_RTE -4
+#define ERR_INPROGRESS -5
+#define ERR_VAL -6
+#define ERR_WOULDBLOCK -7
+#define ERR_ABRT -8
+#define ERR_ARG -14
+#define ERR_IF -12
+#endif
@@ -0,0 +1,12 @@
+#ifndef __SIO_H__
+#define __SIO_H__
+#include "lwip/arch.h"
+typedef void * sio_fd_t;
+sio_fd_t sio_open(u8_t devnum);
+void sio_send(u8_t c, sio_fd_t fd);
+u8_t sio_recv(sio_fd_t fd);
+u32_t sio_read(sio_fd_t fd, u8_t *data, u32_t len);
+u32_t sio_tryread(sio_fd_t fd, u8_t *data, u32_t len);
+u32_t sio_write(sio_fd_t fd, u8_t *data, u32_t len);
+void sio_read_abort(sio_fd_t fd);
+#endif
@@ -0,0 +1,5 @@
+#ifndef __LWIP_SYS_H__
+#define __LWIP_SYS_H__
+#include "lwip/opt.h"
+u32_t sys_now(void);
+#endif
@@ -0,0 +1,4 @@
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+#define STAILQ_ENTRY(type) struct { struct type *stqe_next; }
+#endif
@@ -0,0 +1,65 @@
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+#include "os_type.h"
+#include "lwip/ip_addr.h"
+#include "queue.h"
+#include "gpio.h"
+#include "spi_flash.h"
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen);
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par);
+uint32 system_get_time(void);
+uint32 system_get_free_heap_size(void);
+void system_restart(void);
+bool system_update_cpu_freq(uint8 freq);
+uint8 system_get_cpu_freq(void);
+void system_set_os_print(uint8 onoff);
+void system_soft_wdt_feed(void);
+void system_init_done_cb(void (*cb)(void));
+enum flash_size_map { FLASH_SIZE_4M_MAP_256_256 = 0, FLASH_SIZE_2M, FLASH_SIZE_8M_MAP_512_512, FLASH_SIZE_16M_MAP_512_512, FLASH_SIZE_32M_MAP_512_512, FLASH_SIZE_16M_MAP_1024_1024, FLASH_SIZE_32M_MAP_1024_1024 };
+enum flash_size_map system_get_flash_size_map(void);
+#define NULL_MODE 0
+#define STATION_MODE 1
+#define SOFTAP_MODE 2
+#define STATIONAP_MODE 3
+typedef enum _auth_mode { AUTH_OPEN = 0, AUTH_WEP, AUTH_WPA_PSK, AUTH_WPA2_PSK, AUTH_WPA_WPA2_PSK, AUTH_MAX } AUTH_MODE;
+uint8 wifi_get_opmode(void);
+bool wifi_set_opmode(uint8 opmode);
+struct bss_info { STAILQ_ENTRY(bss_info) next; uint8 bssid[6]; uint8 ssid[32]; uint8 ssid_len; uint8 channel; sint8 rssi; AUTH_MODE authmode; uint8 is_hidden; sint16 freq_offset; sint16 freqcal_val; uint8 *esp_mesh_ie; uint8 simple_pair; };
+typedef void (* scan_done_cb_t)(void *arg, STATUS status);
+struct station_config { uint8 ssid[32]; uint8 password[64]; uint8 bssid_set; uint8 bssid[6]; };
+bool wifi_station_get_config(struct station_config *config);
+bool wifi_station_set_config(struct station_config *config);
+bool wifi_station_set_config_current(struct station_config *config);
+bool wifi_station_connect(void);
+bool wifi_station_disconnect(void);
+sint8 wifi_station_get_rssi(void);
+struct scan_config { uint8 *ssid; uint8 *bssid; uint8 channel; uint8 show_hidden; };
+bool wifi_station_scan(struct scan_config *config, scan_done_cb_t cb);
+bool wifi_station_set_auto_connect(uint8 set);
+uint8 wifi_station_get_connect_status(void);
+bool wifi_set_channel(uint8 channel);
+uint8 wifi_get_channel(void);
+struct softap_config { uint8 ssid[32]; uint8 password[64]; uint8 ssid_len; uint8 channel; AUTH_MODE authmode; uint8 ssid_hidden; uint8 max_connection; uint16 beacon_interval; };
+bool wifi_softap_get_config(struct softap_config *config);
+bool wifi_softap_set_config(struct softap_config *config);
+uint8 wifi_softap_get_station_num(void);
+bool wifi_softap_dhcps_stop(void);
+bool wifi_softap_dhcps_start(void);
+void *eagle_lwip_getif(uint8 index);
+struct ip_info { struct ip_addr ip; struct ip_addr netmask; struct ip_addr gw; };
+bool wifi_get_ip_info(uint8 if_index, struct ip_info *info);
+enum { EVENT_STAMODE_CONNECTED = 0, EVENT_STAMODE_DISCONNECTED, EVENT_STAMODE_AUTHMODE_CHANGE, EVENT_STAMODE_GOT_IP, EVENT_STAMODE_DHCP_TIMEOUT, EVENT_SOFTAPMODE_STACONNECTED, EVENT_SOFTAPMODE_STADISCONNECTED, EVENT_SOFTAPMODE_PROBEREQRECVED, EVENT_MAX };
+enum { REASON_UNSPECIFIED = 1, REASON_AUTH_EXPIRE = 2, REASON_BEACON_TIMEOUT = 200, REASON_NO_AP_FOUND = 201, REASON_AUTH_FAIL = 202, REASON_ASSOC_FAIL = 203, REASON_HANDSHAKE_TIMEOUT = 204 };
+typedef struct { uint8 ssid[32]; uint8 ssid_len; uint8 bssid[6]; uint8 channel; } Event_StaMode_Connected_t;
+typedef struct { uint8 ssid[32]; uint8 ssid_len; uint8 bssid[6]; uint8 reason; } Event_StaMode_Disconnected_t;
+typedef struct { uint8 old_mode; uint8 new_mode; } Event_StaMode_AuthMode_Change_t;
+typedef struct { struct ip_addr ip; struct ip_addr mask; struct ip_addr gw; } Event_StaMode_Got_IP_t;
+typedef union { Event_StaMode_Connected_t connected; Event_StaMode_Disconnected_t disconnected; Event_StaMode_AuthMode_Change_t auth_change; Event_StaMode_Got_IP_t got_ip; } Event_Info_u;
+typedef struct _esp_event { uint32 event; Event_Info_u event_info; } System_Event_t;
+typedef void (* wifi_event_handler_cb_t)(System_Event_t *event);
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb);
+void uart_div_modify(uint8 uart_no, uint32 DivLatchValue);
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+enum { STATION_IDLE = 0, STATION_CONNECTING, STATION_WRONG_PASSWORD, STATION_NO_AP_FOUND, STATION_CONNECT_FAIL, STATION_GOT_IP };
+#endif
@@ -0,0 +1,147 @@
+#include <string.h>
+
+#include "driver/hayes.h"
+
+#include "host_sdk.h"
+
+/*
+ * driver/hayes.c behind the UART ISR as in user_main.c: AT commands and
+ * their answers on the wire, and the +++ escape with its guard time,
+ * which the guard timer of h_init() confirms
+ */
+
+extern hayes_t modem;
+
+static sysconfig_t cfg;
+
+static uint8_t data[256];
+static uint16_t data_len;
+
+static void
+data_rx(uint8_t *d, uint16_t len)
+{
+    memcpy(data + data_len, d, len);
+    data_len += len;
+}
+
+static void
+modem_rx(uint8 *d, uint16 len)
+{
+    h_rx_block(d, len, data_rx);
+}
+
+// Feeds one RX block after after_us of silence
+static void
+feed(uint32_t after_us, const char *s)
+{
+    host_advance_us(after_us);
+    host_uart_rx((const uint8_t *)s, strlen(s));
+}
+
+// The answer to an AT command line
+static const char *
+at(const char *line)
+{
+static char out[256];
+
+    host_wire_clear();
+    feed(100000, line);
+    memcpy(out, host_wire, host_wire_len);
+    out[host_wire_len] = '\0';
+    return out;
+}
+
+static bool
+got(const char *s)
+{
+bool same = data_len == strlen(s) && memcmp(data, s, data_len) == 0;
+
+    data_len = 0;
+    return same;
+}
+
+static void
+test_commands(void)
+{
+    CHECK(!modem.state.online);
+    CHECK(strcmp(at("AT\r"), "AT\rOK\r") == 0);
+    CHECK(strcmp(at("ATE0\r"), "ATE0\rOK\r") == 0);
+    CHECK(strcmp(at("AT\r"), "OK\r") == 0);
+    CHECK(strcmp(at("ATS12?\r"), "S12 = 50\rOK\r") == 0);
+    CHECK(strcmp(at("ATS99?\r"), "ERROR\r") == 0);
+    at("ATV0\r");
+    CHECK(strcmp(at("AT\r"), "0\r") == 0);
+    at("ATV1\r");
+    CHECK(strcmp(at("AT\r"), "OK\r") == 0);
+    CHECK(strcmp(at("ATO\r"), "NO CARRIER\r") == 0);
+
+    // bytes behind the dial command are data already
+    data_len = 0;
+    CHECK(strcmp(at("ATDT5551234\rHELLO"), "CONNECT 115200\r") == 0);
+    CHECK(modem.state.online);
+    CHECK(got("HELLO"));
+}
+
+static void
+test_escape(void)
+{
+uint32_t guard = 50 * 20000;
+
+    // guard time, +++, guard time
+    host_wire_clear();
+    feed(guard + 100000, "+++");
+    host_advance_us(guard / 2);
+    CHECK(modem.state.online);
+    host_advance_us(guard / 2 + HAYES_GUARD_POLL_MS * 1000);
+    CHECK(!modem.state.online);
+    CHECK(host_wire_len == 3 && memcmp(host_wire, "OK\r", 3) == 0);
+    CHECK(got(""));
+
+    CHECK(strcmp(at("ATO\r"), "OK\r") == 0);
+    CHECK(modem.state.online);
+
+    // without silence before it the run is data
+    feed(guard + 100000, "x");
+    feed(1000, "+++");
+    CHECK(got("x+++"));
+
+    // data within the guard time after it
+    feed(guard + 100000, "+++");
+    feed(1000, "y");
+    CHECK(got("+++y"));
+    CHECK(modem.state.online);
+
+    // too short, released when the guard time is over
+    feed(guard + 100000, "++");
+    host_advance_us(guard + HAYES_GUARD_POLL_MS * 1000);
+    CHECK(got("++"));
+    CHECK(modem.state.online);
+
+    // too long
+    feed(guard + 100000, "++++");
+    CHECK(got("++++"));
+
+    // one char per block
+    host_wire_clear();
+    feed(guard + 100000, "+");
+    feed(100000, "+");
+    feed(100000, "+");
+    host_advance_us(guard + HAYES_GUARD_POLL_MS * 1000);
+    CHECK(!modem.state.online);
+    CHECK(got(""));
+    CHECK(host_wire_len == 3 && memcmp(host_wire, "OK\r", 3) == 0);
+}
+
+int
+main(void)
+{
+    uart_init(BIT_RATE_115200);
+    uart0_unload_block_fn = modem_rx;
+
+    cfg.bit_rate = 115200;
+    h_init(&cfg);
+
+    test_commands();
+    test_escape();
+    return host_test_result("hayes");
+}
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "ringbuf.h"
+
+#include "host_sdk.h"
+
+/*
+ * user/ringbuf.c against a plain array model: random writes and reads of
+ * random size, so every wrap position is hit
+ */
+
+#define CAP 100
+
+static uint8_t model[4 * CAP];
+static size_t model_len;
+
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void
+test_basic(void)
+{
+ringbuf_t rb = ringbuf_new(CAP);
+uint8_t in[CAP + 20], out[CAP + 20];
+int i;
+
+    CHECK(rb != NULL);
+    CHECK(ringbuf_capacity(rb) == CAP);
+    CHECK(ringbuf_is_empty(rb));
+
+    for (i = 0; i < sizeof(in); i++)
+	in[i] = i;
+
+    ringbuf_memcpy_into(rb, in, 60);
+    CHECK(ringbuf_bytes_used(rb) == 60);
+    CHECK(ringbuf_bytes_free(rb) == CAP - 60);
+
+    // no underflow: nothing is taken
+    CHECK(ringbuf_memcpy_from(out, rb, 61) == NULL);
+    CHECK(ringbuf_bytes_used(rb) == 60);
+
+    CHECK(ringbuf_memcpy_from(out, rb, 60) != NULL);
+    CHECK(memcmp(in, out, 60) == 0);
+    CHECK(ringbuf_is_empty(rb));
+
+    // overflow keeps the newest CAP bytes
+    ringbuf_memcpy_into(rb, in, CAP + 20);
+    CHECK(ringbuf_is_full(rb));
+    CHECK(ringbuf_memcpy_from(out, rb, CAP) != NULL);
+    CHECK(memcmp(in + 20, out, CAP) == 0);
+
+    ringbuf_free(&rb);
+    CHECK(rb == NULL);
+}
+
+static void
+test_copy(void)
+{
+ringbuf_t a = ringbuf_new(CAP), b = ringbuf_new(CAP / 2);
+uint8_t in[CAP], out[CAP];
+int i;
+
+    for (i = 0; i < CAP; i++)
+	in[i] = 0xff - i;
+
+    ringbuf_memcpy_into(a, in, 70);
+    CHECK(ringbuf_copy(b, a, 71) == NULL);
+    CHECK(ringbuf_copy(b, a, 40) != NULL);
+    CHECK(ringbuf_bytes_used(a) == 30);
+    CHECK(ringbuf_bytes_used(b) == 40);
+    CHECK(ringbuf_memcpy_from(out, b, 40) != NULL);
+    CHECK(memcmp(in, out, 40) == 0);
+
+    ringbuf_free(&a);
+    ringbuf_free(&b);
+}
+
+static void
+test_model(void)
+{
+ringbuf_t rb = ringbuf_new(CAP);
+uint8_t buf[CAP + 1];
+size_t n, i;
+int op;
+bool ok = true;
+
+    for (op = 0; op < 100000 && ok; op++) {
+	n = rnd() % (CAP + 1);
+	if (rnd() & 1) {
+	    if (n > ringbuf_bytes_free(rb))
+		n = ringbuf_bytes_free(rb);
+	    for (i = 0; i < n; i++)
+		buf[i] = model[model_len + i] = rnd();
+	    ringbuf_memcpy_into(rb, buf, n);
+	    model_len += n;
+	} else {
+	    if (n > model_len)
+		n = model_len;
+	    ringbuf_memcpy_from(buf, rb, n);
+	    ok = memcmp(buf, model, n) == 0;
+	    memmove(model, model + n, model_len - n);
+	    model_len -= n;
+	}
+	ok = ok && ringbuf_bytes_used(rb) == model_len;
+    }
+    CHECK(ok);
+
+    ringbuf_free(&rb);
+}
+
+int
+main(void)
+{
+    test_basic();
+    test_copy();
+    test_model();
+    return host_test_result("ringbuf");
+}
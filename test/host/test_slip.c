@@ -0,0 +1,280 @@
+#include <string.h>
+
+#include "lwip/inet_chksum.h"
+
+#include "driver/uart_register.h"
+#include "driver/slip.h"
+#include "driver/vjcomp.h"
+#include "router_stats.h"
+
+#include "host_sdk.h"
+#include "pcap_trace.h"
+#include "slip_link.h"
+
+/*
+ * driver/slip.c over the looped back UART: the framing on the wire, the
+ * error paths of the decoder and a trace sent through each link mode,
+ * every packet has to come out as it went in
+ */
+
+static uint8_t got[TRACE_MTU];
+static uint16_t got_len;
+static uint32_t got_count;
+
+static void
+capture(const uint8_t *pkt, uint16_t len)
+{
+    memcpy(got, pkt, len);
+    got_len = len;
+    got_count++;
+}
+
+// An IPv4 header with a valid checksum and the payload bytes c
+static uint16_t
+make_packet(uint8_t *pkt, uint16_t len, uint8_t c)
+{
+uint16_t sum;
+
+    memset(pkt, c, len);
+    memset(pkt, 0, 20);
+    pkt[0] = 0x45;
+    pkt[2] = len >> 8;
+    pkt[3] = len;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    pkt[12] = 10;
+    pkt[16] = 10;
+    pkt[19] = 1;
+    sum = inet_chksum(pkt, 20);
+    memcpy(&pkt[10], &sum, 2);
+    return len;
+}
+
+static void
+test_framing(void)
+{
+uint8_t pkt[64], expect[2 * 64 + 2];
+uint16_t i, n = 0;
+
+    make_packet(pkt, sizeof(pkt), 0x55);
+    pkt[30] = SLIP_END;
+    pkt[31] = SLIP_ESC;
+    pkt[40] = SLIP_ESC;
+    pkt[41] = SLIP_END;
+
+    expect[n++] = SLIP_END;
+    for (i = 0; i < sizeof(pkt); i++) {
+	if (pkt[i] == SLIP_END) {
+	    expect[n++] = SLIP_ESC;
+	    expect[n++] = SLIP_ESC_END;
+	} else if (pkt[i] == SLIP_ESC) {
+	    expect[n++] = SLIP_ESC;
+	    expect[n++] = SLIP_ESC_ESC;
+	} else {
+	    expect[n++] = pkt[i];
+	}
+    }
+    expect[n++] = SLIP_END;
+
+    host_wire_clear();
+    CHECK(link_send(pkt, sizeof(pkt)) == ERR_OK);
+    CHECK(host_wire_len == n);
+    CHECK(memcmp(host_wire, expect, n) == 0);
+
+    got_count = 0;
+    link_loopback();
+    CHECK(got_count == 1);
+    CHECK(got_len == sizeof(pkt) && memcmp(got, pkt, sizeof(pkt)) == 0);
+}
+
+static void
+test_decode_errors(void)
+{
+uint8_t pkt[40], wire[200];
+uint16_t n = 0;
+uint32_t errors = router_stats.slip_rx_errors;
+
+    make_packet(pkt, sizeof(pkt), 0x11);
+
+    // a bad escape drops the frame, the next one is fine
+    wire[n++] = SLIP_END;
+    memcpy(&wire[n], pkt, 20);
+    n += 20;
+    wire[n++] = SLIP_ESC;
+    wire[n++] = 0x01;
+    memcpy(&wire[n], &pkt[20], 20);
+    n += 20;
+    wire[n++] = SLIP_END;
+    memcpy(&wire[n], pkt, sizeof(pkt));
+    n += sizeof(pkt);
+    wire[n++] = SLIP_END;
+
+    got_count = 0;
+    host_wire_clear();
+    memcpy(host_wire, wire, n);
+    host_wire_len = n;
+    link_loopback();
+    CHECK(router_stats.slip_rx_errors == errors + 1);
+    CHECK(got_count == 1);
+    CHECK(got_len == sizeof(pkt) && memcmp(got, pkt, sizeof(pkt)) == 0);
+}
+
+static void
+test_arena_full(void)
+{
+uint8_t pkt[20];
+uint16_t i;
+uint32_t dropped = router_stats.slip_rx_dropped;
+
+    make_packet(pkt, sizeof(pkt), 0);
+
+    // SLIP_RX_SLOTS + 2 frames in one interrupt, before the task runs
+    for (i = 0; i < SLIP_RX_SLOTS + 2; i++) {
+	host_uart_feed(pkt, sizeof(pkt));
+	host_uart_feed((uint8_t *)"\300", 1);
+    }
+    got_count = 0;
+    host_uart_isr(UART_RXFIFO_TOUT_INT_ST);
+    CHECK(router_stats.slip_rx_dropped == dropped + 2);
+    link_tasks();
+    CHECK(got_count == SLIP_RX_SLOTS);
+}
+
+static void
+test_pbuf_retry(void)
+{
+uint8_t pkt[100];
+uint32_t raw;
+
+    make_packet(pkt, sizeof(pkt), 0x22);
+    got_count = 0;
+    CHECK(link_send(pkt, sizeof(pkt)) == ERR_OK);
+    host_pbuf_fail = 1;
+    link_loopback();
+    CHECK(got_count == 0);
+
+    // the frame waits in the arena for the retry timer
+    host_advance_us(SLIP_RX_RETRY_MS * 1000);
+    CHECK(got_count == 1);
+    CHECK(got_len == sizeof(pkt) && memcmp(got, pkt, sizeof(pkt)) == 0);
+
+    // the compression stats count the frame once, however many retries
+    slip_set_lz(true);
+    raw = router_stats.lz_rx_raw;
+    got_count = 0;
+    CHECK(link_send(pkt, sizeof(pkt)) == ERR_OK);
+    host_pbuf_fail = 3;
+    link_loopback();
+    host_advance_us(3 * SLIP_RX_RETRY_MS * 1000);
+    CHECK(got_count == 1);
+    CHECK(router_stats.lz_rx_raw - raw == sizeof(pkt));
+    slip_set_lz(false);
+}
+
+// Small ICMP is interactive, echo floods of full frames are not
+static void
+test_qos_icmp(void)
+{
+uint8_t pkt[1000];
+uint16_t sum;
+uint32_t inter = router_stats.qos_tx[SLIP_TX_INTERACTIVE];
+uint32_t def = router_stats.qos_tx[SLIP_TX_DEFAULT];
+uint16_t len;
+
+    slip_set_qos(true);
+    for (len = 100; len <= sizeof(pkt); len += sizeof(pkt) - 100) {
+	make_packet(pkt, len, 0x33);
+	pkt[9] = 1;
+	memset(&pkt[10], 0, 2);
+	sum = inet_chksum(pkt, 20);
+	memcpy(&pkt[10], &sum, 2);
+	CHECK(link_send(pkt, len) == ERR_OK);
+	link_loopback();
+    }
+    CHECK(router_stats.qos_tx[SLIP_TX_INTERACTIVE] - inter == 1);
+    CHECK(router_stats.qos_tx[SLIP_TX_DEFAULT] - def == 1);
+}
+
+// An UNCOMPRESSED_TCP header is only taken with a valid IP checksum
+static void
+test_vj_remember(void)
+{
+uint8_t pkt[60], frame[60];
+uint16_t sum;
+
+    make_packet(pkt, sizeof(pkt), 0x50);
+    pkt[9] = 6;
+    memset(&pkt[10], 0, 2);
+    sum = inet_chksum(pkt, 20);
+    memcpy(&pkt[10], &sum, 2);
+
+    // type and slot id in the version and protocol fields
+    memcpy(frame, pkt, sizeof(pkt));
+    frame[0] = VJ_TYPE_UNCOMPRESSED_TCP | 5;
+    frame[9] = 3;
+    CHECK(vj_remember(frame, sizeof(frame)));
+    CHECK(memcmp(frame, pkt, sizeof(pkt)) == 0);
+
+    memcpy(frame, pkt, sizeof(pkt));
+    frame[0] = VJ_TYPE_UNCOMPRESSED_TCP | 5;
+    frame[9] = 3;
+    frame[8]--;
+    CHECK(!vj_remember(frame, sizeof(frame)));
+    vj_init();
+}
+
+// Sends the trace in a link mode, returns the bytes on the wire
+static uint32_t
+test_trace(struct pcap_trace *t, const char *mode, bool cslip, bool lz)
+{
+uint32_t i, bad = 0, wire = 0, errors = router_stats.slip_rx_errors;
+
+    slip_set_cslip(cslip);
+    slip_set_lz(lz);
+
+    for (i = 0; i < t->count; i++) {
+	got_count = 0;
+	if (link_send(t->pkt[i], t->len[i]) != ERR_OK) {
+	    bad++;
+	    continue;
+	}
+	wire += host_wire_len;
+	link_loopback();
+	if (got_count != 1 || got_len != t->len[i] || memcmp(got, t->pkt[i], got_len) != 0) {
+	    if (bad++ == 0)
+		fprintf(stderr, "%s: packet %u of %u bytes differs\n", mode, i, t->len[i]);
+	}
+    }
+    printf("%s: %u packets, %u bad, %u bytes on the wire\n", mode, t->count, bad, wire);
+    CHECK(bad == 0);
+    CHECK(router_stats.slip_rx_errors == errors);
+    return wire;
+}
+
+int
+main(int argc, char **argv)
+{
+struct pcap_trace t;
+uint32_t plain;
+
+    link_init();
+    link_rx = capture;
+
+    test_framing();
+    test_decode_errors();
+    test_arena_full();
+    test_pbuf_retry();
+    test_vj_remember();
+    test_qos_icmp();
+
+    trace_from_args(&t, argc, argv);
+    plain = test_trace(&t, "slip", false, false);
+    // never longer on the wire than plain SLIP
+    CHECK(test_trace(&t, "cslip", true, false) <= plain);
+    CHECK(test_trace(&t, "lzf", false, true) <= plain);
+    CHECK(test_trace(&t, "cslip+lzf", true, true) <= plain);
+    trace_free(&t);
+
+    CHECK(host_pbuf_used == 0);
+    return host_test_result("slip");
+}
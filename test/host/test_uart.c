@@ -0,0 +1,180 @@
+#include <string.h>
+
+#include "host_sdk.h"
+
+/*
+ * The RX and TX rings of driver/uart.c and its ISR against the UART model.
+ * Included, so the LOCAL buffers can be set up for the RX ring.
+ */
+#include "../../driver/uart.c"
+
+static uint8_t rx_got[1024];
+static uint16_t rx_got_len;
+
+static void
+rx_block(uint8 *data, uint16 len)
+{
+    memcpy(rx_got + rx_got_len, data, len);
+    rx_got_len += len;
+}
+
+static void
+rx_char(char c)
+{
+    rx_got[rx_got_len++] = c;
+}
+
+static void
+fill(uint8_t *d, uint16_t len, uint8_t start)
+{
+uint16_t i;
+
+    for (i = 0; i < len; i++)
+	d[i] = start + i * 7;
+}
+
+static void
+test_tx_ring(void)
+{
+static uint8_t data[UART_TX_BUFFER_SIZE + 1000];
+uint16_t i, n;
+bool same;
+
+    // wrap the ring at every offset of a 3000 byte write
+    for (i = 0; i < 3; i++) {
+	fill(data, 3000, i);
+	host_wire_clear();
+	CHECK(tx_buff_enq((char *)data, 3000) == 3000);
+	CHECK(tx_buff_space() == UART_TX_BUFFER_SIZE - 3000);
+	host_uart_tx_drain();
+	CHECK(host_wire_len == 3000);
+	CHECK(memcmp(host_wire, data, 3000) == 0);
+	CHECK(tx_buff_space() == UART_TX_BUFFER_SIZE);
+    }
+
+    // bulk writes of a whole packet
+    host_wire_clear();
+    same = true;
+    for (i = 0; i < 50; i++) {
+	n = 1 + i * 37 % 1500;
+	fill(data, n, i);
+	tx_buff_begin();
+	CHECK(tx_buff_space() >= n);
+	tx_buff_put(data, n);
+	tx_buff_commit();
+	host_uart_tx_drain();
+	same = same && host_wire_len == n && memcmp(host_wire, data, n) == 0;
+	host_wire_clear();
+    }
+    CHECK(same);
+
+    // an overlong write is cut and counted
+    router_stats.uart_tx_full = 0;
+    fill(data, sizeof(data), 0);
+    CHECK(tx_buff_enq((char *)data, sizeof(data)) == UART_TX_BUFFER_SIZE);
+    CHECK(router_stats.uart_tx_full == 1000);
+    CHECK(tx_buff_space() == 0);
+    host_uart_tx_drain();
+    CHECK(host_wire_len == UART_TX_BUFFER_SIZE);
+    CHECK(memcmp(host_wire, data, UART_TX_BUFFER_SIZE) == 0);
+}
+
+static void
+test_tx_notify(void)
+{
+static uint8_t data[2000];
+os_signal_t sig;
+
+    host_os_clear();
+    host_wire_clear();
+    tx_buff_enq((char *)data, sizeof(data));
+    tx_buff_notify(UART_TX_BUFFER_SIZE);
+
+    // one FIFO full is not enough
+    host_uart_isr(UART_TXFIFO_EMPTY_INT_ST);
+    CHECK(!host_os_take(&sig));
+
+    host_uart_tx_drain();
+    CHECK(host_os_take(&sig) && sig == UART0_TX_SIGNAL);
+    CHECK(!host_os_take(&sig));
+
+    // served only once
+    tx_buff_enq((char *)data, 10);
+    host_uart_tx_drain();
+    CHECK(!host_os_take(&sig));
+}
+
+static void
+test_rx_unload(void)
+{
+uint8_t data[300];
+os_signal_t sig;
+
+    fill(data, sizeof(data), 3);
+    host_os_clear();
+
+    // block unload: the whole FIFO in one call
+    uart0_unload_block_fn = rx_block;
+    rx_got_len = 0;
+    host_uart_rx(data, sizeof(data));
+    CHECK(rx_got_len == sizeof(data));
+    CHECK(memcmp(rx_got, data, sizeof(data)) == 0);
+    CHECK(host_os_take(&sig) && sig == UART0_SIGNAL);
+
+    // per char unload
+    uart0_unload_block_fn = NULL;
+    uart0_unload_fn = rx_char;
+    rx_got_len = 0;
+    host_uart_rx(data, 100);
+    CHECK(rx_got_len == 100);
+    CHECK(memcmp(rx_got, data, 100) == 0);
+    uart0_unload_fn = NULL;
+
+    // error counters
+    router_stats.uart_frm_err = router_stats.uart_rx_ovf = 0;
+    host_uart_isr(UART_FRM_ERR_INT_ST | UART_RXFIFO_OVF_INT_ST);
+    CHECK(router_stats.uart_frm_err == 1);
+    CHECK(router_stats.uart_rx_ovf == 1);
+}
+
+static void
+test_rx_ring(void)
+{
+uint8_t data[HOST_UART_FIFO_LEN], out[HOST_UART_FIFO_LEN];
+uint16_t n, i, got;
+bool same = true;
+
+    // the firmware runs without an RX ring (UART_RX_BUFFER_SIZE 0)
+    CHECK(rx_buff_deq((char *)out, sizeof(out)) == 0);
+
+    uart_buf_free(pRxBuffer);
+    pRxBuffer = Uart_Buf_Init(300);
+
+    for (i = 0; i < 40 && same; i++) {
+	n = 20 + i * 13 % 100;
+	fill(data, n, i);
+	host_uart_feed(data, n);
+	Uart_rx_buff_enq();
+	CHECK(pRxBuffer->Space == 300 - n);
+
+	// in two pieces, the first one may stop at the wrap
+	got = rx_buff_deq((char *)out, n / 3);
+	got += rx_buff_deq((char *)out + got, n - got);
+	same = got == n && memcmp(out, data, n) == 0;
+    }
+    CHECK(same);
+    CHECK(pRxBuffer->Space == 300);
+    CHECK(rx_buff_deq((char *)out, sizeof(out)) == 0);
+}
+
+int
+main(void)
+{
+    uart_init(BIT_RATE_115200);
+
+    test_tx_ring();
+    test_tx_notify();
+    test_rx_unload();
+    test_rx_ring();
+    return host_test_result("uart");
+}
@@ -0,0 +1,432 @@
+#include "c_types.h"
+#include "mem.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "lwip/opt.h"
+#include "lwip/ip.h"
+#include "lwip/netif.h"
+#include "lwip/app/espconn.h"
+
+#include "driver/slip.h"
+#include "router_stats.h"
+#include "bench.h"
+
+/*
+ * Benchmark of the router without the host TCP in the loop.
+ *
+ * Discard and echo sinks (UDP, and TCP with a hold of the receive side
+ * until the echo is sent) measure the stack of the ESP itself. The SLIP
+ * loopback takes over the input of the SLIP netif and sends every frame
+ * straight back through slip_output() with source and destination address
+ * swapped, so the host stack accepts the reflected packets. It measures
+ * the serial line, the UART driver and the SLIP codec alone.
+ *
+ * All modes report bytes/s and packets/s since the start and the delay
+ * between the last byte of a frame in the UART ISR and ip_input().
+ */
+
+static BENCH_MODE bench_mode;
+static const char *bench_mode_names[] = {"off", "discard", "echo", "loopback"};
+
+static struct netif *bench_slip_if;
+static netif_input_fn bench_slip_input;
+
+static struct espconn bench_udp_conn, bench_tcp_conn;
+static esp_udp bench_udp;
+static esp_tcp bench_tcp;
+
+static os_timer_t bench_timer;
+
+extern uint64_t Bytes_in, Bytes_out;
+extern uint32_t g_bit_rate;
+
+static struct {
+    BENCH_MODE  mode;           // Mode of the current or last run
+    uint32_t    start;          // system_get_time() of the start
+    uint32_t    stop;           // and of the end, 0 while running
+    uint32_t    bytes;          // Payload seen by the sink or the loopback
+    uint32_t    packets;
+    uint32_t    drops;          // Echos that could not be sent or buffered
+    uint64_t    serial_rx;      // Bytes_out, Bytes_in and the SLIP packet
+    uint64_t    serial_tx;      // counters at the start
+    uint32_t    slip_rx;
+    uint32_t    slip_tx;
+    uint32_t    lat_count;      // ISR to ip_input() delays
+    uint32_t    lat_sum;
+    uint32_t    lat_max;
+} bench;
+
+void ICACHE_FLASH_ATTR
+bench_rx_latency(uint32_t us)
+{
+    if (bench_mode == BENCH_OFF)
+	return;
+
+    bench.lat_count++;
+    bench.lat_sum += us;
+    if (us > bench.lat_max)
+	bench.lat_max = us;
+}
+
+static err_t ICACHE_FLASH_ATTR
+bench_loopback_input(struct pbuf *p, struct netif *inp)
+{
+struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+uint8_t addr[4];
+
+    bench.bytes += p->tot_len;
+    bench.packets++;
+
+    // swapping the addresses leaves all checksums valid
+    if (p->len >= IP_HLEN) {
+	os_memcpy(addr, &iphdr->src, 4);
+	os_memcpy(&iphdr->src, &iphdr->dest, 4);
+	os_memcpy(&iphdr->dest, addr, 4);
+    }
+
+    if (slip_output(inp, p, NULL) != ERR_OK)
+	bench.drops++;
+
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void ICACHE_FLASH_ATTR
+bench_udp_recv_cb(void *arg, char *data, unsigned short len)
+{
+struct espconn *pespconn = (struct espconn *)arg;
+remot_info *remote = NULL;
+
+    bench.bytes += len;
+    bench.packets++;
+
+    if (bench_mode != BENCH_ECHO)
+	return;
+
+    // reply to the sender of this datagram
+    if (espconn_get_connection_info(pespconn, &remote, 0) != ESPCONN_OK) {
+	bench.drops++;
+	return;
+    }
+    os_memcpy(pespconn->proto.udp->remote_ip, remote->remote_ip, 4);
+    pespconn->proto.udp->remote_port = remote->remote_port;
+    if (espconn_sent(pespconn, (uint8 *)data, len) != ESPCONN_OK)
+	bench.drops++;
+}
+
+/*
+ * TCP echo sessions. The received data is copied, espconn frees it after
+ * the recv callback, and sent in chunks of one MSS from the sent
+ * callback. The receive side is held until all of it is out, so the
+ * sender is throttled instead of losing data.
+ */
+#define BENCH_ECHO_SESSIONS     2
+#define BENCH_ECHO_RETRY_MS     10
+
+struct bench_echo {
+    struct espconn *conn;       // NULL if the slot is free
+    uint8_t     remote_ip[4];   // To find the session on disconnect
+    int         remote_port;
+
+    uint8_t     *buf;           // Received, not yet echoed data
+    uint16_t    len;
+    uint16_t    sent;           // Bytes of buf that are out
+    uint16_t    inflight;       // Bytes of the chunk given to espconn_sent()
+    bool        held;
+    os_timer_t  retry;          // Another try when espconn_sent() failed
+};
+
+static struct bench_echo bench_echo[BENCH_ECHO_SESSIONS];
+
+// The disconnect callback may get another espconn with the same remote
+static struct bench_echo * ICACHE_FLASH_ATTR
+bench_echo_find(struct espconn *pespconn)
+{
+int i;
+
+    for (i = 0; i < BENCH_ECHO_SESSIONS; i++) {
+	if (bench_echo[i].conn == pespconn)
+	    return &bench_echo[i];
+    }
+    for (i = 0; i < BENCH_ECHO_SESSIONS; i++) {
+	if (bench_echo[i].conn != NULL &&
+	    bench_echo[i].remote_port == pespconn->proto.tcp->remote_port &&
+	    os_memcmp(bench_echo[i].remote_ip, pespconn->proto.tcp->remote_ip, 4) == 0)
+	    return &bench_echo[i];
+    }
+    return NULL;
+}
+
+static void ICACHE_FLASH_ATTR
+bench_echo_send(struct bench_echo *e)
+{
+uint16_t chunk;
+
+    chunk = e->len - e->sent;
+    if (chunk == 0) {
+	// echo is out, accept the next segment
+	os_free(e->buf);
+	e->buf = NULL;
+	e->len = e->sent = 0;
+	if (e->held) {
+	    e->held = false;
+	    espconn_recv_unhold(e->conn);
+	}
+	return;
+    }
+
+    if (chunk > espconn_tcp_get_mss())
+	chunk = espconn_tcp_get_mss();
+    if (espconn_sent(e->conn, e->buf + e->sent, chunk) == ESPCONN_OK) {
+	e->inflight = chunk;
+	return;
+    }
+
+    // no sent callback will come, keep the receive side held and retry
+    os_timer_arm(&e->retry, BENCH_ECHO_RETRY_MS, 0);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_echo_retry_cb(void *arg)
+{
+struct bench_echo *e = (struct bench_echo *)arg;
+
+    if (e->conn != NULL)
+	bench_echo_send(e);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_echo_close(struct espconn *pespconn)
+{
+struct bench_echo *e = bench_echo_find(pespconn);
+
+    if (e == NULL)
+	return;
+    os_timer_disarm(&e->retry);
+    if (e->buf != NULL)
+	os_free(e->buf);
+    os_memset(e, 0, sizeof(struct bench_echo));
+}
+
+static void ICACHE_FLASH_ATTR
+bench_tcp_sent_cb(void *arg)
+{
+struct bench_echo *e = bench_echo_find((struct espconn *)arg);
+
+    if (e == NULL || e->inflight == 0)
+	return;
+    e->sent += e->inflight;
+    e->inflight = 0;
+    bench_echo_send(e);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_tcp_recv_cb(void *arg, char *data, unsigned short len)
+{
+struct bench_echo *e = bench_echo_find((struct espconn *)arg);
+uint8_t *buf;
+
+    bench.bytes += len;
+    bench.packets++;
+
+    if (bench_mode != BENCH_ECHO)
+	return;
+    if (e == NULL) {
+	bench.drops++;
+	return;
+    }
+
+    // append to what is still waiting, usually nothing as the receive
+    // side is held while an echo is on the way
+    buf = (uint8_t *)os_malloc(e->len - e->sent + len);
+    if (buf == NULL) {
+	bench.drops++;
+	return;
+    }
+    if (e->buf != NULL) {
+	os_memcpy(buf, e->buf + e->sent, e->len - e->sent);
+	os_free(e->buf);
+    }
+    os_memcpy(buf + e->len - e->sent, data, len);
+    e->buf = buf;
+    e->len = e->len - e->sent + len;
+    e->sent = 0;
+
+    if (!e->held) {
+	e->held = true;
+	espconn_recv_hold(e->conn);
+    }
+    if (e->inflight == 0)
+	bench_echo_send(e);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_tcp_discon_cb(void *arg)
+{
+    bench_echo_close((struct espconn *)arg);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_tcp_recon_cb(void *arg, sint8 err)
+{
+    bench_echo_close((struct espconn *)arg);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_tcp_connected_cb(void *arg)
+{
+struct espconn *pespconn = (struct espconn *)arg;
+int i;
+
+    // a connection without a session can be discarded, but not echoed
+    for (i = 0; bench_mode == BENCH_ECHO && i < BENCH_ECHO_SESSIONS; i++) {
+	if (bench_echo[i].conn == NULL) {
+	    bench_echo[i].conn = pespconn;
+	    os_memcpy(bench_echo[i].remote_ip, pespconn->proto.tcp->remote_ip, 4);
+	    bench_echo[i].remote_port = pespconn->proto.tcp->remote_port;
+	    os_timer_setfn(&bench_echo[i].retry, bench_echo_retry_cb, &bench_echo[i]);
+	    break;
+	}
+    }
+    espconn_regist_recvcb(pespconn, bench_tcp_recv_cb);
+    espconn_regist_sentcb(pespconn, bench_tcp_sent_cb);
+    espconn_regist_disconcb(pespconn, bench_tcp_discon_cb);
+    espconn_regist_reconcb(pespconn, bench_tcp_recon_cb);
+    espconn_regist_time(pespconn, 60, 1);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_sinks_start(uint16_t port)
+{
+    bench_udp_conn.type = ESPCONN_UDP;
+    bench_udp_conn.state = ESPCONN_NONE;
+    bench_udp_conn.proto.udp = &bench_udp;
+    os_memset(&bench_udp, 0, sizeof(bench_udp));
+    bench_udp.local_port = port;
+    espconn_regist_recvcb(&bench_udp_conn, bench_udp_recv_cb);
+    espconn_create(&bench_udp_conn);
+
+    bench_tcp_conn.type = ESPCONN_TCP;
+    bench_tcp_conn.state = ESPCONN_NONE;
+    bench_tcp_conn.proto.tcp = &bench_tcp;
+    os_memset(&bench_tcp, 0, sizeof(bench_tcp));
+    bench_tcp.local_port = port;
+    espconn_regist_connectcb(&bench_tcp_conn, bench_tcp_connected_cb);
+    espconn_accept(&bench_tcp_conn);
+}
+
+static void ICACHE_FLASH_ATTR
+bench_timer_cb(void *arg)
+{
+    bench_stop();
+}
+
+void ICACHE_FLASH_ATTR
+bench_init(struct netif *slip_if)
+{
+    bench_slip_if = slip_if;
+}
+
+bool ICACHE_FLASH_ATTR
+bench_start(BENCH_MODE mode, uint32_t secs)
+{
+    if (mode == BENCH_OFF || (mode == BENCH_LOOPBACK && bench_slip_if == NULL))
+	return false;
+
+    bench_stop();
+
+    os_memset(&bench, 0, sizeof(bench));
+    bench.serial_rx = Bytes_out;
+    bench.serial_tx = Bytes_in;
+    bench.slip_rx = router_stats.slip_rx_packets;
+    bench.slip_tx = router_stats.slip_tx_packets;
+    bench.start = system_get_time();
+    bench.mode = bench_mode = mode;
+
+    switch (mode) {
+    case BENCH_DISCARD:
+	bench_sinks_start(BENCH_DISCARD_PORT);
+	break;
+    case BENCH_ECHO:
+	bench_sinks_start(BENCH_ECHO_PORT);
+	break;
+    case BENCH_LOOPBACK:
+	bench_slip_input = bench_slip_if->input;
+	bench_slip_if->input = bench_loopback_input;
+
+	os_timer_disarm(&bench_timer);
+	os_timer_setfn(&bench_timer, bench_timer_cb, NULL);
+	os_timer_arm(&bench_timer, (secs ? secs : BENCH_LOOPBACK_SECS) * 1000, 0);
+	break;
+    default:
+	break;
+    }
+    return true;
+}
+
+void ICACHE_FLASH_ATTR
+bench_stop(void)
+{
+    switch (bench_mode) {
+    case BENCH_DISCARD:
+    case BENCH_ECHO:
+	espconn_delete(&bench_udp_conn);
+	espconn_delete(&bench_tcp_conn);
+	break;
+    case BENCH_LOOPBACK:
+	os_timer_disarm(&bench_timer);
+	bench_slip_if->input = bench_slip_input;
+	break;
+    default:
+	return;
+    }
+
+    bench.stop = system_get_time();
+    bench_mode = BENCH_OFF;
+}
+
+// Events per second over ms milliseconds
+static uint32_t ICACHE_FLASH_ATTR
+bench_rate(uint64_t count, uint32_t ms)
+{
+    return ms ? (uint32_t)(count * 1000 / ms) : 0;
+}
+
+void ICACHE_FLASH_ATTR
+bench_report(ringbuf_t rb)
+{
+char response[128];
+uint32_t ms, serial_rx, serial_tx, slip_rx, slip_tx;
+
+    if (bench.mode == BENCH_OFF) {
+	os_sprintf(response, "No benchmark run\r\n");
+	ringbuf_memcpy_into(rb, response, os_strlen(response));
+	return;
+    }
+
+    ms = ((bench.stop ? bench.stop : system_get_time()) - bench.start) / 1000;
+    serial_rx = (uint32_t)(Bytes_out - bench.serial_rx);
+    serial_tx = (uint32_t)(Bytes_in - bench.serial_tx);
+    slip_rx = router_stats.slip_rx_packets - bench.slip_rx;
+    slip_tx = router_stats.slip_tx_packets - bench.slip_tx;
+
+    os_sprintf(response, "Bench %s%s: %d.%03d s at %d MHz %d bit/s\r\n",
+	bench_mode_names[bench.mode], bench.stop ? " (done)" : "",
+	ms / 1000, ms % 1000, system_get_cpu_freq(), g_bit_rate);
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+
+    os_sprintf(response, "Sink: %d bytes %d packets %d drops, %d B/s %d pkt/s\r\n",
+	bench.bytes, bench.packets, bench.drops,
+	bench_rate(bench.bytes, ms), bench_rate(bench.packets, ms));
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+
+    os_sprintf(response, "Serial rx: %d B/s %d pkt/s tx: %d B/s %d pkt/s\r\n",
+	bench_rate(serial_rx, ms), bench_rate(slip_rx, ms),
+	bench_rate(serial_tx, ms), bench_rate(slip_tx, ms));
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+
+    os_sprintf(response, "ISR to ip_input: %d us avg %d us max (%d packets)\r\n",
+	bench.lat_count ? bench.lat_sum / bench.lat_count : 0, bench.lat_max, bench.lat_count);
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+}
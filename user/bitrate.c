@@ -0,0 +1,206 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+
+#include "driver/uart.h"
+#include "driver/slip.h"
+#include "router_stats.h"
+#include "bitrate.h"
+
+/*
+ * Live switch of the serial bit rate without a reboot.
+ *
+ * The switch waits until the UART TX buffer and FIFO are empty (or
+ * BITRATE_DRAIN_MS passed), sets the new divisor and then waits for the
+ * host to follow: the first SLIP frame with a valid IPv4 header at the
+ * new rate confirms it. Without one within the confirm time the old rate
+ * is restored, so a wrong setting never cuts the link for good.
+ *
+ * Autobaud runs a switch to each candidate rate in turn and counts frames
+ * and errors for a while at each. The host steps through the same list
+ * and falls back as soon as a rate drops packets, so both ends stop at
+ * the last rate that was clean.
+ */
+
+extern uint32_t g_bit_rate;
+
+static BITRATE_STATE bitrate_st;
+static uint32_t bitrate_old, bitrate_new;
+static uint32_t bitrate_confirm_ms;
+static uint32_t bitrate_start;      // system_get_time() of the current phase
+static uint32_t bitrate_valid_base;
+static bitrate_done_fn bitrate_done;
+
+static os_timer_t bitrate_timer;
+
+static const uint32_t autobaud_rates[] = BITRATE_AUTOBAUD_RATES;
+#define AUTOBAUD_STEPS  (sizeof(autobaud_rates)/sizeof(autobaud_rates[0]))
+
+static int8_t autobaud_step = -1;   // index into autobaud_rates, -1 if off
+static uint32_t autobaud_best;      // fastest clean rate so far, 0 if none
+static uint32_t autobaud_start;     // rate before the probing, if none is clean
+static uint32_t autobaud_err_base, autobaud_valid_base;
+static bitrate_done_fn autobaud_done;
+
+static os_timer_t autobaud_timer;
+
+static void ICACHE_FLASH_ATTR
+bitrate_set(uint32_t rate)
+{
+    UART_SetBaudrate(UART0, rate);
+    g_bit_rate = rate;
+}
+
+static void ICACHE_FLASH_ATTR
+bitrate_finish(bool confirmed)
+{
+    os_timer_disarm(&bitrate_timer);
+    slip_rx_verify = false;
+
+    if (!confirmed)
+	bitrate_set(bitrate_old);
+    os_printf("Bit rate %d %s\r\n", bitrate_new, confirmed ? "confirmed" : "failed, back to old rate");
+
+    bitrate_st = BITRATE_IDLE;
+    if (bitrate_done != NULL)
+	bitrate_done(bitrate_new, confirmed);
+}
+
+static void ICACHE_FLASH_ATTR
+bitrate_poll(void *arg)
+{
+uint32_t ms = (system_get_time() - bitrate_start) / 1000;
+
+    switch (bitrate_st) {
+    case BITRATE_DRAIN:
+	if (ms < BITRATE_SETTLE_MS)
+	    return;
+	if (!UART_CheckOutputFinished(UART0, 0) && ms < BITRATE_SETTLE_MS + BITRATE_DRAIN_MS)
+	    return;
+
+	bitrate_set(bitrate_new);
+	bitrate_valid_base = slip_rx_valid;
+	slip_rx_verify = true;
+	bitrate_start = system_get_time();
+	bitrate_st = BITRATE_CONFIRM;
+	break;
+
+    case BITRATE_CONFIRM:
+	if (slip_rx_valid != bitrate_valid_base)
+	    bitrate_finish(true);
+	else if (ms >= bitrate_confirm_ms)
+	    bitrate_finish(false);
+	break;
+
+    default:
+	os_timer_disarm(&bitrate_timer);
+	break;
+    }
+}
+
+bool ICACHE_FLASH_ATTR
+bitrate_switch(uint32_t rate, uint32_t confirm_ms, bitrate_done_fn done)
+{
+    if (bitrate_st != BITRATE_IDLE || rate < BITRATE_MIN || rate > BITRATE_MAX)
+	return false;
+
+    bitrate_old = g_bit_rate;
+    bitrate_new = rate;
+    bitrate_confirm_ms = confirm_ms ? confirm_ms : BITRATE_CONFIRM_MS;
+    bitrate_done = done;
+    bitrate_st = BITRATE_DRAIN;
+    bitrate_start = system_get_time();
+
+    os_timer_disarm(&bitrate_timer);
+    os_timer_setfn(&bitrate_timer, bitrate_poll, NULL);
+    os_timer_arm(&bitrate_timer, BITRATE_POLL_MS, 1);
+    return true;
+}
+
+BITRATE_STATE ICACHE_FLASH_ATTR
+bitrate_state(void)
+{
+    return bitrate_st;
+}
+
+uint32_t ICACHE_FLASH_ATTR
+bitrate_pending(void)
+{
+    return bitrate_st != BITRATE_IDLE ? bitrate_new : g_bit_rate;
+}
+
+static void ICACHE_FLASH_ATTR
+autobaud_end(void)
+{
+    autobaud_step = -1;
+    os_printf("Autobaud done at %d\r\n", g_bit_rate);
+    if (autobaud_done != NULL)
+	autobaud_done(g_bit_rate, autobaud_best != 0);
+}
+
+static void ICACHE_FLASH_ATTR autobaud_switch_done(uint32_t rate, bool confirmed);
+
+static void ICACHE_FLASH_ATTR
+autobaud_probe_end(void *arg)
+{
+uint32_t errors = router_stats.uart_frm_err + router_stats.slip_rx_errors - autobaud_err_base;
+uint32_t valid = slip_rx_valid - autobaud_valid_base;
+
+    slip_rx_verify = false;
+    os_printf("Autobaud %d: %d frames %d errors\r\n", g_bit_rate, valid, errors);
+
+    if (valid < BITRATE_PROBE_FRAMES || errors != 0) {
+	// back to the last clean rate right away, there is nothing to drain
+	// here that could be delivered
+	bitrate_set(autobaud_best != 0 ? autobaud_best : autobaud_start);
+	autobaud_end();
+	return;
+    }
+
+    autobaud_best = g_bit_rate;
+    if (++autobaud_step >= AUTOBAUD_STEPS ||
+	!bitrate_switch(autobaud_rates[autobaud_step], 0, autobaud_switch_done))
+	autobaud_end();
+}
+
+static void ICACHE_FLASH_ATTR
+autobaud_switch_done(uint32_t rate, bool confirmed)
+{
+    if (!confirmed) {
+	// the host did not follow, bitrate_finish() is back at the last rate
+	autobaud_end();
+	return;
+    }
+
+    autobaud_err_base = router_stats.uart_frm_err + router_stats.slip_rx_errors;
+    autobaud_valid_base = slip_rx_valid;
+    slip_rx_verify = true;
+
+    os_timer_disarm(&autobaud_timer);
+    os_timer_setfn(&autobaud_timer, autobaud_probe_end, NULL);
+    os_timer_arm(&autobaud_timer, BITRATE_PROBE_MS, 0);
+}
+
+bool ICACHE_FLASH_ATTR
+bitrate_autobaud(bitrate_done_fn done)
+{
+    if (autobaud_step >= 0 || bitrate_st != BITRATE_IDLE)
+	return false;
+
+    autobaud_step = 0;
+    autobaud_best = 0;
+    autobaud_start = g_bit_rate;
+    autobaud_done = done;
+    if (!bitrate_switch(autobaud_rates[0], 0, autobaud_switch_done)) {
+	autobaud_step = -1;
+	return false;
+    }
+    return true;
+}
+
+bool ICACHE_FLASH_ATTR
+bitrate_autobaud_running(void)
+{
+    return autobaud_step >= 0;
+}
@@ -1,5 +1,9 @@
+#include <stddef.h>
 #include "user_interface.h"
+#include "lwip/ip.h"
+#include "lwip/lwip_napt.h"
 #include "config_flash.h"
+#include "flash_log.h"
 
 
 /*     From the document 99A-SDK-Espressif IOT Flash RW Operation_v0.2      *
@@ -33,16 +37,86 @@ void config_load_default(sysconfig_p config)
     IP4_ADDR(&config->ip_addr_peer, 192, 168, 240, 2);
     config->clock_speed			= 160;
     config->bit_rate                    = 115200;
+    config->flow_control                = 0;
+
+    config->nat_entries                 = IP_NAPT_MAX;
+    config->portmap_entries             = IP_PORTMAP_MAX;
+    config->tcp_timeout                 = 0;
+    config->udp_timeout                 = 0;
+
+    config->metrics_interval            = 0;
+    config->metrics_collector.addr      = 0;
+    config->metrics_port                = METRICS_UDP_PORT;
+
+    config->mss_clamp                   = 0;
+    config->cslip                       = 0;
+    config->compress                    = 0;
+    config->qos                         = 1;
+    IP4_ADDR(&config->slip2_addr, 192, 168, 241, 1);
+    config->slip2_nat                   = 1;
+}
+
+/*
+ * Config and blobs are records of the flash log (flash_log.c) in the
+ * sectors FLASH_BLOCK_NO and FLASH_BLOCK_NO + 1. Before, the config was a
+ * plain copy at the start of FLASH_BLOCK_NO and blob n filled sector
+ * FLASH_BLOCK_NO + 1 + n. Such a config and the portmap table are taken
+ * over once: the table is read into RAM, as the first log sector is built
+ * in FLASH_BLOCK_NO + 1. The old config stays in FLASH_BLOCK_NO and is
+ * found again on the next boot until the header of the new sector is
+ * written, so a power loss on the way does not lose it.
+ *
+ * The old layout ended with bit_rate, the fields from flow_control on were
+ * added with the log. Such a config is taken over up to its length and
+ * the newer fields get their defaults. Its portmap blob always had
+ * IP_PORTMAP_MAX entries.
+ */
+#define SYSCONFIG_OLD_LENGTH (offsetof(sysconfig_t, bit_rate) + sizeof(uint32_t))
+
+static uint32_t * ICACHE_FLASH_ATTR config_read_old_portmap(uint16_t *len)
+{
+    uint32_t *buf;
+
+    *len = sizeof(struct portmap_table) * IP_PORTMAP_MAX;
+    if ((buf = (uint32_t *)os_malloc(*len)) != NULL)
+	spi_flash_read((FLASH_BLOCK_NO + 1) * SPI_FLASH_SEC_SIZE, buf, *len);
+    return buf;
 }
 
 int config_load(sysconfig_p config)
 {
     if (config == NULL) return -1;
-    uint16_t base_address = FLASH_BLOCK_NO;
 
-    spi_flash_read(base_address* SPI_FLASH_SEC_SIZE, &config->magic_number, 4);
+    if (!flash_log_init())
+    {
+        spi_flash_read(FLASH_BLOCK_NO * SPI_FLASH_SEC_SIZE, (uint32 *) config, sizeof(sysconfig_t));
+        if (config->magic_number == MAGIC_NUMBER &&
+            config->length >= SYSCONFIG_OLD_LENGTH && config->length <= sizeof(sysconfig_t))
+        {
+            uint32_t *portmap;
+            uint16_t len = config->length & ~3;     // whole words for spi_flash_read
+
+            os_printf("\r\nConfig of the old flash layout found, converting\r\n");
+            config_load_default(config);
+            spi_flash_read(FLASH_BLOCK_NO * SPI_FLASH_SEC_SIZE, (uint32 *) config, len);
+            config->length = sizeof(sysconfig_t);
+
+            portmap = config_read_old_portmap(&len);
+            config_save(config);
+            if (portmap != NULL) {
+                blob_save(0, portmap, len);
+                os_free(portmap);
+            }
+            return 0;
+        }
+        os_printf("\r\nNo config found, saving default in flash\r\n");
+        config_load_default(config);
+        config_save(config);
+        return -1;
+    }
 
-    if((config->magic_number != MAGIC_NUMBER))
+    if (flash_log_read(FLASH_LOG_CONFIG, (uint32 *) config, sizeof(sysconfig_t)) == 0 ||
+        config->magic_number != MAGIC_NUMBER)
     {
         os_printf("\r\nNo config found, saving default in flash\r\n");
         config_load_default(config);
@@ -51,7 +125,6 @@ int config_load(sysconfig_p config)
     }
 
     os_printf("\r\nConfig found and loaded\r\n");
-    spi_flash_read(base_address * SPI_FLASH_SEC_SIZE, (uint32 *) config, sizeof(sysconfig_t));
     if (config->length != sizeof(sysconfig_t))
     {
         os_printf("Length Mismatch, probably old version of config, loading defaults\r\n");
@@ -62,35 +135,46 @@ int config_load(sysconfig_p config)
     return 0;
 }
 
-void config_save(sysconfig_p config)
+bool config_save(sysconfig_p config)
 {
-    uint16_t base_address = FLASH_BLOCK_NO;
     os_printf("Saving configuration\r\n");
-    spi_flash_erase_sector(base_address);
-    spi_flash_write(base_address * SPI_FLASH_SEC_SIZE, (uint32 *)config, sizeof(sysconfig_t));
+    return flash_log_write(FLASH_LOG_CONFIG, (uint32 *)config, sizeof(sysconfig_t));
+}
+
+/*
+ * Changes only the bit rate of the stored config, edits of the config in
+ * RAM that are not saved yet stay that way
+ */
+bool ICACHE_FLASH_ATTR config_save_bit_rate(uint32_t bit_rate)
+{
+    sysconfig_p stored = (sysconfig_p)os_malloc(sizeof(sysconfig_t));
+    bool ok = false;
+
+    if (stored == NULL)
+	return false;
+    if (flash_log_read(FLASH_LOG_CONFIG, (uint32 *)stored, sizeof(sysconfig_t)) == sizeof(sysconfig_t) &&
+	stored->magic_number == MAGIC_NUMBER && stored->length == sizeof(sysconfig_t)) {
+	stored->bit_rate = bit_rate;
+	ok = config_save(stored);
+    }
+    os_free(stored);
+    return ok;
 }
 
-void ICACHE_FLASH_ATTR blob_save(uint8_t blob_no, uint32_t *data, uint16_t len)
+bool ICACHE_FLASH_ATTR blob_save(uint8_t blob_no, uint32_t *data, uint16_t len)
 {
-    uint16_t base_address = FLASH_BLOCK_NO + 1 + blob_no;
-    spi_flash_erase_sector(base_address);
-    spi_flash_write(base_address * SPI_FLASH_SEC_SIZE, data, len);
+    return flash_log_write(FLASH_LOG_BLOB + blob_no, data, len);
 }
 
 void ICACHE_FLASH_ATTR blob_load(uint8_t blob_no, uint32_t *data, uint16_t len)
 {
-    uint16_t base_address = FLASH_BLOCK_NO + 1 + blob_no;
-    spi_flash_read(base_address * SPI_FLASH_SEC_SIZE, data, len);
+    flash_log_read(FLASH_LOG_BLOB + blob_no, data, len);
 }
 
-void ICACHE_FLASH_ATTR blob_zero(uint8_t blob_no, uint16_t len)
+bool ICACHE_FLASH_ATTR blob_zero(uint8_t blob_no, uint16_t len)
 {
-int i;
-    uint8_t z[len];
-    os_memset(z, 0,len);
-    uint16_t base_address = FLASH_BLOCK_NO + 1 + blob_no;
-    spi_flash_erase_sector(base_address);
-    spi_flash_write(base_address * SPI_FLASH_SEC_SIZE, (uint32_t *)z, len);
+    // a zeroed blob reads the same as none
+    return flash_log_write(FLASH_LOG_BLOB + blob_no, NULL, 0);
 }
 
 const uint8_t esp_init_data_default[] = {
@@ -0,0 +1,551 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "lwip/opt.h"
+#include "lwip/ip.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/netif.h"
+#include "netif/etharp.h"
+
+#include "fastpath.h"
+#include "trace.h"
+
+/*
+ * Fast path for established TCP flows between the SLIP side and the STA.
+ *
+ * The NAPT of the lwip lib is not touched: the first packet of a flow (and
+ * one packet per FASTPATH_REVALIDATE_US) takes the normal ip_input() path.
+ * The output of the egress netif is hooked, so when the same pbuf comes out
+ * there, we see the result of routing and NAPT and can cache it. Further
+ * packets of the flow get the cached rewrite and go straight to the output
+ * of the egress netif. Replies are matched on the mapped address and port
+ * and get the reverse rewrite on their way to the SLIP netif.
+ *
+ * Flows are found with two open addressing hash indices (linear probing,
+ * backward shift on removal), one keyed on the original 5-tuple, one on
+ * the mapped one. Both are updated when a flow is learned or expired.
+ *
+ * SYN, FIN and RST always take the slow path, so the NAPT of the lib keeps
+ * seeing the state changes of the connection.
+ */
+
+struct fastpath_stats fastpath_stats;
+
+static struct fastpath_flow fp_flows[FASTPATH_FLOWS];
+
+// Hash indices, flow number + 1, 0 is an empty slot
+static uint8_t fp_out_idx[FASTPATH_HASH_SIZE];
+static uint8_t fp_in_idx[FASTPATH_HASH_SIZE];
+
+static struct netif *fp_slip_if;
+static netif_input_fn fp_slip_input;
+static netif_output_fn fp_slip_output;
+
+static struct {
+    struct netif    *nif;
+    netif_input_fn  input;
+    netif_output_fn output;
+} fp_hooks[2];
+
+// The packet currently on the slow path that we want to learn from
+static struct pbuf *fp_pending_p;
+static struct fastpath_flow fp_pending_key;
+static bool fp_pending_done;
+
+// The inbound packet currently on the slow path
+static struct pbuf *fp_pending_in_p;
+static bool fp_pending_in_done;
+
+typedef uint16_t (*fp_hash_fn)(struct fastpath_flow *f);
+
+/*
+ * Header fields are accessed as 16 bit words only,
+ * lwip guarantees no better alignment for the payload.
+ */
+static uint32_t ICACHE_FLASH_ATTR
+fp_get_addr(void *a)
+{
+union { uint32_t u32; uint16_t u16[2]; } v;
+
+    v.u16[0] = ((uint16_t *)a)[0];
+    v.u16[1] = ((uint16_t *)a)[1];
+    return v.u32;
+}
+
+static void ICACHE_FLASH_ATTR
+fp_set_addr(void *a, uint32_t addr)
+{
+union { uint32_t u32; uint16_t u16[2]; } v;
+
+    v.u32 = addr;
+    ((uint16_t *)a)[0] = v.u16[0];
+    ((uint16_t *)a)[1] = v.u16[1];
+}
+
+/*
+ * Incremental checksum update (RFC 1624): the delta of a rewrite is the
+ * one's complement sum of ~old + new over all changed words.
+ */
+static uint16_t ICACHE_FLASH_ATTR
+fp_csum_fold(uint32_t sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+static uint32_t ICACHE_FLASH_ATTR
+fp_csum_diff32(uint32_t old, uint32_t new)
+{
+    return (~old & 0xffff) + (~old >> 16) + (new & 0xffff) + (new >> 16);
+}
+
+static uint16_t ICACHE_FLASH_ATTR
+fp_csum_apply(uint16_t csum, uint32_t adj)
+{
+    return ~fp_csum_fold((~csum & 0xffff) + adj);
+}
+
+/*
+ * Hashing of the two directions
+ */
+static uint16_t ICACHE_FLASH_ATTR
+fp_hash(uint32_t a1, uint32_t a2, uint16_t p1, uint16_t p2, uint8_t proto)
+{
+uint32_t h = a1 ^ (a2 * 0x9e3779b1) ^ (((uint32_t)p1 << 16) | p2) ^ proto;
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (FASTPATH_HASH_SIZE - 1);
+}
+
+static uint16_t ICACHE_FLASH_ATTR
+fp_out_hash(struct fastpath_flow *f)
+{
+    return fp_hash(f->src, f->dst, f->sport, f->dport, f->proto);
+}
+
+static uint16_t ICACHE_FLASH_ATTR
+fp_in_hash(struct fastpath_flow *f)
+{
+    return fp_hash(f->dst, f->nat_src, f->dport, f->nat_sport, f->proto);
+}
+
+static void ICACHE_FLASH_ATTR
+fp_index_insert(uint8_t *idx, fp_hash_fn hash, struct fastpath_flow *f)
+{
+uint16_t i = hash(f);
+
+    while (idx[i] != 0)
+	i = (i + 1) & (FASTPATH_HASH_SIZE - 1);
+    idx[i] = (f - fp_flows) + 1;
+}
+
+static void ICACHE_FLASH_ATTR
+fp_index_remove(uint8_t *idx, fp_hash_fn hash, struct fastpath_flow *f)
+{
+uint16_t i, j, k;
+uint8_t n = (f - fp_flows) + 1;
+
+    for (i = hash(f); idx[i] != n; i = (i + 1) & (FASTPATH_HASH_SIZE - 1))
+	if (idx[i] == 0) return;
+
+    // Backward shift: move up entries whose probe sequence passes the hole
+    idx[i] = 0;
+    for (j = (i + 1) & (FASTPATH_HASH_SIZE - 1); idx[j] != 0; j = (j + 1) & (FASTPATH_HASH_SIZE - 1)) {
+	k = hash(&fp_flows[idx[j] - 1]);
+	if (((j - k) & (FASTPATH_HASH_SIZE - 1)) >= ((j - i) & (FASTPATH_HASH_SIZE - 1))) {
+	    idx[i] = idx[j];
+	    idx[j] = 0;
+	    i = j;
+	}
+    }
+}
+
+static void ICACHE_FLASH_ATTR
+fp_remove(struct fastpath_flow *f)
+{
+    if (!f->valid) return;
+    fp_index_remove(fp_out_idx, fp_out_hash, f);
+    fp_index_remove(fp_in_idx, fp_in_hash, f);
+    f->valid = 0;
+}
+
+static struct fastpath_flow * ICACHE_FLASH_ATTR
+fp_find(struct fastpath_flow *key)
+{
+uint16_t i;
+struct fastpath_flow *f;
+
+    for (i = fp_out_hash(key); fp_out_idx[i] != 0; i = (i + 1) & (FASTPATH_HASH_SIZE - 1)) {
+	f = &fp_flows[fp_out_idx[i] - 1];
+	if (f->sport == key->sport && f->dport == key->dport &&
+	    f->src == key->src && f->dst == key->dst && f->proto == key->proto)
+	    return f;
+    }
+    return NULL;
+}
+
+/*
+ * key holds the inbound packet: src/sport remote, dst/dport mapped
+ */
+static struct fastpath_flow * ICACHE_FLASH_ATTR
+fp_find_in(struct fastpath_flow *key)
+{
+uint16_t i;
+struct fastpath_flow *f;
+
+    for (i = fp_hash(key->src, key->dst, key->sport, key->dport, key->proto);
+	 fp_in_idx[i] != 0; i = (i + 1) & (FASTPATH_HASH_SIZE - 1)) {
+	f = &fp_flows[fp_in_idx[i] - 1];
+	if (f->nat_sport == key->dport && f->dport == key->sport &&
+	    f->nat_src == key->dst && f->dst == key->src && f->proto == key->proto)
+	    return f;
+    }
+    return NULL;
+}
+
+static int ICACHE_FLASH_ATTR
+fp_hook_no(struct netif *nif)
+{
+int i;
+
+    for (i = 0; i < sizeof(fp_hooks)/sizeof(fp_hooks[0]); i++) {
+	if (fp_hooks[i].nif == nif)
+	    return i;
+    }
+    return -1;
+}
+
+/*
+ * Checks, whether iphdr is an unfragmented IPv4/TCP packet without
+ * options that the fast path can handle and fills the key.
+ */
+static bool ICACHE_FLASH_ATTR
+fp_classify(struct ip_hdr *iphdr, u16_t len, u16_t tot_len, struct fastpath_flow *key)
+{
+struct tcp_hdr *tcphdr;
+
+    if (len < IP_HLEN + TCP_HLEN)
+	return false;
+    if (IPH_V(iphdr) != 4 || IPH_HL(iphdr) != IP_HLEN / 4)
+	return false;
+    if ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0)
+	return false;
+    if (IPH_PROTO(iphdr) != IP_PROTO_TCP)
+	return false;
+    if (ntohs(IPH_LEN(iphdr)) > tot_len)
+	return false;
+
+    tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + IP_HLEN);
+    key->proto = IP_PROTO_TCP;
+    key->src = fp_get_addr(&iphdr->src);
+    key->dst = fp_get_addr(&iphdr->dest);
+    key->sport = tcphdr->src;
+    key->dport = tcphdr->dest;
+    return true;
+}
+
+/*
+ * Records the result of routing and NAPT for the pending packet
+ */
+static void ICACHE_FLASH_ATTR
+fp_learn(struct netif *nif, struct pbuf *p)
+{
+struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+struct tcp_hdr *tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + IP_HLEN);
+struct fastpath_flow *f, *lru;
+uint32_t now = system_get_time();
+int i;
+
+    if (p->len < IP_HLEN + TCP_HLEN || IPH_HL(iphdr) != IP_HLEN / 4)
+	return;
+    // outbound NAPT only rewrites the source
+    if (fp_get_addr(&iphdr->dest) != fp_pending_key.dst || tcphdr->dest != fp_pending_key.dport)
+	return;
+
+    f = fp_find(&fp_pending_key);
+    if (f == NULL) {
+	// expire idle flows, take a free slot or the least recently used one
+	lru = &fp_flows[0];
+	for (i = 0; i < FASTPATH_FLOWS; i++) {
+	    if (fp_flows[i].valid && now - fp_flows[i].last_used >= FASTPATH_IDLE_US)
+		fp_remove(&fp_flows[i]);
+	    if (!fp_flows[i].valid) {
+		if (f == NULL) f = &fp_flows[i];
+	    } else if ((int32_t)(fp_flows[i].last_used - lru->last_used) < 0) {
+		lru = &fp_flows[i];
+	    }
+	}
+	if (f == NULL) {
+	    f = lru;
+	    fp_remove(f);
+	}
+	*f = fp_pending_key;
+	f->last_used = now;
+	fastpath_stats.learned++;
+    } else {
+	// the mapping may have changed, re-enter it into the inbound index
+	fp_index_remove(fp_in_idx, fp_in_hash, f);
+	fp_index_remove(fp_out_idx, fp_out_hash, f);
+    }
+
+    f->out = nif;
+    f->nat_src = fp_get_addr(&iphdr->src);
+    f->nat_sport = tcphdr->src;
+    f->ip_adj = fp_csum_fold(fp_csum_diff32(f->src, f->nat_src));
+    f->l4_adj = fp_csum_fold(f->ip_adj + (~f->sport & 0xffff) + f->nat_sport);
+    f->in_ip_adj = fp_csum_fold(fp_csum_diff32(f->nat_src, f->src));
+    f->in_l4_adj = fp_csum_fold(f->in_ip_adj + (~f->nat_sport & 0xffff) + f->sport);
+    f->last_check = f->last_check_in = now;
+    f->valid = 1;
+
+    fp_index_insert(fp_out_idx, fp_out_hash, f);
+    fp_index_insert(fp_in_idx, fp_in_hash, f);
+}
+
+/*
+ * Common checks before a packet takes the fast path
+ */
+static bool ICACHE_FLASH_ATTR
+fp_can_forward(struct ip_hdr *iphdr, struct netif *out)
+{
+    if (IPH_TTL(iphdr) <= 1 || !netif_is_up(out))
+	return false;
+    if (out->mtu != 0 && ntohs(IPH_LEN(iphdr)) > out->mtu)
+	return false;
+    if (inet_chksum(iphdr, IP_HLEN) != 0)
+	return false;
+    return true;
+}
+
+/*
+ * Rewrites one address/port pair, decrements the TTL and fixes both checksums
+ */
+static void ICACHE_FLASH_ATTR
+fp_rewrite(struct ip_hdr *iphdr, void *addr, uint32_t new_addr, void *port, uint16_t new_port,
+	   uint16_t ip_adj, uint16_t l4_adj)
+{
+struct tcp_hdr *tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + IP_HLEN);
+uint16_t old_ttl_proto;
+
+    old_ttl_proto = iphdr->_ttl_proto;
+    IPH_TTL_SET(iphdr, IPH_TTL(iphdr) - 1);
+    fp_set_addr(addr, new_addr);
+    IPH_CHKSUM_SET(iphdr, fp_csum_apply(IPH_CHKSUM(iphdr),
+	ip_adj + (~old_ttl_proto & 0xffff) + iphdr->_ttl_proto));
+
+    *(uint16_t *)port = new_port;
+    tcphdr->chksum = fp_csum_apply(tcphdr->chksum, l4_adj);
+}
+
+/*
+ * Forwards a packet of a cached flow to the egress netif,
+ * returns false if the slow path has to do it
+ */
+static bool ICACHE_FLASH_ATTR
+fp_forward(struct fastpath_flow *f, struct pbuf *p, uint32_t now)
+{
+struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+struct tcp_hdr *tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + IP_HLEN);
+ip_addr_t dest;
+int hook;
+
+    if (now - f->last_check >= FASTPATH_REVALIDATE_US)
+	return false;
+    if (!fp_can_forward(iphdr, f->out) || (hook = fp_hook_no(f->out)) < 0)
+	return false;
+
+    fp_rewrite(iphdr, &iphdr->src, f->nat_src, &tcphdr->src, f->nat_sport, f->ip_adj, f->l4_adj);
+
+    f->last_used = now;
+    fastpath_stats.hits++;
+    TRACE(TRACE_FP_OUT, p->tot_len);
+
+    ip_addr_copy(dest, iphdr->dest);
+    fp_hooks[hook].output(f->out, p, &dest);
+    return true;
+}
+
+/*
+ * Input function of the SLIP netif
+ */
+static err_t ICACHE_FLASH_ATTR
+fastpath_input(struct pbuf *p, struct netif *inp)
+{
+struct fastpath_flow key, *f;
+struct tcp_hdr *tcphdr;
+err_t ret;
+
+    if (!fp_classify((struct ip_hdr *)p->payload, p->len, p->tot_len, &key))
+	return fp_slip_input(p, inp);
+
+    f = fp_find(&key);
+    tcphdr = (struct tcp_hdr *)((uint8_t *)p->payload + IP_HLEN);
+    if (TCPH_FLAGS(tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) {
+	// connection state changes are for the NAPT of the lib
+	if (f != NULL)
+	    fp_remove(f);
+	return fp_slip_input(p, inp);
+    }
+
+    if (f != NULL && fp_forward(f, p, system_get_time())) {
+	pbuf_free(p);
+	return ERR_OK;
+    }
+
+    // Slow path, learn from what comes out at the egress netif
+    fastpath_stats.misses++;
+    fp_pending_key = key;
+    fp_pending_done = false;
+    fp_pending_p = p;
+    ret = fp_slip_input(p, inp);
+    fp_pending_p = NULL;
+
+    // not forwarded (anymore), forget it
+    if (!fp_pending_done && (f = fp_find(&key)) != NULL)
+	fp_remove(f);
+
+    return ret;
+}
+
+/*
+ * Input function of the egress netifs (ethernet frames)
+ */
+static err_t ICACHE_FLASH_ATTR
+fastpath_eth_input(struct pbuf *p, struct netif *inp)
+{
+struct eth_hdr *ethhdr = (struct eth_hdr *)p->payload;
+struct ip_hdr *iphdr = (struct ip_hdr *)((uint8_t *)p->payload + SIZEOF_ETH_HDR);
+struct fastpath_flow key, *f;
+struct tcp_hdr *tcphdr;
+netif_input_fn input;
+uint32_t now;
+ip_addr_t dest;
+int hook;
+err_t ret;
+
+    if ((hook = fp_hook_no(inp)) < 0)
+	return ERR_IF;
+    input = fp_hooks[hook].input;
+
+    if (p->len < SIZEOF_ETH_HDR || ethhdr->type != PP_HTONS(ETHTYPE_IP) ||
+	!fp_classify(iphdr, p->len - SIZEOF_ETH_HDR, p->tot_len - SIZEOF_ETH_HDR, &key) ||
+	(f = fp_find_in(&key)) == NULL || f->out != inp)
+	return input(p, inp);
+
+    tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + IP_HLEN);
+    if (TCPH_FLAGS(tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) {
+	fp_remove(f);
+	return input(p, inp);
+    }
+
+    now = system_get_time();
+    if (now - f->last_check_in < FASTPATH_REVALIDATE_US &&
+	fp_can_forward(iphdr, fp_slip_if) && pbuf_header(p, -SIZEOF_ETH_HDR) == 0) {
+
+	fp_rewrite(iphdr, &iphdr->dest, f->src, &tcphdr->dest, f->sport, f->in_ip_adj, f->in_l4_adj);
+
+	f->last_used = now;
+	fastpath_stats.hits_in++;
+	TRACE(TRACE_FP_IN, p->tot_len);
+
+	ip_addr_copy(dest, iphdr->dest);
+	fp_slip_output(fp_slip_if, p, &dest);
+	pbuf_free(p);
+	return ERR_OK;
+    }
+
+    // Slow path, check that the lib still delivers it to the SLIP side
+    fastpath_stats.misses++;
+    fp_pending_in_done = false;
+    fp_pending_in_p = p;
+    ret = input(p, inp);
+    fp_pending_in_p = NULL;
+
+    if (fp_pending_in_done)
+	f->last_check_in = now;
+    else
+	fp_remove(f);
+
+    return ret;
+}
+
+/*
+ * Output function of the egress netifs
+ */
+static err_t ICACHE_FLASH_ATTR
+fastpath_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+int hook = fp_hook_no(netif);
+
+    if (hook < 0)
+	return ERR_IF;
+
+    if (p == fp_pending_p && !fp_pending_done) {
+	fp_learn(netif, p);
+	fp_pending_done = true;
+    }
+    return fp_hooks[hook].output(netif, p, ipaddr);
+}
+
+/*
+ * Output function of the SLIP netif
+ */
+static err_t ICACHE_FLASH_ATTR
+fastpath_slip_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+    if (p == fp_pending_in_p)
+	fp_pending_in_done = true;
+    return fp_slip_output(netif, p, ipaddr);
+}
+
+void ICACHE_FLASH_ATTR fastpath_init(struct netif *slip_if)
+{
+    os_memset(&fastpath_stats, 0, sizeof(fastpath_stats));
+    fastpath_flush();
+
+    fp_slip_if = slip_if;
+    fp_slip_input = slip_if->input;
+    slip_if->input = fastpath_input;
+    fp_slip_output = slip_if->output;
+    slip_if->output = fastpath_slip_output;
+}
+
+void ICACHE_FLASH_ATTR fastpath_hook_netif(struct netif *nif)
+{
+int i;
+
+    if (nif == NULL || nif->output == fastpath_output)
+	return;
+
+    for (i = 0; i < sizeof(fp_hooks)/sizeof(fp_hooks[0]); i++) {
+	if (fp_hooks[i].nif == NULL || fp_hooks[i].nif == nif) {
+	    fp_hooks[i].nif = nif;
+	    fp_hooks[i].input = nif->input;
+	    fp_hooks[i].output = nif->output;
+	    nif->input = fastpath_eth_input;
+	    nif->output = fastpath_output;
+	    return;
+	}
+    }
+}
+
+void ICACHE_FLASH_ATTR fastpath_flush(void)
+{
+    os_memset(fp_flows, 0, sizeof(fp_flows));
+    os_memset(fp_out_idx, 0, sizeof(fp_out_idx));
+    os_memset(fp_in_idx, 0, sizeof(fp_in_idx));
+}
+
+uint8_t ICACHE_FLASH_ATTR fastpath_flows_used(void)
+{
+int i;
+uint8_t n = 0;
+
+    for (i = 0; i < FASTPATH_FLOWS; i++)
+	if (fp_flows[i].valid) n++;
+    return n;
+}
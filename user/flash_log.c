@@ -0,0 +1,303 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "spi_flash.h"
+
+#include "flash_log.h"
+
+/*
+ * Log-structured store for the config and the blobs.
+ *
+ * Each of the two sectors starts with a header (magic and generation),
+ * the one with a valid magic and the higher generation is active. It is
+ * followed by the records, each a header and the data padded to 4 bytes.
+ * The latest record of an id in log order is its current version.
+ *
+ * A save appends a record: the header, then the data, a few page writes
+ * instead of a 4 KiB erase. A torn write leaves a record with a wrong
+ * CRC, which is skipped, or a broken header, after which nothing more is
+ * appended. When the active sector is full (or has a broken header), the
+ * other one is erased, the current version of every id is copied into it
+ * and its header is written last, so a power loss during compaction
+ * leaves the old sector active.
+ */
+
+struct flash_log_sector {
+    uint32_t    magic;
+    uint32_t    gen;
+};
+
+struct flash_log_rec {
+    uint8_t     id;             // 0xff: erased flash, end of the log
+    uint8_t     check;          // over the other header fields
+    uint16_t    len;
+    uint16_t    crc;            // CRC-16 of the data
+    uint16_t    unused;         // stays 0xffff
+};
+
+#define FLASH_LOG_ALIGN(n)  (((n) + 3) & ~3)
+#define FLASH_LOG_ADDR(s)   ((FLASH_LOG_SECTOR + (s)) * SPI_FLASH_SEC_SIZE)
+#define FLASH_LOG_CHUNK     64
+
+static int8_t flash_log_active = -1;    // sector (0 or 1), -1 if none
+static uint32_t flash_log_gen;
+static uint16_t flash_log_end;          // offset of the next record
+static bool flash_log_full;             // broken header, compact on the next write
+static uint32_t flash_log_erase_count;
+
+// Offset and length of the current version per id, offset 0 if none
+static uint16_t flash_log_off[FLASH_LOG_IDS];
+static uint16_t flash_log_len[FLASH_LOG_IDS];
+
+static uint16_t ICACHE_FLASH_ATTR
+flash_log_crc(uint16_t crc, uint8_t *data, uint16_t len)
+{
+int i;
+
+    // CRC-16/CCITT
+    while (len-- > 0) {
+	crc ^= (uint16_t)*data++ << 8;
+	for (i = 0; i < 8; i++)
+	    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint8_t ICACHE_FLASH_ATTR
+flash_log_check(struct flash_log_rec *r)
+{
+    return 0x5a ^ r->id ^ r->len ^ (r->len >> 8) ^ r->crc ^ (r->crc >> 8);
+}
+
+// CRC of len bytes in flash, read in chunks
+static uint16_t ICACHE_FLASH_ATTR
+flash_log_crc_flash(uint32_t addr, uint16_t len)
+{
+uint32_t buf[FLASH_LOG_CHUNK/4];
+uint16_t crc = 0xffff, n;
+
+    while (len > 0) {
+	n = len < FLASH_LOG_CHUNK ? len : FLASH_LOG_CHUNK;
+	spi_flash_read(addr, buf, FLASH_LOG_ALIGN(n));
+	crc = flash_log_crc(crc, (uint8_t *)buf, n);
+	addr += n;
+	len -= n;
+    }
+    return crc;
+}
+
+// Writes len bytes of data (any length, the last word padded with 0xff)
+static void ICACHE_FLASH_ATTR
+flash_log_put(uint32_t addr, uint32_t *data, uint16_t len)
+{
+uint32_t tail = 0xffffffff;
+
+    if (len >= 4)
+	spi_flash_write(addr, data, len & ~3);
+    if ((len & 3) != 0) {
+	os_memcpy(&tail, (uint8_t *)data + (len & ~3), len & 3);
+	spi_flash_write(addr + (len & ~3), &tail, 4);
+    }
+}
+
+// Appends a record at flash_log_end of sector s, the caller checked the space
+static void ICACHE_FLASH_ATTR
+flash_log_append(uint8_t s, uint8_t id, uint32_t *data, uint16_t len)
+{
+struct flash_log_rec r;
+
+    r.id = id;
+    r.len = len;
+    r.crc = flash_log_crc(0xffff, (uint8_t *)data, len);
+    r.unused = 0xffff;
+    r.check = flash_log_check(&r);
+
+    spi_flash_write(FLASH_LOG_ADDR(s) + flash_log_end, (uint32_t *)&r, sizeof(r));
+    flash_log_put(FLASH_LOG_ADDR(s) + flash_log_end + sizeof(r), data, len);
+
+    flash_log_off[id] = flash_log_end;
+    flash_log_len[id] = len;
+    flash_log_end += sizeof(r) + FLASH_LOG_ALIGN(len);
+}
+
+static bool ICACHE_FLASH_ATTR
+flash_log_sector_valid(uint8_t s, uint32_t *gen)
+{
+struct flash_log_sector h;
+
+    spi_flash_read(FLASH_LOG_ADDR(s), (uint32_t *)&h, sizeof(h));
+    *gen = h.gen;
+    return h.magic == FLASH_LOG_MAGIC;
+}
+
+bool ICACHE_FLASH_ATTR
+flash_log_init(void)
+{
+struct flash_log_rec r;
+uint32_t gen0, gen1;
+bool valid0, valid1;
+uint16_t off;
+
+    os_memset(flash_log_off, 0, sizeof(flash_log_off));
+    os_memset(flash_log_len, 0, sizeof(flash_log_len));
+    flash_log_full = false;
+
+    valid0 = flash_log_sector_valid(0, &gen0);
+    valid1 = flash_log_sector_valid(1, &gen1);
+    if (!valid0 && !valid1) {
+	flash_log_active = -1;
+	return false;
+    }
+    if (valid0 && valid1)
+	flash_log_active = (int32_t)(gen1 - gen0) > 0 ? 1 : 0;
+    else
+	flash_log_active = valid1 ? 1 : 0;
+    flash_log_gen = flash_log_active ? gen1 : gen0;
+
+    for (off = sizeof(struct flash_log_sector); off + sizeof(r) <= SPI_FLASH_SEC_SIZE; ) {
+	spi_flash_read(FLASH_LOG_ADDR(flash_log_active) + off, (uint32_t *)&r, sizeof(r));
+	if (r.id == 0xff && r.check == 0xff && r.len == 0xffff)
+	    break;
+	if (r.check != flash_log_check(&r) ||
+	    off + sizeof(r) + FLASH_LOG_ALIGN(r.len) > SPI_FLASH_SEC_SIZE) {
+	    flash_log_full = true;
+	    break;
+	}
+	// a record with a wrong CRC was torn, the previous version stays
+	if (r.id < FLASH_LOG_IDS &&
+	    flash_log_crc_flash(FLASH_LOG_ADDR(flash_log_active) + off + sizeof(r), r.len) == r.crc) {
+	    // length 0 deletes
+	    flash_log_off[r.id] = r.len != 0 ? off : 0;
+	    flash_log_len[r.id] = r.len;
+	}
+	off += sizeof(r) + FLASH_LOG_ALIGN(r.len);
+    }
+    flash_log_end = off;
+    return true;
+}
+
+uint16_t ICACHE_FLASH_ATTR
+flash_log_read(uint8_t id, uint32_t *data, uint16_t len)
+{
+uint16_t n;
+
+    os_memset(data, 0, len);
+    if (flash_log_active < 0 || id >= FLASH_LOG_IDS || flash_log_off[id] == 0)
+	return 0;
+
+    n = flash_log_len[id] < len ? flash_log_len[id] : len;
+    spi_flash_read(FLASH_LOG_ADDR(flash_log_active) + flash_log_off[id] + sizeof(struct flash_log_rec),
+	data, n & ~3);
+    if ((n & 3) != 0) {
+	uint32_t tail;
+	spi_flash_read(FLASH_LOG_ADDR(flash_log_active) + flash_log_off[id] + sizeof(struct flash_log_rec) + (n & ~3),
+	    &tail, 4);
+	os_memcpy((uint8_t *)data + (n & ~3), &tail, n & 3);
+    }
+    return flash_log_len[id];
+}
+
+// Whether the current version of id has exactly this content
+static bool ICACHE_FLASH_ATTR
+flash_log_same(uint8_t id, uint32_t *data, uint16_t len)
+{
+uint32_t buf[FLASH_LOG_CHUNK/4];
+uint32_t addr;
+uint16_t i, n;
+
+    if (len == 0)
+	return flash_log_off[id] == 0;
+    if (flash_log_off[id] == 0 || flash_log_len[id] != len)
+	return false;
+
+    addr = FLASH_LOG_ADDR(flash_log_active) + flash_log_off[id] + sizeof(struct flash_log_rec);
+    for (i = 0; i < len; i += n) {
+	n = len - i < FLASH_LOG_CHUNK ? len - i : FLASH_LOG_CHUNK;
+	spi_flash_read(addr + i, buf, FLASH_LOG_ALIGN(n));
+	if (os_memcmp(buf, (uint8_t *)data + i, n) != 0)
+	    return false;
+    }
+    return true;
+}
+
+// Copies the current versions into the other sector, replacing id with data
+static bool ICACHE_FLASH_ATTR
+flash_log_compact(uint8_t id, uint32_t *data, uint16_t len)
+{
+uint32_t buf[FLASH_LOG_CHUNK/4];
+struct flash_log_sector h;
+uint16_t old_off[FLASH_LOG_IDS];
+uint16_t space, i, n, done;
+uint8_t from, to;
+
+    // the data of the other ids must fit as well
+    space = sizeof(h) + sizeof(struct flash_log_rec) + FLASH_LOG_ALIGN(len);
+    for (i = 0; i < FLASH_LOG_IDS; i++) {
+	if (i != id && flash_log_off[i] != 0)
+	    space += sizeof(struct flash_log_rec) + FLASH_LOG_ALIGN(flash_log_len[i]);
+    }
+    if (space > SPI_FLASH_SEC_SIZE)
+	return false;
+
+    // the first store goes to the second sector, the first one may still
+    // hold a config of the old layout until the header is written
+    from = flash_log_active < 0 ? 0 : flash_log_active;
+    to = from ^ 1;
+    os_printf("Compacting config store into sector %x\r\n", FLASH_LOG_SECTOR + to);
+    spi_flash_erase_sector(FLASH_LOG_SECTOR + to);
+    flash_log_erase_count++;
+
+    os_memcpy(old_off, flash_log_off, sizeof(old_off));
+    os_memset(flash_log_off, 0, sizeof(flash_log_off));
+    flash_log_end = sizeof(h);
+
+    // records are copied as a whole, with their header
+    for (i = 0; i < FLASH_LOG_IDS; i++) {
+	if (i == id || old_off[i] == 0)
+	    continue;
+	n = sizeof(struct flash_log_rec) + FLASH_LOG_ALIGN(flash_log_len[i]);
+	flash_log_off[i] = flash_log_end;
+	for (done = 0; done < n; done += FLASH_LOG_CHUNK) {
+	    uint16_t c = n - done < FLASH_LOG_CHUNK ? n - done : FLASH_LOG_CHUNK;
+	    spi_flash_read(FLASH_LOG_ADDR(from) + old_off[i] + done, buf, c);
+	    spi_flash_write(FLASH_LOG_ADDR(to) + flash_log_end + done, buf, c);
+	}
+	flash_log_end += n;
+    }
+    if (len != 0)
+	flash_log_append(to, id, data, len);
+    else
+	flash_log_len[id] = 0;
+
+    h.magic = FLASH_LOG_MAGIC;
+    h.gen = flash_log_gen + 1;
+    spi_flash_write(FLASH_LOG_ADDR(to), (uint32_t *)&h, sizeof(h));
+
+    flash_log_active = to;
+    flash_log_gen = h.gen;
+    flash_log_full = false;
+    return true;
+}
+
+bool ICACHE_FLASH_ATTR
+flash_log_write(uint8_t id, uint32_t *data, uint16_t len)
+{
+    if (id >= FLASH_LOG_IDS)
+	return false;
+    if (flash_log_same(id, data, len))
+	return true;
+
+    if (flash_log_active < 0 || flash_log_full ||
+	flash_log_end + sizeof(struct flash_log_rec) + FLASH_LOG_ALIGN(len) > SPI_FLASH_SEC_SIZE)
+	return flash_log_compact(id, data, len);
+
+    flash_log_append(flash_log_active, id, data, len);
+    if (len == 0)
+	flash_log_off[id] = 0;
+    return true;
+}
+
+uint32_t ICACHE_FLASH_ATTR
+flash_log_erases(void)
+{
+    return flash_log_erase_count;
+}
@@ -0,0 +1,360 @@
+#include "c_types.h"
+#include "mem.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "lwip/ip.h"
+#include "lwip/lwip_napt.h"
+#include "lwip/app/espconn.h"
+
+#include "driver/slip.h"
+#include "router_stats.h"
+#include "metrics.h"
+#include "mss_clamp.h"
+
+#ifdef ENABLE_FASTPATH
+#include "fastpath.h"
+#endif
+
+/*
+ * Metrics export: the same set of counters and gauges is sent as a UDP
+ * datagram of "name value" lines to a collector every metrics_interval
+ * seconds, and served in Prometheus text format by a minimal HTTP
+ * listener for GET /metrics (any other path gets a 404).
+ */
+
+extern uint64_t Bytes_in, Bytes_out;
+
+typedef enum {METRIC_COUNTER=0, METRIC_GAUGE} METRIC_TYPE;
+
+struct metric {
+    const char  *name;
+    uint8_t     type;
+    sint32      value;
+};
+
+static struct espconn metrics_udp_conn, metrics_http_conn;
+static esp_udp metrics_udp;
+static esp_tcp metrics_http;
+static os_timer_t metrics_timer;
+
+uint16_t ICACHE_FLASH_ATTR
+metrics_format_from(char *buf, uint16_t size, METRICS_FORMAT format, int *index)
+{
+uint32_t napt_used = router_stats_napt_update();
+struct metric m[] = {
+    {"bytes_in",         METRIC_COUNTER, (uint32_t)Bytes_in},
+    {"bytes_out",        METRIC_COUNTER, (uint32_t)Bytes_out},
+    {"free_heap",        METRIC_GAUGE,   system_get_free_heap_size()},
+    {"wifi_rssi",        METRIC_GAUGE,   wifi_station_get_connect_status() == STATION_GOT_IP ?
+					   wifi_station_get_rssi() : 0},
+    {"napt_tcp",         METRIC_GAUGE,   nr_active_napt_tcp},
+    {"napt_udp",         METRIC_GAUGE,   nr_active_napt_udp},
+    {"napt_icmp",        METRIC_GAUGE,   nr_active_napt_icmp},
+    {"napt_used",        METRIC_GAUGE,   napt_used},
+    {"napt_max",         METRIC_GAUGE,   ip_napt_max},
+    {"napt_hwm",         METRIC_GAUGE,   router_stats.napt_hwm},
+    {"slip_rx_packets",  METRIC_COUNTER, router_stats.slip_rx_packets},
+    {"slip_tx_packets",  METRIC_COUNTER, router_stats.slip_tx_packets},
+    {"slip_rx_errors",   METRIC_COUNTER, router_stats.slip_rx_errors},
+    {"slip_rx_dropped",  METRIC_COUNTER, router_stats.slip_rx_dropped},
+    {"slip_tx_dropped",  METRIC_COUNTER, router_stats.slip_tx_dropped},
+    {"pbuf_alloc_fail",  METRIC_COUNTER, router_stats.pbuf_alloc_fail},
+    {"uart_rx_ovf",      METRIC_COUNTER, router_stats.uart_rx_ovf},
+    {"uart_frm_err",     METRIC_COUNTER, router_stats.uart_frm_err},
+    {"uart_tx_full",     METRIC_COUNTER, router_stats.uart_tx_full},
+    {"mss_clamped",      METRIC_COUNTER, mss_clamp_stats.clamped},
+    {"qos_tx_interactive",   METRIC_COUNTER, router_stats.qos_tx[SLIP_TX_INTERACTIVE]},
+    {"qos_tx_default",       METRIC_COUNTER, router_stats.qos_tx[SLIP_TX_DEFAULT]},
+    {"qos_tx_bulk",          METRIC_COUNTER, router_stats.qos_tx[SLIP_TX_BULK]},
+    {"qos_drop_interactive", METRIC_COUNTER, router_stats.qos_drop[SLIP_TX_INTERACTIVE]},
+    {"qos_drop_default",     METRIC_COUNTER, router_stats.qos_drop[SLIP_TX_DEFAULT]},
+    {"qos_drop_bulk",        METRIC_COUNTER, router_stats.qos_drop[SLIP_TX_BULK]},
+    {"codel_drop",           METRIC_COUNTER, router_stats.codel_drop},
+#ifdef ENABLE_SLIP2
+    {"slip2_rx_packets", METRIC_COUNTER, router_stats.slip2_rx_packets},
+    {"slip2_tx_packets", METRIC_COUNTER, router_stats.slip2_tx_packets},
+    {"slip2_tx_dropped", METRIC_COUNTER, router_stats.slip2_tx_dropped},
+    {"slip2_rx_ovf",     METRIC_COUNTER, router_stats.slip2_rx_ovf},
+    {"slip2_frm_err",    METRIC_COUNTER, router_stats.slip2_frm_err},
+#endif
+#ifdef ENABLE_LZF
+    {"lz_tx_raw",        METRIC_COUNTER, router_stats.lz_tx_raw},
+    {"lz_tx_comp",       METRIC_COUNTER, router_stats.lz_tx_comp},
+    {"lz_rx_raw",        METRIC_COUNTER, router_stats.lz_rx_raw},
+    {"lz_rx_comp",       METRIC_COUNTER, router_stats.lz_rx_comp},
+#endif
+#ifdef ENABLE_FASTPATH
+    {"fastpath_hits",    METRIC_COUNTER, fastpath_stats.hits},
+    {"fastpath_hits_in", METRIC_COUNTER, fastpath_stats.hits_in},
+    {"fastpath_misses",  METRIC_COUNTER, fastpath_stats.misses},
+    {"fastpath_flows",   METRIC_GAUGE,   fastpath_flows_used()},
+#endif
+};
+char line[96];
+uint16_t len = 0, l;
+int i;
+
+    for (i = *index; i < sizeof(m)/sizeof(m[0]); i++) {
+	// counters wrap as u32, gauges are signed (RSSI)
+	if (format == METRICS_PROMETHEUS)
+	    os_sprintf(line, m[i].type == METRIC_COUNTER ?
+		"# TYPE esp_slip_%s counter\nesp_slip_%s %u\n" : "# TYPE esp_slip_%s gauge\nesp_slip_%s %d\n",
+		m[i].name, m[i].name, m[i].value);
+	else
+	    os_sprintf(line, m[i].type == METRIC_COUNTER ? "%s %u\r\n" : "%s %d\r\n",
+		m[i].name, m[i].value);
+
+	l = os_strlen(line);
+	if (len + l >= size)
+	    break;
+	os_memcpy(&buf[len], line, l);
+	len += l;
+    }
+    *index = i < sizeof(m)/sizeof(m[0]) ? i : -1;
+    buf[len] = 0;
+    return len;
+}
+
+uint16_t ICACHE_FLASH_ATTR
+metrics_format(char *buf, uint16_t size, METRICS_FORMAT format)
+{
+int index = 0;
+
+    return metrics_format_from(buf, size, format, &index);
+}
+
+/*
+ * UDP push: a set of metrics is sent as datagrams of whole lines, one
+ * after the other from the sent callback, and the buffer is kept until
+ * the last one is out
+ */
+static struct {
+    char        *buf;
+    uint16_t    len;
+    uint16_t    pos;            // Start of the next datagram
+} metrics_out;
+
+static void ICACHE_FLASH_ATTR
+metrics_push_done(void)
+{
+    if (metrics_out.buf != NULL)
+	os_free(metrics_out.buf);
+    metrics_out.buf = NULL;
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_push_next(void *arg)
+{
+uint16_t len;
+
+    if (metrics_out.buf == NULL)
+	return;
+    if (metrics_out.pos >= metrics_out.len) {
+	metrics_push_done();
+	return;
+    }
+
+    // break after the last line end that fits
+    len = metrics_out.len - metrics_out.pos;
+    if (len > METRICS_UDP_SIZE) {
+	len = METRICS_UDP_SIZE;
+	while (len > 0 && metrics_out.buf[metrics_out.pos + len - 1] != '\n')
+	    len--;
+	if (len == 0)
+	    len = METRICS_UDP_SIZE;
+    }
+
+    metrics_out.pos += len;
+    if (espconn_sent(&metrics_udp_conn, (uint8 *)&metrics_out.buf[metrics_out.pos - len], len) != ESPCONN_OK)
+	metrics_push_done();
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_push(void *arg)
+{
+    // a set still on the way an interval later has lost a sent callback
+    metrics_push_done();
+
+    if ((metrics_out.buf = (char *)os_malloc(METRICS_BUF_SIZE)) == NULL)
+	return;
+    metrics_out.len = metrics_format(metrics_out.buf, METRICS_BUF_SIZE, METRICS_PLAIN);
+    metrics_out.pos = 0;
+    metrics_push_next(NULL);
+}
+
+void ICACHE_FLASH_ATTR
+metrics_set_push(uint16_t interval, ip_addr_t *collector, uint16_t port)
+{
+    os_timer_disarm(&metrics_timer);
+    if (metrics_udp_conn.proto.udp != NULL) {
+	espconn_delete(&metrics_udp_conn);
+	metrics_udp_conn.proto.udp = NULL;
+    }
+    metrics_push_done();
+
+    if (interval == 0 || collector->addr == 0 || port == 0)
+	return;
+
+    os_memset(&metrics_udp, 0, sizeof(metrics_udp));
+    metrics_udp_conn.type = ESPCONN_UDP;
+    metrics_udp_conn.state = ESPCONN_NONE;
+    metrics_udp_conn.proto.udp = &metrics_udp;
+    os_memcpy(metrics_udp.remote_ip, &collector->addr, 4);
+    metrics_udp.remote_port = port;
+    metrics_udp.local_port = espconn_port();
+    espconn_regist_sentcb(&metrics_udp_conn, metrics_push_next);
+    espconn_create(&metrics_udp_conn);
+
+    os_timer_setfn(&metrics_timer, metrics_push, NULL);
+    os_timer_arm(&metrics_timer, interval * 1000, 1);
+}
+
+/*
+ * HTTP responses, sent one MSS at a time from the sent callback. espconn
+ * keeps a pointer to the data that does not fit into the send buffer,
+ * so the buffer lives until the connection is closed.
+ */
+#define METRICS_HTTP_SESSIONS   2
+
+struct metrics_resp {
+    struct espconn *conn;       // NULL if the slot is free
+    uint8_t     remote_ip[4];   // To find the response on disconnect
+    int         remote_port;
+
+    char        *buf;
+    uint16_t    len;
+    uint16_t    sent;
+    uint16_t    chunk;          // Bytes given to the last espconn_sent()
+};
+
+static struct metrics_resp metrics_resp[METRICS_HTTP_SESSIONS];
+
+// The disconnect callback may get another espconn with the same remote
+static struct metrics_resp * ICACHE_FLASH_ATTR
+metrics_resp_find(struct espconn *pespconn)
+{
+int i;
+
+    for (i = 0; i < METRICS_HTTP_SESSIONS; i++) {
+	if (metrics_resp[i].conn == pespconn)
+	    return &metrics_resp[i];
+    }
+    for (i = 0; i < METRICS_HTTP_SESSIONS; i++) {
+	if (metrics_resp[i].conn != NULL &&
+	    metrics_resp[i].remote_port == pespconn->proto.tcp->remote_port &&
+	    os_memcmp(metrics_resp[i].remote_ip, pespconn->proto.tcp->remote_ip, 4) == 0)
+	    return &metrics_resp[i];
+    }
+    return NULL;
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_send(struct metrics_resp *r)
+{
+    r->chunk = r->len - r->sent;
+    if (r->chunk > espconn_tcp_get_mss())
+	r->chunk = espconn_tcp_get_mss();
+    if (espconn_sent(r->conn, (uint8 *)&r->buf[r->sent], r->chunk) != ESPCONN_OK)
+	espconn_disconnect(r->conn);
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_close(struct espconn *pespconn)
+{
+struct metrics_resp *r = metrics_resp_find(pespconn);
+
+    if (r == NULL)
+	return;
+    os_free(r->buf);
+    os_memset(r, 0, sizeof(struct metrics_resp));
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_sent_cb(void *arg)
+{
+struct espconn *pespconn = (struct espconn *)arg;
+struct metrics_resp *r = metrics_resp_find(pespconn);
+
+    if (r != NULL) {
+	r->sent += r->chunk;
+	if (r->sent < r->len) {
+	    metrics_http_send(r);
+	    return;
+	}
+    }
+    espconn_disconnect(pespconn);
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_discon_cb(void *arg)
+{
+    metrics_http_close((struct espconn *)arg);
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_recon_cb(void *arg, sint8 err)
+{
+    metrics_http_close((struct espconn *)arg);
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_recv_cb(void *arg, char *data, unsigned short length)
+{
+struct espconn *pespconn = (struct espconn *)arg;
+static const char hdr_ok[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+static const char hdr_404[] = "HTTP/1.0 404 Not Found\r\n\r\n";
+struct metrics_resp *r = NULL;
+int i;
+
+    // one request per connection, the request line is in the first segment
+    espconn_regist_recvcb(pespconn, NULL);
+
+    if (length < 13 || os_strncmp(data, "GET /metrics", 12) != 0 ||
+	(data[12] != ' ' && data[12] != '?')) {
+	espconn_sent(pespconn, (uint8 *)hdr_404, sizeof(hdr_404)-1);
+	return;
+    }
+
+    for (i = 0; i < METRICS_HTTP_SESSIONS && r == NULL; i++) {
+	if (metrics_resp[i].conn == NULL)
+	    r = &metrics_resp[i];
+    }
+    if (r == NULL || (r->buf = (char *)os_malloc(sizeof(hdr_ok) + METRICS_BUF_SIZE)) == NULL) {
+	espconn_disconnect(pespconn);
+	return;
+    }
+    r->conn = pespconn;
+    os_memcpy(r->remote_ip, pespconn->proto.tcp->remote_ip, 4);
+    r->remote_port = pespconn->proto.tcp->remote_port;
+
+    os_memcpy(r->buf, hdr_ok, sizeof(hdr_ok)-1);
+    r->len = sizeof(hdr_ok)-1;
+    r->len += metrics_format(&r->buf[r->len], METRICS_BUF_SIZE, METRICS_PROMETHEUS);
+    r->sent = 0;
+    metrics_http_send(r);
+}
+
+static void ICACHE_FLASH_ATTR
+metrics_http_connected_cb(void *arg)
+{
+struct espconn *pespconn = (struct espconn *)arg;
+
+    espconn_regist_recvcb(pespconn, metrics_http_recv_cb);
+    espconn_regist_sentcb(pespconn, metrics_http_sent_cb);
+    espconn_regist_disconcb(pespconn, metrics_http_discon_cb);
+    espconn_regist_reconcb(pespconn, metrics_http_recon_cb);
+    espconn_regist_time(pespconn, 10, 1);
+}
+
+void ICACHE_FLASH_ATTR
+metrics_init(uint16_t port)
+{
+    os_memset(&metrics_http, 0, sizeof(metrics_http));
+    metrics_http_conn.type = ESPCONN_TCP;
+    metrics_http_conn.state = ESPCONN_NONE;
+    metrics_http_conn.proto.tcp = &metrics_http;
+    metrics_http.local_port = port;
+    espconn_regist_connectcb(&metrics_http_conn, metrics_http_connected_cb);
+    espconn_accept(&metrics_http_conn);
+}
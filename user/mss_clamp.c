@@ -0,0 +1,131 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/opt.h"
+#include "lwip/ip.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/netif.h"
+
+#include "mss_clamp.h"
+
+/*
+ * MSS clamping of TCP SYNs in both directions of the SLIP netif.
+ *
+ * The hosts of a forwarded connection negotiate the MSS end to end and
+ * know nothing about the SLIP link or the pbuf pool of the ESP. Lowering
+ * the MSS option of the SYN and SYN-ACK to the SLIP MTU minus IP and TCP
+ * header (or a lower configured value) keeps all segments of the
+ * connection below it, so they are never fragmented. The checksum is
+ * adjusted incrementally (RFC 1624).
+ */
+
+struct mss_clamp_stats mss_clamp_stats;
+
+static struct netif *mss_slip_if;
+static netif_input_fn mss_slip_input;
+static netif_output_fn mss_slip_output;
+static uint16_t mss_config;
+
+uint16_t ICACHE_FLASH_ATTR
+mss_clamp_get(void)
+{
+uint16_t mss = mss_slip_if != NULL && mss_slip_if->mtu > IP_HLEN + TCP_HLEN ?
+		 mss_slip_if->mtu - IP_HLEN - TCP_HLEN : 0;
+
+    if (mss_config != 0 && (mss == 0 || mss_config < mss))
+	mss = mss_config;
+    return mss;
+}
+
+static void ICACHE_FLASH_ATTR
+mss_clamp_pbuf(struct pbuf *p)
+{
+struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+struct tcp_hdr *tcphdr;
+uint8_t *opt, *end;
+uint16_t hlen, mss, clamp;
+uint32_t sum;
+
+    if (p->len < IP_HLEN || IPH_V(iphdr) != 4 || IPH_PROTO(iphdr) != IP_PROTO_TCP)
+	return;
+    if ((IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK)) != 0)
+	return;
+    hlen = IPH_HL(iphdr) * 4;
+    if (p->len < hlen + TCP_HLEN)
+	return;
+
+    tcphdr = (struct tcp_hdr *)((uint8_t *)iphdr + hlen);
+    if ((TCPH_FLAGS(tcphdr) & TCP_SYN) == 0)
+	return;
+    if ((clamp = mss_clamp_get()) == 0)
+	return;
+
+    // the options have to be in the first pbuf, as all headers
+    opt = (uint8_t *)tcphdr + TCP_HLEN;
+    end = (uint8_t *)tcphdr + TCPH_HDRLEN(tcphdr) * 4;
+    if (end > (uint8_t *)p->payload + p->len)
+	return;
+
+    while (opt < end) {
+	if (opt[0] == 0)	// end of options
+	    return;
+	if (opt[0] == 1) {	// NOP
+	    opt++;
+	    continue;
+	}
+	if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+	    return;
+	if (opt[0] == 2 && opt[1] == 4) {
+	    mss = (opt[2] << 8) | opt[3];
+	    if (mss <= clamp)
+		return;
+	    opt[2] = clamp >> 8;
+	    opt[3] = clamp & 0xff;
+
+	    // one's complement delta of the changed word, byte swapped if the
+	    // value is not at an even offset from the start of the header
+	    if (((opt + 2 - (uint8_t *)tcphdr) & 1) == 0)
+		sum = (~mss & 0xffff) + clamp;
+	    else
+		sum = (~((mss >> 8) | (mss << 8)) & 0xffff) + (((clamp >> 8) | (clamp << 8)) & 0xffff);
+	    sum += ~ntohs(tcphdr->chksum) & 0xffff;
+	    sum = (sum & 0xffff) + (sum >> 16);
+	    sum = (sum & 0xffff) + (sum >> 16);
+	    tcphdr->chksum = htons(~sum & 0xffff);
+
+	    mss_clamp_stats.clamped++;
+	    return;
+	}
+	opt += opt[1];
+    }
+}
+
+static err_t ICACHE_FLASH_ATTR
+mss_clamp_input(struct pbuf *p, struct netif *inp)
+{
+    mss_clamp_pbuf(p);
+    return mss_slip_input(p, inp);
+}
+
+static err_t ICACHE_FLASH_ATTR
+mss_clamp_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+    mss_clamp_pbuf(p);
+    return mss_slip_output(netif, p, ipaddr);
+}
+
+void ICACHE_FLASH_ATTR
+mss_clamp_set(uint16_t mss)
+{
+    mss_config = mss;
+}
+
+void ICACHE_FLASH_ATTR
+mss_clamp_init(struct netif *slip_if, uint16_t mss)
+{
+    mss_config = mss;
+    mss_slip_if = slip_if;
+    mss_slip_input = slip_if->input;
+    slip_if->input = mss_clamp_input;
+    mss_slip_output = slip_if->output;
+    slip_if->output = mss_clamp_output;
+}
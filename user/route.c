@@ -0,0 +1,176 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "lwip/ip_addr.h"
+#include "lwip/def.h"
+
+#include "config_flash.h"
+#include "route.h"
+
+/*
+ * Static route table with longest prefix match.
+ *
+ * The entries are kept sorted by prefix length, longest first, so the
+ * first match is the most specific one. A lookup first checks a small
+ * direct mapped cache of destinations (including "no route", the common
+ * case for traffic to the internet), so for ongoing flows the per-packet
+ * cost does not grow with the table. Any change of the table flushes the
+ * cache.
+ *
+ * Unused entries at the end of the table have gw 0.
+ */
+
+struct route_stats route_stats;
+
+static struct route_entry route_table[ROUTE_MAX];
+static uint8_t route_n;
+
+#define ROUTE_CACHE_NONE    -1      // no route for the destination
+#define ROUTE_CACHE_EMPTY   -2
+
+static struct {
+    uint32_t    addr;
+    int8_t      idx;
+} route_cache[ROUTE_CACHE_SIZE];
+
+static void ICACHE_FLASH_ATTR
+route_cache_flush(void)
+{
+int i;
+
+    for (i = 0; i < ROUTE_CACHE_SIZE; i++)
+	route_cache[i].idx = ROUTE_CACHE_EMPTY;
+}
+
+static uint8_t ICACHE_FLASH_ATTR
+route_hash(uint32_t addr)
+{
+    addr ^= addr >> 16;
+    addr ^= addr >> 8;
+    return addr & (ROUTE_CACHE_SIZE - 1);
+}
+
+// A contiguous mask in host order is ~0 shifted left
+static bool ICACHE_FLASH_ATTR
+route_mask_valid(ip_addr_t mask)
+{
+uint32_t m = ntohl(mask.addr);
+
+    return (m & (~m >> 1)) == 0;
+}
+
+static int ICACHE_FLASH_ATTR
+route_find_exact(ip_addr_t ip, ip_addr_t mask)
+{
+int i;
+
+    for (i = 0; i < route_n; i++) {
+	if (route_table[i].ip.addr == (ip.addr & mask.addr) && route_table[i].mask.addr == mask.addr)
+	    return i;
+    }
+    return -1;
+}
+
+bool ICACHE_FLASH_ATTR
+route_add(ip_addr_t ip, ip_addr_t mask, ip_addr_t gw)
+{
+int i;
+
+    if (!route_mask_valid(mask) || gw.addr == 0)
+	return false;
+    ip.addr &= mask.addr;
+
+    if ((i = route_find_exact(ip, mask)) >= 0) {
+	route_table[i].gw = gw;
+	route_cache_flush();
+	return true;
+    }
+    if (route_n >= ROUTE_MAX)
+	return false;
+
+    // insert behind all routes with a longer or equal prefix
+    for (i = route_n; i > 0 && ntohl(route_table[i-1].mask.addr) < ntohl(mask.addr); i--)
+	route_table[i] = route_table[i-1];
+    route_table[i].ip = ip;
+    route_table[i].mask = mask;
+    route_table[i].gw = gw;
+    route_n++;
+
+    route_cache_flush();
+    return true;
+}
+
+bool ICACHE_FLASH_ATTR
+route_del(ip_addr_t ip, ip_addr_t mask)
+{
+int i;
+
+    if ((i = route_find_exact(ip, mask)) < 0)
+	return false;
+
+    route_n--;
+    for (; i < route_n; i++)
+	route_table[i] = route_table[i+1];
+    os_memset(&route_table[route_n], 0, sizeof(struct route_entry));
+
+    route_cache_flush();
+    return true;
+}
+
+bool ICACHE_FLASH_ATTR
+route_get(uint8_t no, ip_addr_t *ip, ip_addr_t *mask, ip_addr_t *gw)
+{
+    if (no >= route_n)
+	return false;
+    *ip = route_table[no].ip;
+    *mask = route_table[no].mask;
+    *gw = route_table[no].gw;
+    return true;
+}
+
+uint8_t ICACHE_FLASH_ATTR
+route_count(void)
+{
+    return route_n;
+}
+
+void ICACHE_FLASH_ATTR
+route_load(void)
+{
+struct route_entry saved[ROUTE_MAX];
+int i;
+
+    // re-added one by one, so a damaged entry cannot break the order
+    blob_load(ROUTE_BLOB, (uint32_t *)saved, sizeof(saved));
+    os_memset(route_table, 0, sizeof(route_table));
+    route_n = 0;
+    for (i = 0; i < ROUTE_MAX && saved[i].gw.addr != 0; i++)
+	route_add(saved[i].ip, saved[i].mask, saved[i].gw);
+    route_cache_flush();
+}
+
+bool ICACHE_FLASH_ATTR
+route_save(void)
+{
+    return blob_save(ROUTE_BLOB, (uint32_t *)route_table, sizeof(route_table));
+}
+
+struct route_entry * ICACHE_FLASH_ATTR
+__wrap_ip_find_route(ip_addr_t ip)
+{
+uint8_t h = route_hash(ip.addr);
+int i;
+
+    if (route_cache[h].idx != ROUTE_CACHE_EMPTY && route_cache[h].addr == ip.addr) {
+	route_stats.cache_hits++;
+	return route_cache[h].idx >= 0 ? &route_table[route_cache[h].idx] : NULL;
+    }
+    route_stats.cache_misses++;
+
+    for (i = 0; i < route_n; i++) {
+	if ((ip.addr & route_table[i].mask.addr) == route_table[i].ip.addr)
+	    break;
+    }
+    route_cache[h].addr = ip.addr;
+    route_cache[h].idx = i < route_n ? i : ROUTE_CACHE_NONE;
+    return i < route_n ? &route_table[i] : NULL;
+}
@@ -0,0 +1,109 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "user_interface.h"
+#include "lwip/ip.h"
+#include "lwip/netif.h"
+#include "lwip/lwip_napt.h"
+#include "netif/slipif.h"
+
+#include "driver/sio.h"
+#include "driver/softuart.h"
+#include "router_stats.h"
+#include "slip2.h"
+
+/*
+ * Second SLIP link on the softuart.
+ *
+ * This is the plain slipif of the lwip lib on sio device SIO_DEV_SOFTUART,
+ * none of the UART0 machinery (RX arena, TX queues, compression) is
+ * involved. The softuart has no TX interrupt, so a timer drives both
+ * directions: every SLIP2_POLL_MS it bit-bangs a burst of at most
+ * SLIP2_TX_BURST_MS line time and feeds the received bytes to slipif.
+ */
+
+#define SLIP2_TX_BURST  ((SLIP2_BIT_RATE / 10) * SLIP2_TX_BURST_MS / 1000 + 1)
+
+static struct netif sl2_netif;
+static bool sl2_up;
+static u8_t sl2_int_no = SIO_DEV_SOFTUART;
+static sio_fd_t sl2_fd;
+static netif_output_fn sl2_slipif_output;
+static os_timer_t sl2_timer;
+
+static err_t ICACHE_FLASH_ATTR
+slip2_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+    // slipif_output() writes byte by byte and cannot see a full buffer,
+    // a frame that might not fit (all bytes escaped) is dropped as a whole
+    if (sio_write_space(sl2_fd) < 2 * (u32_t)p->tot_len + 2) {
+	router_stats.slip2_tx_dropped++;
+	return ERR_MEM;
+    }
+    router_stats.slip2_tx_packets++;
+    return sl2_slipif_output(netif, p, ipaddr);
+}
+
+static err_t ICACHE_FLASH_ATTR
+slip2_input(struct pbuf *p, struct netif *inp)
+{
+    router_stats.slip2_rx_packets++;
+    return ip_input(p, inp);
+}
+
+static void ICACHE_FLASH_ATTR
+slip2_poll(void *arg)
+{
+Softuart *s = (Softuart *)sl2_fd;
+
+    // first the RX side, sio_poll() completes a byte ending without edge
+    sio_poll(sl2_fd, 0);
+    slipif_poll(&sl2_netif);
+
+    if (s->buffer.buffer_overflow) {
+	s->buffer.buffer_overflow = 0;
+	router_stats.slip2_rx_ovf++;
+    }
+    if (s->rx.frame_error) {
+	s->rx.frame_error = 0;
+	router_stats.slip2_frm_err++;
+    }
+
+    sio_poll(sl2_fd, SLIP2_TX_BURST);
+}
+
+void ICACHE_FLASH_ATTR
+slip2_init(ip_addr_t *addr, bool nat)
+{
+ip_addr_t netmask, gw;
+
+    // slipif_init() opens the same device again
+    sl2_fd = sio_open(SIO_DEV_SOFTUART);
+    if (sl2_fd == NULL) {
+	os_printf("SLIP2: no softuart\r\n");
+	return;
+    }
+
+    IP4_ADDR(&netmask, 255, 255, 255, 0);
+    ip_addr_set_zero(&gw);
+    if (netif_add(&sl2_netif, addr, &netmask, &gw, &sl2_int_no, slipif_init, slip2_input) == NULL)
+	return;
+    sl2_netif.mtu = SLIP2_MTU;
+    sl2_slipif_output = sl2_netif.output;
+    sl2_netif.output = slip2_output;
+    netif_set_up(&sl2_netif);
+    sl2_up = true;
+
+    if (nat)
+	ip_napt_enable(addr->addr, 1);
+
+    os_timer_disarm(&sl2_timer);
+    os_timer_setfn(&sl2_timer, slip2_poll, NULL);
+    os_timer_arm(&sl2_timer, SLIP2_POLL_MS, 1);
+}
+
+struct netif * ICACHE_FLASH_ATTR
+slip2_netif(void)
+{
+    return sl2_up ? &sl2_netif : NULL;
+}
@@ -0,0 +1,122 @@
+#include "c_types.h"
+#include "osapi.h"
+#include "user_interface.h"
+
+#include "ringbuf.h"
+#include "trace.h"
+
+/*
+ * Hot path trace: each record is the CCOUNT at the tracepoint plus an id
+ * and a 16 bit argument, kept in a ringbuf that overwrites the oldest
+ * records. The ringbuf functions are in IRAM, so records can be written
+ * from the UART ISR. Writers lock the interrupts for the 8 byte copy, so
+ * task and ISR records never interleave.
+ */
+
+struct trace_entry {
+    uint32_t    ccount;
+    uint16_t    id;
+    uint16_t    arg;
+};
+
+static ringbuf_t trace_buf;
+static uint32_t trace_last_ccount;
+
+static const char *trace_names[TRACE_IDS] = {
+    "-", "isr", "isr_end", "rx_unload", "tx_fill", "task_rx", "task_rx_end",
+    "ip_input", "ip_input_end", "fp_out", "fp_in"
+};
+
+static inline uint32_t
+trace_irq_lock(void)
+{
+uint32_t ps;
+
+    __asm__ __volatile__("rsil %0, 15" : "=a"(ps) :: "memory");
+    return ps;
+}
+
+static inline void
+trace_irq_unlock(uint32_t ps)
+{
+    __asm__ __volatile__("wsr %0, ps; rsync" :: "a"(ps) : "memory");
+}
+
+void ICACHE_FLASH_ATTR
+trace_init(void)
+{
+    trace_buf = ringbuf_new(TRACE_ENTRIES * sizeof(struct trace_entry));
+}
+
+void
+trace_record(uint16_t id, uint16_t arg)
+{
+struct trace_entry e;
+uint32_t ps;
+
+    if (trace_buf == NULL)
+	return;
+
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(e.ccount));
+    e.id = id;
+    e.arg = arg;
+
+    // capacity is a multiple of the record size, so an overflow drops
+    // exactly the oldest record
+    ps = trace_irq_lock();
+    ringbuf_memcpy_into(trace_buf, &e, sizeof(e));
+    trace_irq_unlock(ps);
+}
+
+void ICACHE_FLASH_ATTR
+trace_clear(void)
+{
+uint32_t ps;
+
+    if (trace_buf == NULL)
+	return;
+
+    ps = trace_irq_lock();
+    ringbuf_reset(trace_buf);
+    trace_irq_unlock(ps);
+    trace_last_ccount = 0;
+}
+
+uint16_t ICACHE_FLASH_ATTR
+trace_count(void)
+{
+    if (trace_buf == NULL)
+	return 0;
+    return ringbuf_bytes_used(trace_buf) / sizeof(struct trace_entry);
+}
+
+uint16_t ICACHE_FLASH_ATTR
+trace_dump(ringbuf_t rb, uint16_t max)
+{
+struct trace_entry e;
+char line[48];
+uint16_t n = 0;
+uint32_t ps;
+void *ok;
+
+    if (trace_buf == NULL)
+	return 0;
+
+    while (n < max && ringbuf_bytes_free(rb) > sizeof(line)) {
+	ps = trace_irq_lock();
+	ok = ringbuf_memcpy_from(&e, trace_buf, sizeof(e));
+	trace_irq_unlock(ps);
+	if (ok == NULL)
+	    break;
+
+	// cycles since the previous record, at system_get_cpu_freq() MHz
+	os_sprintf(line, "%u +%u %s %u\r\n", e.ccount,
+	    trace_last_ccount ? e.ccount - trace_last_ccount : 0,
+	    e.id < TRACE_IDS ? trace_names[e.id] : "?", e.arg);
+	trace_last_ccount = e.ccount;
+	ringbuf_memcpy_into(rb, line, os_strlen(line));
+	n++;
+    }
+
+    return n;
+}
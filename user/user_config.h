@@ -18,16 +18,54 @@ typedef enum {SIG_DO_NOTHING=0, SIG_START_SERVER=2, SIG_SEND_DATA, SIG_CONSOLE_R
 //
 #define MAX_CON_SEND_SIZE    1024
 
+//
+// Size of the console receive buffer, max. length of a command line and
+// max. number of queued command lines. Input from the telnet connection is
+// held back (TCP window closed) while less than MAX_CON_RECV_HOLD bytes
+// or half of the queue are free
+//
+#define MAX_CON_RECV_SIZE    2048
+#define MAX_CON_CMD_SIZE     256
+#define MAX_CON_CMD_QUEUE    32
+#define MAX_CON_RECV_HOLD    1460
+
 //
 // Define this for debug output on the SoftUART (Rx GPIO 14, Tx GPIO 12)
 //
 //#define DEBUG_SOFTUART      1
 
+//
+// Define this for a second SLIP link on a SoftUART, a netif of its own
+// with address, NAPT and stats (set slip2_addr|slip2_nat). Its default
+// pins are the ones of DEBUG_SOFTUART, so only one of both. The TX is
+// bit-banged in bursts of SLIP2_TX_BURST_MS every SLIP2_POLL_MS, which
+// blocks the CPU for that time, so keep the bit rate low. The TX buffer
+// takes at least one frame of SLIP2_MTU with all bytes escaped
+//
+//#define ENABLE_SLIP2        1
+#define SLIP2_RX_GPIO       14
+#define SLIP2_TX_GPIO       12
+#define SLIP2_BIT_RATE      19200
+#define SLIP2_MTU           576
+#define SLIP2_TX_BUFF       (2*SLIP2_MTU+4)
+#define SLIP2_POLL_MS       10
+#define SLIP2_TX_BURST_MS   5
+
+#if defined(ENABLE_SLIP2) && defined(DEBUG_SOFTUART)
+#error "ENABLE_SLIP2 and DEBUG_SOFTUART share the SoftUART pins"
+#endif
+
 //
 // Define this to support the "scan" command for AP search
 //
 #define ALLOW_SCANNING      1
 
+//
+// Time (ms) the station tries the AP of the last connect at boot, before
+// it falls back to a connect with a full scan
+//
+#define WIFI_FAST_CONNECT_MS 5000
+
 //
 // Define this if you want to have access to the config console via TCP.
 // Ohterwise only local access via serial is possible
@@ -35,6 +73,21 @@ typedef enum {SIG_DO_NOTHING=0, SIG_START_SERVER=2, SIG_SEND_DATA, SIG_CONSOLE_R
 #define REMOTE_CONFIG      1
 #define CONSOLE_SERVER_PORT  7777
 
+//
+// Max. number of concurrent console sessions. Each one allocates
+// MAX_CON_RECV_SIZE + MAX_CON_SEND_SIZE bytes of heap while connected
+//
+#define MAX_CON_SESSIONS     3
+
+//
+// Define this for metrics export: HTTP GET /metrics (Prometheus text
+// format) on METRICS_SERVER_PORT and an optional periodic UDP push to a
+// collector (set metrics_interval|metrics_collector|metrics_port)
+//
+#define ENABLE_METRICS       1
+#define METRICS_SERVER_PORT  (CONSOLE_SERVER_PORT+1)
+#define METRICS_UDP_PORT     7779
+
 //
 // Define this if you want to emulate a Hayes-compatible modem
 // Otherwise it will be a straight ethernet-SLIP ("direct") connection
@@ -44,6 +97,31 @@ typedef enum {SIG_DO_NOTHING=0, SIG_START_SERVER=2, SIG_SEND_DATA, SIG_CONSOLE_R
 //#define ENABLE_HAYES  1
 //#define HAYES_CMD_MODE_AT_BOOT true
 
+//
+// Define this to forward established TCP flows between SLIP and STA via
+// a hashed flow cache instead of the full ip_forward/NAPT path (STA mode)
+//
+#define ENABLE_FASTPATH     1
+
+//
+// Define this for the "bench" console command: UDP/TCP discard and echo
+// sinks and a SLIP loopback with throughput and latency report
+//
+#define ENABLE_BENCH        1
+
+//
+// Define this for the compressed link mode ("set compress 1"): frames on
+// the serial line are LZF compressed where that makes them shorter. Needs
+// about 5 kB of static RAM and a compressing peer, see README
+//
+#define ENABLE_LZF          1
+
+//
+// Define this for CCOUNT tracepoints in the UART ISR, the RX task and the
+// forward path, read out with "trace dump". No code if undefined
+//
+//#define ENABLE_TRACE        1
+
 //
 // Define the GPIO of the status LED
 // If undefined, no status LED
@@ -15,7 +15,10 @@
 #include "lwip/ip_route.h"
 #include "netif/slipif.h"
 #include "driver/uart.h"
+#include "driver/slip.h"
+#include "driver/codel.h"
 #include "driver/softuart.h"
+#include "driver/sio.h"
 
 #include "ringbuf.h"
 #include "user_config.h"
@@ -25,6 +28,25 @@
 #endif
 
 #include "config_flash.h"
+#include "flash_log.h"
+#include "router_stats.h"
+
+#ifdef ENABLE_FASTPATH
+#include "fastpath.h"
+#endif
+
+#ifdef ENABLE_BENCH
+#include "bench.h"
+#endif
+
+#include "trace.h"
+#include "metrics.h"
+#include "bitrate.h"
+#include "mss_clamp.h"
+#include "route.h"
+#ifdef ENABLE_SLIP2
+#include "slip2.h"
+#endif
 
 #define user_procTaskPrio        0
 #define user_procTaskQueueLen    10
@@ -34,6 +56,8 @@ static char INVALID_LOCKED[] = "Invalid command. Config locked\r\n";
 static char INVALID_NUMARGS[] = "Invalid number of arguments\r\n";
 static char INVALID_ARG[] = "Invalid argument\r\n";
 
+static char *flow_control_names[] = {"none", "RTS", "CTS", "RTS/CTS"};
+
 Softuart softuart;
 
 struct netif sl_netif;
@@ -41,19 +65,82 @@ struct netif sl_netif;
 // Holds the system wide configuration
 sysconfig_t config;
 
-static ringbuf_t console_rx_buffer, console_tx_buffer;
+//
+// Output that does not fit into the tx buffer of a session comes from a
+// generator. It is called while at least CON_GEN_SPACE bytes are free and
+// writes one or more items starting at index, returning the next index or
+// -1 when done
+//
+#define CON_GEN_SPACE 128
+typedef int (*console_gen_fn)(ringbuf_t rb, int index);
+
+//
+// One console session per telnet connection, the buffers are allocated
+// when the client connects
+//
+struct console_session {
+    struct espconn *conn;               // NULL if the slot is free
+    uint8_t     remote_ip[4];           // To find the session on disconnect
+    int         remote_port;
+
+    ringbuf_t   rx_buffer;              // Complete command lines, oldest first
+    ringbuf_t   tx_buffer;
+    uint16_t    cmd_len[MAX_CON_CMD_QUEUE];
+    uint8_t     cmd_head, cmd_count;
+
+    char        line[MAX_CON_CMD_SIZE]; // The incomplete line at the end of the received data
+    uint16_t    line_len;
+    bool        line_drop;
+
+    bool        busy;                   // A command is executed or its response is still on the way
+    bool        held;                   // Receive side held with espconn_recv_hold()
+    bool        disconnect;             // Close after the response
+    bool        query;                  // Non-interactive query, no prompt
+
+    console_gen_fn gen;
+    int         gen_index;
+};
+
+static struct console_session console_sessions[MAX_CON_SESSIONS];
 
 static ip_addr_t my_ip, dns_ip;
 bool connected;
 
-uint8_t remote_console_disconnect;
-
 uint32_t g_bit_rate;
+uint8_t g_flow_control;
 
 uint64_t Bytes_in, Bytes_out;
 
+struct router_stats router_stats;
+
 static os_timer_t ptimer;
 
+// BSSID and channel of the last connect, see user_set_station_config()
+static wifi_cache_t wifi_cache;
+static bool wifi_fast_connect;
+static os_timer_t wifi_fast_timer;
+
+uint32_t ICACHE_FLASH_ATTR router_stats_napt_update(void)
+{
+    uint32_t used = nr_active_napt_tcp + nr_active_napt_udp + nr_active_napt_icmp;
+
+    if (used > router_stats.napt_hwm)
+	router_stats.napt_hwm = used;
+    return used;
+}
+
+void ICACHE_FLASH_ATTR router_stats_reset(void)
+{
+    os_memset(&router_stats, 0, sizeof(router_stats));
+    os_memset(&mss_clamp_stats, 0, sizeof(mss_clamp_stats));
+    os_memset(&route_stats, 0, sizeof(route_stats));
+    Bytes_in = Bytes_out = 0;
+#ifdef ENABLE_FASTPATH
+    os_memset(&fastpath_stats, 0, sizeof(fastpath_stats));
+#endif
+    router_stats_napt_update();
+}
+
 // Similar to strtok
 int ICACHE_FLASH_ATTR parse_str_into_tokens(char *str, char **tokens, int max_tokens)
 {
@@ -131,70 +218,416 @@ int ICACHE_FLASH_ATTR parse_str_into_tokens(char *str, char **tokens, int max_to
 }
 
 
-void ICACHE_FLASH_ATTR console_send_response(struct espconn *pespconn)
+/*
+ * Finds the session of a connection. Some SDK versions hand a different
+ * espconn to the disconnect callback, so the remote address is tried too.
+ */
+static struct console_session * ICACHE_FLASH_ATTR console_session_find(struct espconn *pespconn)
+{
+    int i;
+
+    if (pespconn == NULL)
+	return NULL;
+    for (i = 0; i < MAX_CON_SESSIONS; i++) {
+	if (console_sessions[i].conn == pespconn)
+	    return &console_sessions[i];
+    }
+    if (pespconn->type != ESPCONN_TCP || pespconn->proto.tcp == NULL)
+	return NULL;
+    for (i = 0; i < MAX_CON_SESSIONS; i++) {
+	if (console_sessions[i].conn != NULL &&
+	    console_sessions[i].remote_port == pespconn->proto.tcp->remote_port &&
+	    os_memcmp(console_sessions[i].remote_ip, pespconn->proto.tcp->remote_ip, 4) == 0)
+	    return &console_sessions[i];
+    }
+    return NULL;
+}
+
+static struct console_session * ICACHE_FLASH_ATTR console_session_open(struct espconn *pespconn)
+{
+    struct console_session *cs;
+    int i;
+
+    for (i = 0; i < MAX_CON_SESSIONS; i++) {
+	if (console_sessions[i].conn == NULL)
+	    break;
+    }
+    if (i == MAX_CON_SESSIONS)
+	return NULL;
+
+    cs = &console_sessions[i];
+    os_memset(cs, 0, sizeof(struct console_session));
+    cs->rx_buffer = ringbuf_new(MAX_CON_RECV_SIZE);
+    cs->tx_buffer = ringbuf_new(MAX_CON_SEND_SIZE);
+    if (cs->rx_buffer == NULL || cs->tx_buffer == NULL) {
+	if (cs->rx_buffer != NULL) ringbuf_free(&cs->rx_buffer);
+	if (cs->tx_buffer != NULL) ringbuf_free(&cs->tx_buffer);
+	return NULL;
+    }
+    cs->conn = pespconn;
+    os_memcpy(cs->remote_ip, pespconn->proto.tcp->remote_ip, 4);
+    cs->remote_port = pespconn->proto.tcp->remote_port;
+    return cs;
+}
+
+static void ICACHE_FLASH_ATTR console_session_close(struct console_session *cs)
+{
+    ringbuf_free(&cs->rx_buffer);
+    ringbuf_free(&cs->tx_buffer);
+    cs->gen = NULL;
+    cs->conn = NULL;
+}
+
+/*
+ * Starts the next queued command line, once the response of the previous
+ * one was sent, and reopens the receive window if there is room again.
+ * Commands are executed one at a time, so a pasted script can neither
+ * overrun the task queue nor interleave responses.
+ */
+void ICACHE_FLASH_ATTR console_next_command(struct console_session *cs, bool busy)
+{
+    cs->busy = busy;
+
+    if (cs->held && ringbuf_bytes_free(cs->rx_buffer) >= MAX_CON_RECV_HOLD &&
+	cs->cmd_count < MAX_CON_CMD_QUEUE/2) {
+	cs->held = false;
+	espconn_recv_unhold(cs->conn);
+    }
+
+    if (!cs->busy && cs->cmd_count > 0) {
+	cs->busy = true;
+	system_os_post(0, SIG_CONSOLE_RX, (ETSParam) cs->conn);
+    }
+}
+
+static void ICACHE_FLASH_ATTR console_start_output(struct console_session *cs, console_gen_fn gen)
+{
+    cs->gen = gen;
+    cs->gen_index = 0;
+}
+
+static void ICACHE_FLASH_ATTR console_fill(struct console_session *cs)
+{
+    while (cs->gen != NULL && ringbuf_bytes_free(cs->tx_buffer) >= CON_GEN_SPACE) {
+	cs->gen_index = cs->gen(cs->tx_buffer, cs->gen_index);
+	if (cs->gen_index < 0)
+	    cs->gen = NULL;
+    }
+}
+
+/*
+ * Sends the next chunk of the response, at most one MSS. Output from a
+ * generator is refilled on each sent callback, the prompt follows the
+ * last chunk, unless it is a query.
+ */
+void ICACHE_FLASH_ATTR console_send_response(struct console_session *cs)
 {
     char payload[MAX_CON_SEND_SIZE+4];
-    uint16_t len = ringbuf_bytes_used(console_tx_buffer);
+    uint16_t len, chunk;
+    bool last;
+
+    console_fill(cs);
+
+    len = ringbuf_bytes_used(cs->tx_buffer);
+    chunk = espconn_tcp_get_mss();
+    if (chunk > MAX_CON_SEND_SIZE) chunk = MAX_CON_SEND_SIZE;
+    if (len > chunk) len = chunk;
+    ringbuf_memcpy_from(payload, cs->tx_buffer, len);
+
+    last = cs->gen == NULL && ringbuf_is_empty(cs->tx_buffer);
+    if (last && !cs->query) {
+	os_memcpy(&payload[len], "CMD>", 4);
+	len += 4;
+    }
+
+    if (len > 0 && espconn_sent(cs->conn, payload, len) != ESPCONN_OK) {
+	// no sent callback will come, drop the rest of the output
+	cs->gen = NULL;
+	ringbuf_reset(cs->tx_buffer);
+	last = true;
+	console_next_command(cs, false);
+    }
+
+    if (last && cs->disconnect) {
+	cs->disconnect = false;
+	espconn_disconnect(cs->conn);
+    }
+}
+
+static void ICACHE_FLASH_ATTR console_bitrate_done(uint32_t rate, bool confirmed)
+{
+    // persisted with the next save
+    if (confirmed)
+	config.bit_rate = rate;
+}
+
+static void ICACHE_FLASH_ATTR console_autobaud_done(uint32_t rate, bool clean)
+{
+    // the probe ran unattended, so the result is persisted right away,
+    // but without other pending changes of the config
+    if (clean) {
+	config.bit_rate = rate;
+	if (!config_save_bit_rate(rate))
+	    os_printf("Saving the bit rate %d failed\r\n", rate);
+    }
+}
+
+// part of whole in percent, 100 if whole is 0
+static uint32_t ICACHE_FLASH_ATTR console_percent(uint32_t part, uint32_t whole)
+{
+    return whole != 0 ? (uint32_t)((uint64_t)part * 100 / whole) : 100;
+}
+
+static int ICACHE_FLASH_ATTR console_query_stats_gen(ringbuf_t rb, int i)
+{
+    // same set as the metrics exporter, one "name value" per line
+    char response[CON_GEN_SPACE];
+
+    ringbuf_memcpy_into(rb, response, metrics_format_from(response, sizeof(response), METRICS_PLAIN, &i));
+    return i;
+}
+
+static int ICACHE_FLASH_ATTR console_stats_gen(ringbuf_t rb, int i)
+{
+    char response[128];
+
+    response[0] = '\0';
+    switch (i) {
+    case 0:
+	os_sprintf(response, "%d KiB in\r\n%d KiB out\r\n",
+	  (uint32_t)(Bytes_in/1024), (uint32_t)(Bytes_out/1024));
+	break;
+    case 1:
+	os_sprintf(response, "Free mem: %d\r\n", system_get_free_heap_size());
+	break;
+    case 2:
+	router_stats_napt_update();
+	os_sprintf(response, "NAPT: %d TCP %d UDP %d ICMP of %d entries (max %d)\r\n",
+	  nr_active_napt_tcp, nr_active_napt_udp, nr_active_napt_icmp, ip_napt_max, router_stats.napt_hwm);
+	break;
+    case 3:
+	os_sprintf(response, "SLIP: %d packets in %d out\r\n",
+	  router_stats.slip_rx_packets, router_stats.slip_tx_packets);
+	break;
+    case 4:
+	os_sprintf(response, "SLIP errors: %d framing %d rx drops %d tx drops %d no pbuf\r\n",
+	  router_stats.slip_rx_errors, router_stats.slip_rx_dropped,
+	  router_stats.slip_tx_dropped, router_stats.pbuf_alloc_fail);
+	break;
+    case 5:
+	os_sprintf(response, "UART errors: %d rx overflows %d framing %d tx bytes refused\r\n",
+	  router_stats.uart_rx_ovf, router_stats.uart_frm_err, router_stats.uart_tx_full);
+	break;
+    case 6:
+	os_sprintf(response, "MSS clamp: %d SYNs clamped\r\n", mss_clamp_stats.clamped);
+	break;
+    case 7:
+	os_sprintf(response, "Flash: %d sector erases\r\n", flash_log_erases());
+	break;
+    case 8:
+	os_sprintf(response, "Routes: %d of %d, cache %d hits %d misses\r\n",
+	  route_count(), ROUTE_MAX, route_stats.cache_hits, route_stats.cache_misses);
+	break;
+    case 9:
+	os_sprintf(response, "QoS: %d/%d/%d out %d/%d/%d drops (interactive/default/bulk)\r\n",
+	  router_stats.qos_tx[SLIP_TX_INTERACTIVE], router_stats.qos_tx[SLIP_TX_DEFAULT],
+	  router_stats.qos_tx[SLIP_TX_BULK], router_stats.qos_drop[SLIP_TX_INTERACTIVE],
+	  router_stats.qos_drop[SLIP_TX_DEFAULT], router_stats.qos_drop[SLIP_TX_BULK]);
+	break;
+    case 10:
+	os_sprintf(response, "CoDel: %d drops, target %d ms\r\n",
+	  router_stats.codel_drop, codel_target() / 1000);
+	break;
+#ifdef ENABLE_SLIP2
+    case 11:
+	os_sprintf(response, "SLIP2: %d packets in %d out, %d tx drops %d rx overflows %d framing\r\n",
+	  router_stats.slip2_rx_packets, router_stats.slip2_tx_packets, router_stats.slip2_tx_dropped,
+	  router_stats.slip2_rx_ovf, router_stats.slip2_frm_err);
+	break;
+#endif
+#ifdef ENABLE_LZF
+    case 12:
+	if (slip_get_lz())
+	    os_sprintf(response, "Compression: tx %d%% rx %d%% of raw size\r\n",
+	      console_percent(router_stats.lz_tx_comp, router_stats.lz_tx_raw),
+	      console_percent(router_stats.lz_rx_comp, router_stats.lz_rx_raw));
+	break;
+#endif
+#ifdef ENABLE_FASTPATH
+    case 13:
+	os_sprintf(response, "Fast path: %d out %d in %d misses %d flows\r\n",
+	  fastpath_stats.hits, fastpath_stats.hits_in, fastpath_stats.misses, fastpath_flows_used());
+	break;
+#endif
+    case 14:
+	if (config.use_ap) {
+	    os_sprintf(response, "%d Station%s connected to SoftAP\r\n", wifi_softap_get_station_num(),
+	      wifi_softap_get_station_num()==1?"":"s");
+	} else if (connected) {
+	    struct netif *sta_nf = (struct netif *)eagle_lwip_getif(0);
+	    os_sprintf(response, "STA IP: %d.%d.%d.%d GW: %d.%d.%d.%d\r\n", IP2STR(&sta_nf->ip_addr), IP2STR(&sta_nf->gw));
+	} else {
+	    os_sprintf(response, "STA not connected\r\n");
+	}
+	break;
+    case 15:
+	if (!config.use_ap && connected)
+	    os_sprintf(response, "STA RSSI: %d\r\n", wifi_station_get_rssi());
+	break;
+    default:
+	return -1;
+    }
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+    return i+1;
+}
 
-    ringbuf_memcpy_from(payload, console_tx_buffer, len);
-    os_memcpy(&payload[len], "CMD>", 4);
+static int ICACHE_FLASH_ATTR console_portmap_gen(ringbuf_t rb, int i)
+{
+    char response[128];
+    struct portmap_table *p;
+    ip_addr_t i_ip;
+
+    for (; i < ip_portmap_max; i++) {
+	p = &ip_portmap_table[i];
+	if (p->valid) {
+	    i_ip.addr = p->daddr;
+	    os_sprintf(response, "Portmap: %s: " IPSTR ":%d -> "  IPSTR ":%d\r\n",
+	       p->proto==IP_PROTO_TCP?"TCP":p->proto==IP_PROTO_UDP?"UDP":"???",
+	       IP2STR(&my_ip), ntohs(p->mport), IP2STR(&i_ip), ntohs(p->dport));
+	    ringbuf_memcpy_into(rb, response, os_strlen(response));
+	    return i+1;
+	}
+    }
+    return -1;
+}
 
-    if (pespconn != NULL)
-	espconn_sent(pespconn, payload, len+4);
+static int ICACHE_FLASH_ATTR console_route_gen(ringbuf_t rb, int i)
+{
+    char response[80];
+    ip_addr_t ip, mask, gw;
+
+    if (!route_get(i, &ip, &mask, &gw))
+	return -1;
+    os_sprintf(response, "Route: " IPSTR "/" IPSTR " via " IPSTR "\r\n",
+       IP2STR(&ip), IP2STR(&mask), IP2STR(&gw));
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+    return i+1;
 }
 
+#ifdef ENABLE_TRACE
+static uint16_t console_trace_left;
+
+static int ICACHE_FLASH_ATTR console_trace_gen(ringbuf_t rb, int i)
+{
+    char response[64];
+
+    // only the records present at the start, the ISR keeps adding more
+    if (console_trace_left > 0) {
+	console_trace_left -= trace_dump(rb, console_trace_left);
+	return i+1;
+    }
+    os_sprintf(response, "CPU %d MHz\r\n", system_get_cpu_freq());
+    ringbuf_memcpy_into(rb, response, os_strlen(response));
+    return -1;
+}
+#endif
+
 
 #ifdef ALLOW_SCANNING
 struct espconn *scanconn;
+// Results of the last scan, sent by console_scan_gen()
+static struct scan_entry {
+    uint8 ssid[33];
+    uint8 bssid[6];
+    sint8 rssi;
+    uint8 authmode;
+    uint8 channel;
+} *scan_results;
+static int scan_count;
+
+static int ICACHE_FLASH_ATTR console_scan_gen(ringbuf_t rb, int i)
+{
+  char response[128];
+  struct scan_entry *e;
+
+  if (i >= scan_count) {
+    os_free(scan_results);
+    scan_results = NULL;
+    scan_count = 0;
+    return -1;
+  }
+  e = &scan_results[i];
+  os_sprintf(response, "\r(%d,\"%s\",%d,\""MACSTR"\",%d)\r\n",
+             e->authmode, e->ssid, e->rssi, MAC2STR(e->bssid), e->channel);
+  ringbuf_memcpy_into(rb, response, os_strlen(response));
+  return i+1;
+}
+
 void ICACHE_FLASH_ATTR scan_done(void *arg, STATUS status)
 {
-  uint8 ssid[33];
   char response[128];
+  struct bss_info *bss_link;
+  struct console_session *cs;
+  int n;
+
+  if (scan_results != NULL) {
+    os_free(scan_results);
+    scan_results = NULL;
+  }
+  scan_count = 0;
+
+  // the session might be gone meanwhile
+  if ((cs = console_session_find(scanconn)) == NULL)
+    return;
 
   if (status == OK)
   {
-    struct bss_info *bss_link = (struct bss_info *)arg;
+    for (n = 0, bss_link = (struct bss_info *)arg; bss_link != NULL; bss_link = bss_link->next.stqe_next)
+      n++;
+    if (n > 0 && (scan_results = (struct scan_entry *)os_zalloc(n * sizeof(struct scan_entry))) == NULL)
+      n = 0;
 
-    while (bss_link != NULL)
+    // keep a copy, the list is only valid during the callback
+    for (bss_link = (struct bss_info *)arg; bss_link != NULL && scan_count < n; bss_link = bss_link->next.stqe_next)
     {
-      ringbuf_memcpy_into(console_tx_buffer, "\r", 1);
+      struct scan_entry *e = &scan_results[scan_count++];
 
-      os_memset(ssid, 0, 33);
-      if (os_strlen(bss_link->ssid) <= 32)
-      {
-        os_memcpy(ssid, bss_link->ssid, os_strlen(bss_link->ssid));
-      }
-      else
-      {
-        os_memcpy(ssid, bss_link->ssid, 32);
-      }
-      os_sprintf(response, "(%d,\"%s\",%d,\""MACSTR"\",%d)\r\n",
-                 bss_link->authmode, ssid, bss_link->rssi,
-                 MAC2STR(bss_link->bssid),bss_link->channel);
-      ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-      bss_link = bss_link->next.stqe_next;
+      os_memcpy(e->ssid, bss_link->ssid, os_strlen(bss_link->ssid) <= 32 ? os_strlen(bss_link->ssid) : 32);
+      os_memcpy(e->bssid, bss_link->bssid, 6);
+      e->rssi = bss_link->rssi;
+      e->authmode = bss_link->authmode;
+      e->channel = bss_link->channel;
     }
+    console_start_output(cs, console_scan_gen);
   }
   else
   {
      os_sprintf(response, "scan fail !!!\r\n");
-     ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+     ringbuf_memcpy_into(cs->tx_buffer, response, os_strlen(response));
   }
   system_os_post(0, SIG_CONSOLE_TX, (ETSParam) scanconn);
 }
 #endif
 
 
-void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
+void ICACHE_FLASH_ATTR console_handle_command(struct console_session *cs)
 {
-    char cmd_line[256];
+    char cmd_line[MAX_CON_CMD_SIZE];
     char response[256];
     char *tokens[6];
+    struct espconn *pespconn = cs->conn;
+    ringbuf_t console_tx_buffer = cs->tx_buffer;
 
     int bytes_count, nTokens, i, j;
 
-    bytes_count = ringbuf_bytes_used(console_rx_buffer);
-    ringbuf_memcpy_from(cmd_line, console_rx_buffer, bytes_count);
+    if (cs->cmd_count == 0) {
+	cs->busy = false;
+	return;
+    }
+    bytes_count = cs->cmd_len[cs->cmd_head];
+    ringbuf_memcpy_from(cmd_line, cs->rx_buffer, bytes_count);
+    cs->cmd_head = (cs->cmd_head + 1) % MAX_CON_CMD_QUEUE;
+    cs->cmd_count--;
 
     for (i=j=0; i<bytes_count; i++) {
 	if (cmd_line[i] != 8) {
@@ -215,16 +648,55 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 	goto command_handled;
     }
 
+    if (tokens[0][0] == '?')
+    {
+	// Non-interactive query for monitoring: one "name value" per line
+	// after an empty line, no prompt, the connection is closed afterwards
+	cs->query = cs->disconnect = true;
+	ringbuf_memcpy_into(console_tx_buffer, "\r\n", 2);
+	if (strcmp(tokens[0], "?stats") == 0) {
+	    // longer than the tx buffer, it is streamed
+	    console_start_output(cs, console_query_stats_gen);
+	} else if (strcmp(tokens[0], "?version") == 0) {
+	    os_sprintf(response, "version %s\r\n", ESP_SLIP_ROUTER_VERSION);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	} else {
+	    os_sprintf(response, "error unknown query\r\n");
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	}
+	goto command_handled;
+    }
+
     if (strcmp(tokens[0], "help") == 0)
     {
-        os_sprintf(response, "show [stats]\r\nset [ssid|password|auto_connect|addr|addr_peer|speed|bitrate] <val>\r\n");
+        os_sprintf(response, "show [stats]|stats reset\r\nset [ssid|password|auto_connect|addr|addr_peer|speed|bitrate|flowcontrol|cslip|compress|qos] <val>\r\n");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
         os_sprintf(response, "set [use_ap|ap_ssid|ap_password|ap_channel|ap_open|ssid_hidden|max_clients|dns] <val>\r\n");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-        os_sprintf(response, "quit|save|reset [factory]|lock|unlock <password>\r\n");
+        os_sprintf(response, "quit|save|reset [factory]|lock|unlock <password>|autobaud\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        os_sprintf(response, "set [nat_entries|portmap_entries|tcp_timeout|udp_timeout|mss_clamp] <val>\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#ifdef ENABLE_METRICS
+        os_sprintf(response, "set [metrics_interval|metrics_collector|metrics_port] <val>\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
+#ifdef ENABLE_SLIP2
+        os_sprintf(response, "set [slip2_addr|slip2_nat] <val>\r\n");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
         os_sprintf(response, "portmap [add|remove] [TCP|UDP] <ext_port> <int_addr> <int_port>\r\n");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        os_sprintf(response, "route [add <net> <mask> <gw>|del <net> <mask>|show]\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#ifdef ENABLE_TRACE
+        os_sprintf(response, "trace [dump|clear]\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
+#ifdef ENABLE_BENCH
+        os_sprintf(response, "bench [discard|echo|loopback [secs]|stop|show]\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
 #ifdef ALLOW_SCANNING
         os_sprintf(response, "scan");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
@@ -235,10 +707,6 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 
     if (strcmp(tokens[0], "show") == 0)
     {
-      int16_t i;
-      struct portmap_table *p;
-      ip_addr_t i_ip;
-
       if (nTokens == 1) {
 	os_sprintf(response, "ESP SLIP Router %s (build: %s)\r\n", ESP_SLIP_ROUTER_VERSION, __TIMESTAMP__);
 	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
@@ -267,58 +735,159 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
         os_sprintf(response, "Clock speed: %d\r\n", config.clock_speed);
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-	os_sprintf(response, "Serial bit rate: %d\r\n", config.bit_rate);
+	os_sprintf(response, "Serial bit rate: %d%s Flow control: %s\r\n", g_bit_rate,
+	  bitrate_autobaud_running() ? " (autobaud)" :
+	  bitrate_state() != BITRATE_IDLE ? " (switching)" : "",
+	  flow_control_names[config.flow_control & 3]);
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	os_sprintf(response, "Serial protocol: %s%s\r\n", slip_get_cslip() ? "CSLIP" : "SLIP",
+#ifdef ENABLE_LZF
+	  slip_get_lz() ? " compressed" :
+#endif
+	  "");
 	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	os_sprintf(response, "QoS: %s\r\n", slip_get_qos() ? "on" : "off");
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#ifdef ENABLE_SLIP2
+	os_sprintf(response, "SLIP2: " IPSTR "/24 at %d (GPIO %d/%d), NAT %s%s\r\n",
+	  IP2STR(&config.slip2_addr), SLIP2_BIT_RATE, SLIP2_RX_GPIO, SLIP2_TX_GPIO,
+	  config.slip2_nat ? "on" : "off", slip2_netif() == NULL ? ", down" : "");
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
 
-	for (i = 0; i<IP_PORTMAP_MAX; i++) {
-	    p = &ip_portmap_table[i];
-	    if(p->valid) {
-		i_ip.addr = p->daddr;
-		os_sprintf(response, "Portmap: %s: " IPSTR ":%d -> "  IPSTR ":%d\r\n",
-		   p->proto==IP_PROTO_TCP?"TCP":p->proto==IP_PROTO_UDP?"UDP":"???",
-		   IP2STR(&my_ip), ntohs(p->mport), IP2STR(&i_ip), ntohs(p->dport));
-		ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-	    }
+	os_sprintf(response, "NAPT: %d entries, %d portmaps, timeouts TCP: %ds UDP: %ds\r\n",
+	  ip_napt_max, ip_portmap_max, ip_napt_tcp_timeout/1000, ip_napt_udp_timeout/1000);
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	os_sprintf(response, "MSS clamp: %d%s\r\n", mss_clamp_get(), config.mss_clamp == 0 ? " (from MTU)" : "");
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#ifdef ENABLE_METRICS
+	if (config.metrics_interval != 0) {
+	    os_sprintf(response, "Metrics: port %d, push every %ds to " IPSTR ":%d\r\n",
+	      METRICS_SERVER_PORT, config.metrics_interval,
+	      IP2STR(&config.metrics_collector), config.metrics_port);
+	} else {
+	    os_sprintf(response, "Metrics: port %d, push off\r\n", METRICS_SERVER_PORT);
 	}
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+#endif
+
+	// the portmap list can be long, it is streamed
+	console_start_output(cs, console_portmap_gen);
 
 	goto command_handled;
       }
 
       if (nTokens == 2 && strcmp(tokens[1], "stats") == 0) {
-
-	   os_sprintf(response, "%d KiB in\r\n%d KiB out\r\n",
-         (uint32_t)(Bytes_in/1024), (uint32_t)(Bytes_out/1024));
-	   ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-
-	   os_sprintf(response, "Free mem: %d\r\n", system_get_free_heap_size());
-	   ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-
-	   if (config.use_ap) {
-	     os_sprintf(response, "%d Station%s connected to SoftAP\r\n", wifi_softap_get_station_num(),
-		  wifi_softap_get_station_num()==1?"":"s");
-	     ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-	   } else {
-	     if (connected) {
-		struct netif *sta_nf = (struct netif *)eagle_lwip_getif(0);
-		os_sprintf(response, "STA IP: %d.%d.%d.%d GW: %d.%d.%d.%d\r\n", IP2STR(&sta_nf->ip_addr), IP2STR(&sta_nf->gw));
-		ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-		os_sprintf(response, "STA RSSI: %d\r\n", wifi_station_get_rssi());
-		ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-	     } else {
-		os_sprintf(response, "STA not connected\r\n");
-		ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
-	     }
-	   }
-	   goto command_handled;
+	// more than a tx buffer with all options, it is streamed
+	console_start_output(cs, console_stats_gen);
+	goto command_handled;
       }
     }
 
+    if (strcmp(tokens[0], "stats") == 0)
+    {
+	if (nTokens != 2 || strcmp(tokens[1], "reset") != 0) {
+	    os_sprintf(response, INVALID_ARG);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	    goto command_handled;
+	}
+	router_stats_reset();
+        os_sprintf(response, "Stats cleared\r\n");
+        ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        goto command_handled;
+    }
+
+#ifdef ENABLE_TRACE
+    if (strcmp(tokens[0], "trace") == 0)
+    {
+	if (nTokens != 2) {
+            os_sprintf(response, INVALID_NUMARGS);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	    goto command_handled;
+	}
+	if (strcmp(tokens[1], "clear") == 0) {
+	    trace_clear();
+	    os_sprintf(response, "Trace cleared\r\n");
+	} else if (strcmp(tokens[1], "dump") == 0) {
+	    // ccount +cycles since the previous record, name, arg
+	    console_trace_left = trace_count();
+	    console_start_output(cs, console_trace_gen);
+	    os_sprintf(response, "%d records\r\n", console_trace_left);
+	} else {
+	    os_sprintf(response, INVALID_ARG);
+	}
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        goto command_handled;
+    }
+#endif
+
+#ifdef ENABLE_BENCH
+    if (strcmp(tokens[0], "bench") == 0)
+    {
+	BENCH_MODE mode;
+
+	if (nTokens < 2 || nTokens > 3) {
+            os_sprintf(response, INVALID_NUMARGS);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	    goto command_handled;
+	}
+
+	if (strcmp(tokens[1], "show") == 0) {
+	    bench_report(console_tx_buffer);
+	    goto command_handled;
+	}
+	if (strcmp(tokens[1], "stop") == 0) {
+	    bench_stop();
+	    bench_report(console_tx_buffer);
+	    goto command_handled;
+	}
+
+	if (strcmp(tokens[1], "discard") == 0) mode = BENCH_DISCARD;
+	else if (strcmp(tokens[1], "echo") == 0) mode = BENCH_ECHO;
+	else if (strcmp(tokens[1], "loopback") == 0) mode = BENCH_LOOPBACK;
+	else {
+	    os_sprintf(response, INVALID_ARG);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	    goto command_handled;
+	}
+
+	bench_start(mode, nTokens == 3 ? atoi(tokens[2]) : 0);
+	if (mode == BENCH_LOOPBACK)
+	    os_sprintf(response, "SLIP loopback for %d s\r\n",
+		nTokens == 3 && atoi(tokens[2]) > 0 ? atoi(tokens[2]) : BENCH_LOOPBACK_SECS);
+	else
+	    os_sprintf(response, "%s sink on UDP/TCP port %d\r\n", tokens[1],
+		mode == BENCH_DISCARD ? BENCH_DISCARD_PORT : BENCH_ECHO_PORT);
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        goto command_handled;
+    }
+#endif
+
+    if (strcmp(tokens[0], "autobaud") == 0)
+    {
+	if (config.locked) {
+	    os_sprintf(response, INVALID_LOCKED);
+	} else if (bitrate_autobaud(console_autobaud_done)) {
+	    os_sprintf(response, "Autobaud started, step the host through the same rates\r\n");
+	} else {
+	    os_sprintf(response, "Bit rate switch in progress\r\n");
+	}
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        goto command_handled;
+    }
+
     if (strcmp(tokens[0], "save") == 0)
     {
-        config_save(&config);
-	// also save the portmap table
-	blob_save(0, (uint32_t *)ip_portmap_table, sizeof(struct portmap_table) * IP_PORTMAP_MAX);
-        os_sprintf(response, "Config saved\r\n");
+    bool ok;
+
+        ok = config_save(&config);
+	// also save the portmap table and the routes
+	ok = blob_save(0, (uint32_t *)ip_portmap_table, sizeof(struct portmap_table) * ip_portmap_max) && ok;
+	ok = route_save() && ok;
+	if (ok)
+	    os_sprintf(response, "Config saved\r\n");
+	else
+	    os_sprintf(response, "Save failed, the flash store is full\r\n");
         ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
         goto command_handled;
     }
@@ -338,7 +907,9 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
            config_load_default(&config);
            config_save(&config);
 	   // clear saved portmap table
-	   blob_zero(0, sizeof(struct portmap_table) * IP_PORTMAP_MAX);
+	   blob_zero(0, sizeof(struct portmap_table) * ip_portmap_max);
+	   blob_zero(WIFI_CACHE_BLOB, sizeof(wifi_cache_t));
+	   blob_zero(ROUTE_BLOB, sizeof(struct route_entry) * ROUTE_MAX);
 	}
         os_printf("Restarting ... \r\n");
 	system_restart();
@@ -347,7 +918,7 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 
     if (strcmp(tokens[0], "quit") == 0)
     {
-	remote_console_disconnect = 1;
+	cs->disconnect = true;
         goto command_handled;
     }
 
@@ -407,6 +978,53 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
         goto command_handled;
     }
 
+    if (strcmp(tokens[0], "route") == 0)
+    {
+    ip_addr_t ip, mask, gw;
+    bool ok;
+
+        if (nTokens == 2 && strcmp(tokens[1],"show") == 0)
+        {
+	    console_start_output(cs, console_route_gen);
+	    goto command_handled;
+        }
+
+        if (config.locked)
+        {
+            os_sprintf(response, INVALID_LOCKED);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+            goto command_handled;
+        }
+
+        if (nTokens == 5 && strcmp(tokens[1],"add") == 0)
+        {
+	    ip.addr = ipaddr_addr(tokens[2]);
+	    mask.addr = ipaddr_addr(tokens[3]);
+	    gw.addr = ipaddr_addr(tokens[4]);
+	    ok = route_add(ip, mask, gw);
+        }
+        else if (nTokens == 4 && strcmp(tokens[1],"del") == 0)
+        {
+	    ip.addr = ipaddr_addr(tokens[2]);
+	    mask.addr = ipaddr_addr(tokens[3]);
+	    ok = route_del(ip, mask);
+        }
+        else
+        {
+            os_sprintf(response, INVALID_NUMARGS);
+	    ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+	    goto command_handled;
+        }
+
+	if (ok) {
+	    os_sprintf(response, "Route %s\r\n", tokens[1][0] == 'a' ? "set" : "deleted");
+	} else {
+	    os_sprintf(response, "Route failed\r\n");
+	}
+	ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+        goto command_handled;
+    }
+
     if (strcmp(tokens[0], "lock") == 0)
     {
 	config.locked = 1;
@@ -595,8 +1213,186 @@ void ICACHE_FLASH_ATTR console_handle_command(struct espconn *pespconn)
 
             if (strcmp(tokens[1],"bitrate") == 0)
             {
-                config.bit_rate = atoi(tokens[2]);
-                os_sprintf(response, "Bitrate will be %d after save & reset.\r\n", config.bit_rate);
+		uint32_t rate = atoi(tokens[2]);
+		// switched live, the config follows once the host confirmed it
+		if (bitrate_autobaud_running() || bitrate_state() != BITRATE_IDLE) {
+		    os_sprintf(response, "Bit rate switch to %d in progress\r\n", bitrate_pending());
+		} else if (bitrate_switch(rate, BITRATE_CONFIRM_MS, console_bitrate_done)) {
+		    os_sprintf(response, "Switching bit rate to %d, back to %d if the host does not follow within %ds\r\n",
+		      rate, g_bit_rate, BITRATE_CONFIRM_MS/1000);
+		} else {
+		    os_sprintf(response, "Invalid bit rate (%d-%d)\r\n", BITRATE_MIN, BITRATE_MAX);
+		}
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+#ifdef ENABLE_SLIP2
+            if (strcmp(tokens[1],"slip2_addr") == 0)
+            {
+                config.slip2_addr.addr = ipaddr_addr(tokens[2]);
+                os_sprintf(response, "SLIP2 address set to %d.%d.%d.%d/24 after save & reset\r\n",
+			IP2STR(&config.slip2_addr));
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"slip2_nat") == 0)
+            {
+                config.slip2_nat = atoi(tokens[2]) != 0;
+                os_sprintf(response, "SLIP2 NAT %s after save & reset\r\n", config.slip2_nat ? "on" : "off");
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+#endif
+
+            if (strcmp(tokens[1],"nat_entries") == 0)
+            {
+#if IP_NAPT_DYNAMIC
+		uint16_t n = atoi(tokens[2]);
+		if (n >= 16) {
+		    config.nat_entries = n;
+		    os_sprintf(response, "NAPT table will have %d entries after save & reset.\r\n", n);
+		} else {
+		    os_sprintf(response, "Invalid val (>= 16)\r\n");
+		}
+#else
+		os_sprintf(response, "NAPT table is fixed to %d entries in this build\r\n", ip_napt_max);
+#endif
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"portmap_entries") == 0)
+            {
+#if IP_NAPT_DYNAMIC
+		uint16_t n = atoi(tokens[2]);
+		// the portmap table shares one flash log sector with the
+		// config, the wifi cache and the routes
+		uint16_t max = FLASH_LOG_ROOM(FLASH_LOG_REC_SIZE(sizeof(sysconfig_t)) +
+		    FLASH_LOG_REC_SIZE(sizeof(wifi_cache_t)) +
+		    FLASH_LOG_REC_SIZE(sizeof(struct route_entry) * ROUTE_MAX)) / sizeof(struct portmap_table);
+		if (max > 255)
+		    max = 255;
+		if (n >= 1 && n <= max) {
+		    config.portmap_entries = n;
+		    os_sprintf(response, "Portmap table will have %d entries after save & reset.\r\n", n);
+		} else {
+		    os_sprintf(response, "Invalid val (1-%d)\r\n", max);
+		}
+#else
+		os_sprintf(response, "Portmap table is fixed to %d entries in this build\r\n", ip_portmap_max);
+#endif
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"tcp_timeout") == 0)
+            {
+                config.tcp_timeout = atoi(tokens[2]);
+		ip_napt_set_tcp_timeout(config.tcp_timeout != 0 ?
+		  config.tcp_timeout : IP_NAPT_TIMEOUT_MS_TCP/1000);
+                os_sprintf(response, "NAPT TCP timeout set to %ds\r\n", ip_napt_tcp_timeout/1000);
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"udp_timeout") == 0)
+            {
+                config.udp_timeout = atoi(tokens[2]);
+		ip_napt_set_udp_timeout(config.udp_timeout != 0 ?
+		  config.udp_timeout : IP_NAPT_TIMEOUT_MS_UDP/1000);
+                os_sprintf(response, "NAPT UDP timeout set to %ds\r\n", ip_napt_udp_timeout/1000);
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+#ifdef ENABLE_METRICS
+            if (strcmp(tokens[1],"metrics_interval") == 0)
+            {
+                config.metrics_interval = atoi(tokens[2]);
+		metrics_set_push(config.metrics_interval, &config.metrics_collector, config.metrics_port);
+                os_sprintf(response, "Metrics interval set\r\n");
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"metrics_collector") == 0)
+            {
+                config.metrics_collector.addr = ipaddr_addr(tokens[2]);
+		metrics_set_push(config.metrics_interval, &config.metrics_collector, config.metrics_port);
+                os_sprintf(response, "Metrics collector set to " IPSTR "\r\n", IP2STR(&config.metrics_collector));
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"metrics_port") == 0)
+            {
+                config.metrics_port = atoi(tokens[2]);
+		metrics_set_push(config.metrics_interval, &config.metrics_collector, config.metrics_port);
+                os_sprintf(response, "Metrics port set to %d\r\n", config.metrics_port);
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+#endif
+
+#ifdef ENABLE_LZF
+            if (strcmp(tokens[1],"compress") == 0)
+            {
+		// takes effect immediately, the host has to switch its mode too
+		config.compress = atoi(tokens[2]) != 0;
+		slip_set_lz(config.compress);
+		os_sprintf(response, "Compressed link mode %s\r\n", config.compress ? "on" : "off");
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+#endif
+
+            if (strcmp(tokens[1],"cslip") == 0)
+            {
+		// takes effect immediately, the host has to switch its mode too
+		config.cslip = atoi(tokens[2]) != 0;
+		slip_set_cslip(config.cslip);
+		os_sprintf(response, "CSLIP %s\r\n", config.cslip ? "on" : "off");
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"qos") == 0)
+            {
+		// applies to the next packet, queued ones are still sent
+		config.qos = atoi(tokens[2]) != 0;
+		slip_set_qos(config.qos);
+		os_sprintf(response, "QoS %s\r\n", config.qos ? "on" : "off");
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"mss_clamp") == 0)
+            {
+		uint16_t mss = atoi(tokens[2]);
+		if (mss == 0 || mss >= MSS_CLAMP_MIN) {
+		    // applies to the next SYN
+		    config.mss_clamp = mss;
+		    mss_clamp_set(mss);
+		    os_sprintf(response, "MSS clamp set to %d\r\n", mss_clamp_get());
+		} else {
+		    os_sprintf(response, "Invalid MSS (0 for MTU based, min %d)\r\n", MSS_CLAMP_MIN);
+		}
+                ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
+                goto command_handled;
+            }
+
+            if (strcmp(tokens[1],"flowcontrol") == 0)
+            {
+		uint8_t fc = atoi(tokens[2]);
+		if (fc <= 3) {
+		    // takes effect immediately, the RX threshold follows the bit rate
+		    config.flow_control = fc;
+		    uart0_set_flow_ctrl(fc);
+		    os_sprintf(response, "Flow control set to %s\r\n", flow_control_names[fc]);
+		} else {
+		    os_sprintf(response, "Invalid flow control (0 none, 1 RTS, 2 CTS, 3 both)\r\n");
+		}
                 ringbuf_memcpy_into(console_tx_buffer, response, os_strlen(response));
                 goto command_handled;
             }
@@ -618,28 +1414,96 @@ static void ICACHE_FLASH_ATTR tcp_client_recv_cb(void *arg,
                                                  unsigned short length)
 {
     struct espconn *pespconn = (struct espconn *)arg;
-    int            index;
-    uint8_t         ch;
+    struct console_session *cs = console_session_find(pespconn);
+    char *end = data + length;
+    char *nl;
+    uint16_t seg;
+    char *msg;
+
+    if (cs == NULL)
+	return;
+
+    while (data < end) {
+	// find the end of the line
+	for (nl = data; nl < end && *nl != '\n'; nl++);
+	seg = nl - data + (nl < end);
+
+	if (cs->line_len + seg > MAX_CON_CMD_SIZE - 1)
+	    cs->line_drop = true;
+
+	if (nl == end) {
+	    // incomplete, keep it until the rest arrives
+	    if (!cs->line_drop) {
+		os_memcpy(&cs->line[cs->line_len], data, seg);
+		cs->line_len += seg;
+	    }
+	    break;
+	}
 
-    for (index=0; index <length; index++)
-    {
-        ch = *(data+index);
-	ringbuf_memcpy_into(console_rx_buffer, &ch, 1);
+	msg = NULL;
+	if (cs->line_drop) {
+	    msg = "Command line too long\r\n";
+	} else if (cs->cmd_count >= MAX_CON_CMD_QUEUE ||
+	    ringbuf_bytes_free(cs->rx_buffer) < cs->line_len + seg) {
+	    msg = "Console input overflow, line dropped\r\n";
+	} else {
+	    // one copy per line into the command queue
+	    if (cs->line_len > 0)
+		ringbuf_memcpy_into(cs->rx_buffer, cs->line, cs->line_len);
+	    ringbuf_memcpy_into(cs->rx_buffer, data, seg);
+	    cs->cmd_len[(cs->cmd_head + cs->cmd_count) % MAX_CON_CMD_QUEUE] =
+		cs->line_len + seg;
+	    cs->cmd_count++;
+	}
+	if (msg != NULL)
+	    ringbuf_memcpy_into(cs->tx_buffer, msg, os_strlen(msg));
 
-        // If a complete commandline is received, then signal the main
-        // task that command is available for processing
-        if (ch == '\n')
-            system_os_post(0, SIG_CONSOLE_RX, (ETSParam) arg);
+	cs->line_len = 0;
+	cs->line_drop = false;
+	data += seg;
     }
 
-    *(data+length) = 0;
+    // close the receive window while another segment might not fit
+    if (!cs->held && (ringbuf_bytes_free(cs->rx_buffer) < MAX_CON_RECV_HOLD ||
+	cs->cmd_count >= MAX_CON_CMD_QUEUE/2)) {
+	cs->held = true;
+	espconn_recv_hold(pespconn);
+    }
+
+    console_next_command(cs, cs->busy);
+}
+
+static void ICACHE_FLASH_ATTR tcp_client_sent_cb(void *arg)
+{
+    struct console_session *cs = console_session_find((struct espconn *)arg);
+
+    if (cs == NULL)
+	return;
+
+    // more output streaming, send the next chunk
+    if (cs->gen != NULL || !ringbuf_is_empty(cs->tx_buffer)) {
+	console_send_response(cs);
+	return;
+    }
+
+    // the response is out, continue with the next queued command
+    console_next_command(cs, false);
 }
 
 
 static void ICACHE_FLASH_ATTR tcp_client_discon_cb(void *arg)
 {
     os_printf("tcp_client_discon_cb(): client disconnected\n");
-    struct espconn *pespconn = (struct espconn *)arg;
+    struct console_session *cs = console_session_find((struct espconn *)arg);
+
+    if (cs != NULL)
+	console_session_close(cs);
+}
+
+static void ICACHE_FLASH_ATTR tcp_client_recon_cb(void *arg, sint8 err)
+{
+    // connection aborted, there will be no disconnect callback
+    tcp_client_discon_cb(arg);
 }
 
 
@@ -648,19 +1512,28 @@ static void ICACHE_FLASH_ATTR tcp_client_connected_cb(void *arg)
 {
     char payload[128];
     struct espconn *pespconn = (struct espconn *)arg;
+    struct console_session *cs;
 
     os_printf("tcp_client_connected_cb(): Client connected\r\n");
 
-    //espconn_regist_sentcb(pespconn,     tcp_client_sent_cb);
+    if ((cs = console_session_open(pespconn)) == NULL) {
+	os_sprintf(payload, "Too many console sessions\r\n");
+	espconn_sent(pespconn, payload, os_strlen(payload));
+	espconn_disconnect(pespconn);
+	return;
+    }
+
+    espconn_regist_sentcb(pespconn,     tcp_client_sent_cb);
     espconn_regist_disconcb(pespconn,   tcp_client_discon_cb);
+    espconn_regist_reconcb(pespconn,    tcp_client_recon_cb);
     espconn_regist_recvcb(pespconn,     tcp_client_recv_cb);
     espconn_regist_time(pespconn,  300, 1);  // Specific to console only
 
-    ringbuf_reset(console_rx_buffer);
-    ringbuf_reset(console_tx_buffer);
-
+    // commands wait until the prompt is out
+    cs->busy = true;
     os_sprintf(payload, "CMD>");
-    espconn_sent(pespconn, payload, os_strlen(payload));
+    if (espconn_sent(pespconn, payload, os_strlen(payload)) != ESPCONN_OK)
+	cs->busy = false;
 }
 #endif
 
@@ -684,26 +1557,35 @@ static void ICACHE_FLASH_ATTR user_procTask(os_event_t *events)
 	break;
 
     case UART0_SIGNAL:
-	// We get this every time the UART0 receive buffer has been tranfered to the lwip stack
-	// Check, whether it is a complete IP packet
-	slipif_process_rxqueue(&sl_netif);
+	// We get this every time the UART0 receive buffer has been decoded into the
+	// SLIP receive arena, hand the complete IP packets to the lwip stack
+	TRACE(TRACE_TASK_RX, 0);
+	slip_process_rxqueue(&sl_netif);
+	router_stats_napt_update();
+	TRACE(TRACE_TASK_RX_END, 0);
+
+	break;
 
+    case UART0_TX_SIGNAL:
+	// Space in the UART0 send buffer, send packets held back by slip_output()
+	slip_output_resume(&sl_netif);
 	break;
 
     case SIG_CONSOLE_TX:
         {
-            struct espconn *pespconn = (struct espconn *) events->par;
-            console_send_response(pespconn);
+            struct console_session *cs = console_session_find((struct espconn *) events->par);
 
-	    if (pespconn != 0 && remote_console_disconnect) espconn_disconnect(pespconn);
-	    remote_console_disconnect = 0;
+            if (cs != NULL)
+                console_send_response(cs);
         }
         break;
 
     case SIG_CONSOLE_RX:
         {
-            struct espconn *pespconn = (struct espconn *) events->par;
-            console_handle_command(pespconn);
+            struct console_session *cs = console_session_find((struct espconn *) events->par);
+
+            if (cs != NULL)
+                console_handle_command(cs);
         }
         break;
 
@@ -714,6 +1596,46 @@ static void ICACHE_FLASH_ATTR user_procTask(os_event_t *events)
     }
 }
 
+/* Saves BSSID and channel of a successful connect, if they changed */
+static void ICACHE_FLASH_ATTR wifi_cache_update(uint8_t *bssid, uint8_t channel)
+{
+    if (wifi_cache.magic_number == WIFI_CACHE_MAGIC &&
+	os_strncmp(wifi_cache.ssid, config.ssid, sizeof(wifi_cache.ssid)) == 0 &&
+	os_memcmp(wifi_cache.bssid, bssid, sizeof(wifi_cache.bssid)) == 0 &&
+	wifi_cache.channel == channel)
+	return;
+
+    os_memset(&wifi_cache, 0, sizeof(wifi_cache));
+    wifi_cache.magic_number = WIFI_CACHE_MAGIC;
+    os_memcpy(wifi_cache.ssid, config.ssid, sizeof(wifi_cache.ssid));
+    os_memcpy(wifi_cache.bssid, bssid, sizeof(wifi_cache.bssid));
+    wifi_cache.channel = channel;
+    blob_save(WIFI_CACHE_BLOB, (uint32_t *)&wifi_cache, sizeof(wifi_cache));
+}
+
+static void ICACHE_FLASH_ATTR wifi_station_conf(struct station_config *stationConf)
+{
+    os_memset(stationConf, 0, sizeof(struct station_config));
+    os_sprintf(stationConf->ssid, "%s", config.ssid);
+    os_sprintf(stationConf->password, "%s", config.password);
+}
+
+/* The cached AP was not found in time, connect again with a scan */
+static void ICACHE_FLASH_ATTR wifi_fast_connect_fail(void *arg)
+{
+struct station_config stationConf;
+
+    if (!wifi_fast_connect)
+	return;
+    wifi_fast_connect = false;
+    os_printf("No connect to the cached AP, scanning\r\n");
+
+    wifi_station_disconnect();
+    wifi_station_conf(&stationConf);
+    wifi_station_set_config_current(&stationConf);
+    wifi_station_connect();
+}
+
 /* Callback called when the connection state of the module with an Access Point changes */
 void ICACHE_FLASH_ATTR wifi_handle_event_cb(System_Event_t *evt)
 {
@@ -724,11 +1646,22 @@ int i;
     {
     case EVENT_STAMODE_CONNECTED:
         os_printf("connect to ssid %s, channel %d\n", evt->event_info.connected.ssid, evt->event_info.connected.channel);
+	wifi_fast_connect = false;
+	os_timer_disarm(&wifi_fast_timer);
+	wifi_cache_update(evt->event_info.connected.bssid, evt->event_info.connected.channel);
         break;
 
     case EVENT_STAMODE_DISCONNECTED:
         os_printf("disconnect from ssid %s, reason %d\n", evt->event_info.disconnected.ssid, evt->event_info.disconnected.reason);
 	    connected = false;
+	    if (wifi_fast_connect) {
+		// not from the SDK callback itself
+		os_timer_disarm(&wifi_fast_timer);
+		os_timer_arm(&wifi_fast_timer, 10, 0);
+	    }
+#ifdef ENABLE_FASTPATH
+	    fastpath_flush();
+#endif
 #ifdef STATUS_LED
         // Stop LED-off timer
         os_timer_disarm(&ptimer);
@@ -756,11 +1689,17 @@ int i;
 	    connected = true;
 
 	    // Update any predefined portmaps to the new IP addr
-        for (i = 0; i<IP_PORTMAP_MAX; i++) {
+        for (i = 0; i<ip_portmap_max; i++) {
 	        if(ip_portmap_table[i].valid) {
 	            ip_portmap_table[i].maddr = my_ip.addr;
 	        }
 	    }
+
+#ifdef ENABLE_FASTPATH
+	    // Learn flows on the STA interface, old ones used the old address
+	    fastpath_flush();
+	    fastpath_hook_netif((struct netif *)eagle_lwip_getif(0));
+#endif
         break;
 
         // Post a Server Start message as the IP has been acquired to Task with priority 0
@@ -778,11 +1717,26 @@ void ICACHE_FLASH_ATTR user_set_station_config(void)
     char hostname[40];
 
     /* Setup AP credentials */
-    stationConf.bssid_set = 0;
-    os_sprintf(stationConf.ssid, "%s", config.ssid);
-    os_sprintf(stationConf.password, "%s", config.password);
+    wifi_station_conf(&stationConf);
     wifi_station_set_config(&stationConf);
 
+    // With a cached AP for this SSID, the boot connect goes to its BSSID
+    // and channel without a scan. Only the current config gets the BSSID,
+    // the saved one is used by the fallback and by the SDK reconnects
+    if (config.auto_connect && wifi_cache.magic_number == WIFI_CACHE_MAGIC &&
+	os_strncmp(wifi_cache.ssid, config.ssid, sizeof(wifi_cache.ssid)) == 0 &&
+	wifi_cache.channel >= 1 && wifi_cache.channel <= 14) {
+	stationConf.bssid_set = 1;
+	os_memcpy(stationConf.bssid, wifi_cache.bssid, sizeof(stationConf.bssid));
+	wifi_set_channel(wifi_cache.channel);
+	wifi_station_set_config_current(&stationConf);
+
+	wifi_fast_connect = true;
+	os_timer_disarm(&wifi_fast_timer);
+	os_timer_setfn(&wifi_fast_timer, wifi_fast_connect_fail, NULL);
+	os_timer_arm(&wifi_fast_timer, WIFI_FAST_CONNECT_MS, 0);
+    }
+
     wifi_set_event_handler_cb(wifi_handle_event_cb);
 
     wifi_station_set_auto_connect(config.auto_connect != 0);
@@ -827,14 +1781,28 @@ softuart_write_char(char c)
 LOCAL void ICACHE_FLASH_ATTR
 void_write_char(char c) {}
 
+#ifdef ENABLE_HAYES
+// Online data from the Hayes parser, AT commands and escape chars that
+// are held back or swallowed are not counted
+LOCAL void
+hayes_data_rx(uint8_t *data, uint16_t len)
+{
+    slip_rx_bytes(data, len);
+    Bytes_out += len;
+}
+#endif
+
 LOCAL void
-write_to_pbuf(char c)
+write_block_to_pbuf(uint8 *data, uint16 len)
 {
+    // Called once per RX interrupt with the whole FIFO content
 #ifdef ENABLE_HAYES
-    if(h_handler(c, slipif_received_byte, &sl_netif, &Bytes_out)) return;
+    // Command mode and the +++ escape, the rest goes to the SLIP decoder
+    h_rx_block(data, len, hayes_data_rx);
+#else
+    slip_rx_bytes(data, len);
+    Bytes_out += len;
 #endif
-    slipif_received_byte(&sl_netif, c);
-    Bytes_out++;
 #ifdef STATUS_LED
     // Turn LED on on traffic
     GPIO_OUTPUT_SET (STATUS_LED, 0);
@@ -859,15 +1827,15 @@ void ICACHE_FLASH_ATTR  user_init()
 #endif
     ip_addr_t netmask;
     ip_addr_t gw;
+    bool config_ok;
+    int i;
 
     // This interface number 2 is just to avoid any confusion with the WiFi-Interfaces (0 and 1)
     // Should be different in the name anyway - just to be sure
     // Matches the number in sio_open()
-    char int_no = 2;
+    char int_no = SIO_DEV_UART0;
 
     connected = false;
-    console_rx_buffer = ringbuf_new(80);
-    console_tx_buffer = ringbuf_new(MAX_CON_SEND_SIZE);
 
 #ifdef DEBUG_SOFTUART
     // Initialize software uart
@@ -886,17 +1854,36 @@ void ICACHE_FLASH_ATTR  user_init()
 #endif /* DEBUG_SOFTUART */
 
     // Load config
-    if (config_load(&config)== 0) {
+    config_ok = config_load(&config) == 0;
+
+#if IP_NAPT_DYNAMIC
+    // Size the NAPT tables as configured, the lib has not allocated them yet
+    ip_napt_init(config.nat_entries, config.portmap_entries);
+#endif
+    if (config.tcp_timeout != 0)
+	ip_napt_set_tcp_timeout(config.tcp_timeout);
+    if (config.udp_timeout != 0)
+	ip_napt_set_udp_timeout(config.udp_timeout);
+
+    if (config_ok) {
 	// valid config in FLASH, can read portmap table
-	blob_load(0, (uint32_t *)ip_portmap_table, sizeof(struct portmap_table) * IP_PORTMAP_MAX);
+	blob_load(0, (uint32_t *)ip_portmap_table, sizeof(struct portmap_table) * ip_portmap_max);
+	// the table may have grown since it was saved, the rest of the sector is erased flash
+	for (i = 0; i<ip_portmap_max; i++) {
+	    if (ip_portmap_table[i].valid != 1)
+		ip_portmap_table[i].valid = 0;
+	}
+	blob_load(WIFI_CACHE_BLOB, (uint32_t *)&wifi_cache, sizeof(wifi_cache));
     } else {
 
 	// clear portmap table
-	blob_zero(0, sizeof(struct portmap_table) * IP_PORTMAP_MAX);
+	blob_zero(0, sizeof(struct portmap_table) * ip_portmap_max);
+	blob_zero(ROUTE_BLOB, sizeof(struct route_entry) * ROUTE_MAX);
     }
+    route_load();
 
     g_bit_rate = config.bit_rate;
-    remote_console_disconnect = 0;
+    g_flow_control = config.flow_control;
 
     Bytes_in = Bytes_out = 0;
 
@@ -930,9 +1917,9 @@ void ICACHE_FLASH_ATTR  user_init()
 
     system_update_cpu_freq(config.clock_speed);
 
-    // The callback fn that unloads one char from the receive buffer of UART0
-    // We write it directly into the lwip pbufs
-    uart0_unload_fn = write_to_pbuf;
+    // The callback fn that unloads the receive buffer of UART0
+    // We write it directly into the lwip pbufs, the whole FIFO at once
+    uart0_unload_block_fn = write_block_to_pbuf;
 
     // Configure the SLIP interface
     if (config.use_ap) {
@@ -954,6 +1941,42 @@ void ICACHE_FLASH_ATTR  user_init()
 	ip_napt_enable(config.ip_addr.addr, 1);
     }
 
+#ifdef ENABLE_SLIP2
+    // Second serial link, a plain slipif on the softuart
+    slip2_init(&config.slip2_addr, config.slip2_nat);
+#endif
+
+    // Send whole packets into the UART buffer instead of one sio_send() per byte
+    sl_netif.output = slip_output;
+    slip_set_cslip(config.cslip);
+    slip_set_qos(config.qos);
+#ifdef ENABLE_LZF
+    slip_set_lz(config.compress);
+#endif
+
+#ifdef ENABLE_FASTPATH
+    // Established TCP flows bypass ip_forward and the NAPT lookup
+    fastpath_init(&sl_netif);
+#endif
+
+    // Forwarded connections get an MSS that fits the SLIP MTU
+    mss_clamp_init(&sl_netif, config.mss_clamp);
+
+#ifdef ENABLE_BENCH
+    bench_init(&sl_netif);
+#endif
+
+#ifdef ENABLE_TRACE
+    trace_init();
+#endif
+
+#ifdef ENABLE_METRICS
+    // Prometheus scrape target and optional UDP push
+    os_printf("Starting Metrics HTTP Server on %d port\r\n", METRICS_SERVER_PORT);
+    metrics_init(METRICS_SERVER_PORT);
+    metrics_set_push(config.metrics_interval, &config.metrics_collector, config.metrics_port);
+#endif
+
     // Start the telnet server (TCP)
     os_printf("Starting Console TCP Server on %d port\r\n", CONSOLE_SERVER_PORT);
     struct espconn *pCon = (struct espconn *)os_zalloc(sizeof(struct espconn));
@@ -974,6 +1997,7 @@ void ICACHE_FLASH_ATTR  user_init()
 
     // Put the connection in accept mode
     espconn_accept(pCon);
+    espconn_tcp_set_max_con_allow(pCon, MAX_CON_SESSIONS);
 
 #ifdef ENABLE_HAYES
     h_result(OKAY);